@@ -1,27 +1,294 @@
 #pragma once
 
+#include "DitherCore.h"
+
 #include "cinder/Surface.h"
 #include "cinder/Color.h"
 
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
 namespace reza {
 namespace dither {
-ci::Surface32fRef linear( ci::Surface32fRef input );
-ci::Surface32fRef linearRGB( ci::Surface32fRef input );
-ci::Surface32fRef FloydSteinberg( ci::Surface32fRef input );
-ci::Surface32fRef FloydSteinbergRGB( ci::Surface32fRef input );
-ci::Surface32fRef JarvisJudiceNinke( ci::Surface32fRef input );
-ci::Surface32fRef JarvisJudiceNinkeRGB( ci::Surface32fRef input );
-ci::Surface32fRef Stucki( ci::Surface32fRef input );
-ci::Surface32fRef StuckiRGB( ci::Surface32fRef input );
-ci::Surface32fRef Atkinson( ci::Surface32fRef input );
-ci::Surface32fRef AtkinsonRGB( ci::Surface32fRef input );
-ci::Surface32fRef Burkes( ci::Surface32fRef input );
-ci::Surface32fRef BurkesRGB( ci::Surface32fRef input );
-ci::Surface32fRef Sierra( ci::Surface32fRef input );
-ci::Surface32fRef SierraRGB( ci::Surface32fRef input );
-ci::Surface32fRef TwoRowSierra( ci::Surface32fRef input );
-ci::Surface32fRef TwoRowSierraRGB( ci::Surface32fRef input );
-ci::Surface32fRef SierraLite( ci::Surface32fRef input );
-ci::Surface32fRef SierraLiteRGB( ci::Surface32fRef input );
+
+namespace detail {
+class FrameDitherer;
+class Pool;
+class BatchState;
+}
+
+//! Returns a view of \a surface's pixels, which stay owned by the surface. The Surface functions below run the
+//! functions of DitherCore.h on these views, so they copy nothing either.
+inline ImageView32f toView( const ci::Surface32fRef &surface )
+{
+    return ImageView32f( surface->getData(), surface->getWidth(), surface->getHeight(), surface->getRowBytes(), surface->getPixelInc(),
+        surface->getRedOffset(), surface->getGreenOffset(), surface->getBlueOffset(), surface->hasAlpha() ? surface->getAlphaOffset() : -1 );
+}
+
+inline ImageView8u toView( const ci::Surface8uRef &surface )
+{
+    return ImageView8u( surface->getData(), surface->getWidth(), surface->getHeight(), surface->getRowBytes(), surface->getPixelInc(),
+        surface->getRedOffset(), surface->getGreenOffset(), surface->getBlueOffset(), surface->hasAlpha() ? surface->getAlphaOffset() : -1 );
+}
+
+ci::Surface32fRef linear( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef linearRGB( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef FloydSteinberg( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef FloydSteinbergRGB( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef JarvisJudiceNinke( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef JarvisJudiceNinkeRGB( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef Stucki( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef StuckiRGB( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef Atkinson( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef AtkinsonRGB( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef Burkes( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef BurkesRGB( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef Sierra( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef SierraRGB( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef TwoRowSierra( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef TwoRowSierraRGB( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef SierraLite( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef SierraLiteRGB( ci::Surface32fRef input, const Options &options = Options() );
+
+//! Versions of the above that write into \a output instead of a new surface. \a output may be \a input itself to
+//! dither in place; otherwise it must not overlap it. Only the area both surfaces cover is written. Single-threaded
+//! calls don't allocate once the first call has sized the per-thread scratch.
+void linear( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void linearRGB( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void FloydSteinberg( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void FloydSteinbergRGB( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void JarvisJudiceNinke( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void JarvisJudiceNinkeRGB( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void Stucki( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void StuckiRGB( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void Atkinson( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void AtkinsonRGB( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void Burkes( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void BurkesRGB( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void Sierra( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void SierraRGB( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void TwoRowSierra( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void TwoRowSierraRGB( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void SierraLite( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void SierraLiteRGB( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+
+//! Black-and-white versions of the above that write \a output's bits directly, one per pixel, without an RGBA float
+//! surface in between. The bits match the float versions pixel for pixel. Only the area both cover is written.
+void linear( ci::Surface32fRef input, Bitmap &output, const Options &options = Options() );
+void FloydSteinberg( ci::Surface32fRef input, Bitmap &output, const Options &options = Options() );
+void JarvisJudiceNinke( ci::Surface32fRef input, Bitmap &output, const Options &options = Options() );
+void Stucki( ci::Surface32fRef input, Bitmap &output, const Options &options = Options() );
+void Atkinson( ci::Surface32fRef input, Bitmap &output, const Options &options = Options() );
+void Burkes( ci::Surface32fRef input, Bitmap &output, const Options &options = Options() );
+void Sierra( ci::Surface32fRef input, Bitmap &output, const Options &options = Options() );
+void TwoRowSierra( ci::Surface32fRef input, Bitmap &output, const Options &options = Options() );
+void SierraLite( ci::Surface32fRef input, Bitmap &output, const Options &options = Options() );
+
+//! Color versions that write palette indices instead of colors: 0 to 3 for red, green, blue and black, which is the
+//! palette \a output is given.
+void linearRGB( ci::Surface32fRef input, IndexedImage &output, const Options &options = Options() );
+void FloydSteinbergRGB( ci::Surface32fRef input, IndexedImage &output, const Options &options = Options() );
+void JarvisJudiceNinkeRGB( ci::Surface32fRef input, IndexedImage &output, const Options &options = Options() );
+void StuckiRGB( ci::Surface32fRef input, IndexedImage &output, const Options &options = Options() );
+void AtkinsonRGB( ci::Surface32fRef input, IndexedImage &output, const Options &options = Options() );
+void BurkesRGB( ci::Surface32fRef input, IndexedImage &output, const Options &options = Options() );
+void SierraRGB( ci::Surface32fRef input, IndexedImage &output, const Options &options = Options() );
+void TwoRowSierraRGB( ci::Surface32fRef input, IndexedImage &output, const Options &options = Options() );
+void SierraLiteRGB( ci::Surface32fRef input, IndexedImage &output, const Options &options = Options() );
+
+//! Error diffusion to the nearest colors, in RGB distance, of \a palette. The search scans palettes of up to 32 colors
+//! four at a time and walks a k-d tree for larger ones, so the cost per pixel grows slowly with the palette size.
+//! The output alpha, if any, follows Options::alpha().
+ci::Surface32fRef linear( ci::Surface32fRef input, const Palette &palette, const Options &options = Options() );
+ci::Surface32fRef FloydSteinberg( ci::Surface32fRef input, const Palette &palette, const Options &options = Options() );
+ci::Surface32fRef JarvisJudiceNinke( ci::Surface32fRef input, const Palette &palette, const Options &options = Options() );
+ci::Surface32fRef Stucki( ci::Surface32fRef input, const Palette &palette, const Options &options = Options() );
+ci::Surface32fRef Atkinson( ci::Surface32fRef input, const Palette &palette, const Options &options = Options() );
+ci::Surface32fRef Burkes( ci::Surface32fRef input, const Palette &palette, const Options &options = Options() );
+ci::Surface32fRef Sierra( ci::Surface32fRef input, const Palette &palette, const Options &options = Options() );
+ci::Surface32fRef TwoRowSierra( ci::Surface32fRef input, const Palette &palette, const Options &options = Options() );
+ci::Surface32fRef SierraLite( ci::Surface32fRef input, const Palette &palette, const Options &options = Options() );
+void linear( ci::Surface32fRef input, ci::Surface32fRef output, const Palette &palette, const Options &options = Options() );
+void FloydSteinberg( ci::Surface32fRef input, ci::Surface32fRef output, const Palette &palette, const Options &options = Options() );
+void JarvisJudiceNinke( ci::Surface32fRef input, ci::Surface32fRef output, const Palette &palette, const Options &options = Options() );
+void Stucki( ci::Surface32fRef input, ci::Surface32fRef output, const Palette &palette, const Options &options = Options() );
+void Atkinson( ci::Surface32fRef input, ci::Surface32fRef output, const Palette &palette, const Options &options = Options() );
+void Burkes( ci::Surface32fRef input, ci::Surface32fRef output, const Palette &palette, const Options &options = Options() );
+void Sierra( ci::Surface32fRef input, ci::Surface32fRef output, const Palette &palette, const Options &options = Options() );
+void TwoRowSierra( ci::Surface32fRef input, ci::Surface32fRef output, const Palette &palette, const Options &options = Options() );
+void SierraLite( ci::Surface32fRef input, ci::Surface32fRef output, const Palette &palette, const Options &options = Options() );
+//! Versions that write the indices of the chosen \a palette colors and give \a output the palette. Indices are 8-bit,
+//! so only the first 256 colors of a larger palette are used.
+void linear( ci::Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options = Options() );
+void FloydSteinberg( ci::Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options = Options() );
+void JarvisJudiceNinke( ci::Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options = Options() );
+void Stucki( ci::Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options = Options() );
+void Atkinson( ci::Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options = Options() );
+void Burkes( ci::Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options = Options() );
+void Sierra( ci::Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options = Options() );
+void TwoRowSierra( ci::Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options = Options() );
+void SierraLite( ci::Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options = Options() );
+
+//! Builds a palette of up to \a colors colors for \a input, as buildPalette() on its view does.
+Palette buildPalette( ci::Surface32fRef input, int colors, const Options &options = Options() );
+Palette buildPalette( ci::Surface8uRef input, int colors, const Options &options = Options() );
+
+//! Error diffusion of a sequence of video frames that only re-dithers what changed. The context keeps the last
+//! frame's input and output and the error entering every band of Options::videoBandHeight() rows. A frame is compared
+//! band by band with the previous one; unchanged bands keep their output, and diffusion restarts at the first changed
+//! band from its saved error. Static regions therefore cost a comparison instead of a dither, and don't shimmer.
+//! Frames are dithered on the calling thread.
+class VideoDitherer {
+  public:
+    //! Dithers to black and white, or with \a rgb to red, green, blue and black.
+    VideoDitherer( Kernel kernel, bool rgb, const Options &options = Options() );
+    //! Dithers to the colors of \a palette.
+    VideoDitherer( Kernel kernel, const Palette &palette, const Options &options = Options() );
+    VideoDitherer( VideoDitherer &&other );
+    VideoDitherer &operator=( VideoDitherer &&other );
+    ~VideoDitherer();
+
+    //! Dithers \a frame and returns the output. The surface belongs to the context and is updated in place by the next
+    //! frame, so copy it to keep it. A frame of another size or layout than the last one starts over.
+    ci::Surface32fRef dither( ci::Surface32fRef frame );
+    //! Returns the number of rows the last frame actually diffused.
+    int getRowsDithered() const;
+    //! Forgets the previous frame, so the next one is dithered in full.
+    void reset();
+
+  private:
+    std::unique_ptr<detail::FrameDitherer> mImpl;
+    ci::Surface32fRef mOutput;
+};
+
+//! Dithers many surfaces on a persistent work-stealing pool of threads. Consecutive small images are packed into one
+//! task up to Options::batchPackPixels(); images of Options::batchSplitPixels() or more are dithered on every pool
+//! thread, as with Options::threads(), with the other pool threads picking up their rows in between other work.
+class BatchDitherer {
+  public:
+    //! Dithers \a input into \a output, e.g. a lambda that calls FloydSteinbergRGB( input, output, options ).
+    typedef std::function<void( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options )> Function;
+
+    struct Result {
+        //! Position of the image in the batch.
+        size_t index = 0;
+        ci::Surface32fRef output;
+        //! Wall time spent dithering the image.
+        double seconds = 0.0;
+        //! What dithering the image threw, with a null output, or null when it succeeded.
+        std::exception_ptr error;
+    };
+    typedef std::function<void( const Result &result )> Callback;
+
+    //! Starts a pool of \a threads threads, 0 for every hardware thread.
+    explicit BatchDitherer( size_t threads = 0 );
+    //! Waits for every image submitted, then stops the pool.
+    ~BatchDitherer();
+
+    size_t getThreads() const;
+
+    //! Queues \a inputs and returns a future result per input. Options::threads() is ignored, and a Stats in
+    //! \a options totals every image.
+    std::vector<std::future<Result>> dither( const std::vector<ci::Surface32fRef> &inputs, const Function &function, const Options &options = Options() );
+    //! Queues \a inputs and calls \a done on a pool thread as each one finishes, with Result::error set for an image
+    //! whose \a function threw.
+    void dither( const std::vector<ci::Surface32fRef> &inputs, const Function &function, const Callback &done, const Options &options = Options() );
+
+    //! Blocks until every image submitted so far is done, then rethrows the first exception a Callback threw since
+    //! the last call, if any.
+    void wait();
+
+  private:
+    std::unique_ptr<detail::BatchState> mState;
+    std::unique_ptr<detail::Pool> mPool;
+};
+
+//! 8-bit error diffusion. The error is carried in 1/16ths of a level in 16-bit integers and divided by the kernel
+//! with shifts or fixed-point multipliers, so the output is bit-exact on every platform and thread count, but it
+//! is not required to match the float versions pixel for pixel. The output alpha, if any, follows Options::alpha().
+ci::Surface8uRef linear( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef linearRGB( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef FloydSteinberg( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef FloydSteinbergRGB( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef JarvisJudiceNinke( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef JarvisJudiceNinkeRGB( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef Stucki( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef StuckiRGB( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef Atkinson( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef AtkinsonRGB( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef Burkes( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef BurkesRGB( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef Sierra( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef SierraRGB( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef TwoRowSierra( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef TwoRowSierraRGB( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef SierraLite( ci::Surface8uRef input, const Options &options = Options() );
+ci::Surface8uRef SierraLiteRGB( ci::Surface8uRef input, const Options &options = Options() );
+
+//! Versions of the 8-bit functions that write into \a output, which may be \a input itself.
+void linear( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void linearRGB( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void FloydSteinberg( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void FloydSteinbergRGB( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void JarvisJudiceNinke( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void JarvisJudiceNinkeRGB( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void Stucki( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void StuckiRGB( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void Atkinson( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void AtkinsonRGB( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void Burkes( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void BurkesRGB( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void Sierra( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void SierraRGB( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void TwoRowSierra( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void TwoRowSierraRGB( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void SierraLite( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+void SierraLiteRGB( ci::Surface8uRef input, ci::Surface8uRef output, const Options &options = Options() );
+
+//! Ordered dithering against a tiled N x N Bayer matrix. Pixels are independent of each other, so these are
+//! vectorized and scale with Options::threads().
+ci::Surface32fRef Bayer2( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef Bayer2RGB( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef Bayer4( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef Bayer4RGB( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef Bayer8( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef Bayer8RGB( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef Bayer16( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef Bayer16RGB( ci::Surface32fRef input, const Options &options = Options() );
+void Bayer2( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void Bayer2RGB( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void Bayer4( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void Bayer4RGB( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void Bayer8( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void Bayer8RGB( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void Bayer16( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void Bayer16RGB( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+//! Versions of the black-and-white Bayer functions that write packed bits, four pixels per SIMD compare.
+void Bayer2( ci::Surface32fRef input, Bitmap &output, const Options &options = Options() );
+void Bayer4( ci::Surface32fRef input, Bitmap &output, const Options &options = Options() );
+void Bayer8( ci::Surface32fRef input, Bitmap &output, const Options &options = Options() );
+void Bayer16( ci::Surface32fRef input, Bitmap &output, const Options &options = Options() );
+//! Versions of the color Bayer functions that write palette indices, as the indexed error diffusion functions do.
+void Bayer2RGB( ci::Surface32fRef input, IndexedImage &output, const Options &options = Options() );
+void Bayer4RGB( ci::Surface32fRef input, IndexedImage &output, const Options &options = Options() );
+void Bayer8RGB( ci::Surface32fRef input, IndexedImage &output, const Options &options = Options() );
+void Bayer16RGB( ci::Surface32fRef input, IndexedImage &output, const Options &options = Options() );
+
+//! Ordered dithering against a tiled void-and-cluster blue-noise mask, which looks close to error diffusion while
+//! keeping every pixel independent. A mask is generated once per size and process, and cached on disk when a cache
+//! directory is set.
+ci::Surface32fRef BlueNoise( ci::Surface32fRef input, const Options &options = Options() );
+ci::Surface32fRef BlueNoiseRGB( ci::Surface32fRef input, const Options &options = Options() );
+void BlueNoise( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void BlueNoiseRGB( ci::Surface32fRef input, ci::Surface32fRef output, const Options &options = Options() );
+void BlueNoise( ci::Surface32fRef input, Bitmap &output, const Options &options = Options() );
+void BlueNoiseRGB( ci::Surface32fRef input, IndexedImage &output, const Options &options = Options() );
+
+//! Measures how visible the seams of a striped dither are, as seamVisibility() on views of the surfaces does.
+float seamVisibility( ci::Surface32fRef source, ci::Surface32fRef dithered, int stripeHeight );
 }
 }
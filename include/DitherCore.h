@@ -0,0 +1,512 @@
+#pragma once
+
+// The part of the library that depends on nothing but the standard library: the options,
+// palettes and output types, and every algorithm on plain views of pixel memory. Dither.h
+// adds the Cinder Surface interface on top of it.
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace reza {
+namespace dither {
+
+//! Counters a call fills in when given one through Options::stats(). Calls add to the counters, so one Stats can total
+//! a series of calls, but concurrent calls need a Stats each.
+struct Stats {
+    //! Time spent building palettes, blue-noise masks and palette tables.
+    double setupSeconds = 0.0;
+    //! Time spent creating output surfaces.
+    double allocationSeconds = 0.0;
+    //! Wall time of the dithering itself. Quantization and diffusion happen in the same pass over the pixels.
+    double ditherSeconds = 0.0;
+    size_t pixels = 0;
+    //! Bytes of output surfaces and scratch allocated. Scratch that is reused from an earlier call isn't counted.
+    size_t bytesAllocated = 0;
+
+    //! Dither wall time multiplied by the threads used, the part of it the threads spent working, and the part of that
+    //! they spent waiting for the rows above them.
+    double threadSeconds = 0.0;
+    double busySeconds = 0.0;
+    double waitSeconds = 0.0;
+
+    //! Returns the fraction of the available thread time spent doing useful work.
+    double getThreadUtilization() const { return threadSeconds > 0.0 ? ( busySeconds - waitSeconds ) / threadSeconds : 0.0; }
+};
+
+//! What the float and 8-bit functions write to the output's alpha channel. Alpha never takes part in the dithering
+//! itself, so it doesn't change which colors are picked.
+enum class AlphaPolicy {
+    //! Writes every pixel opaque, the default.
+    Ignore,
+    //! Copies each pixel's alpha from the input, so transparent sprites keep their edges. Opaque inputs give opaque
+    //! pixels.
+    Preserve,
+    //! Writes pixels whose input alpha reaches the threshold opaque and the rest fully transparent.
+    Threshold
+};
+
+//! Settings shared by the dithering functions.
+class Options {
+  public:
+    Options() {}
+
+    //! Sets the number of threads used. 0 uses every hardware thread. Defaults to 1.
+    //! Error diffusion pipelines rows across threads and stays bit-identical to the single-threaded result.
+    Options &threads( size_t count )
+    {
+        mThreads = count;
+        return *this;
+    }
+    size_t getThreads() const { return mThreads; }
+
+    //! Enables striped error diffusion: the image is cut into horizontal stripes of \a height rows that are
+    //! dithered independently and concurrently. Each stripe seeds its boundary error by first diffusing the
+    //! \a seedRows rows above it and keeping the local average of that error, which makes the seams fainter than
+    //! starting from no error but does not reproduce the serial output. Every stripe keeps its own error lines.
+    //! 0 disables striping, which is the default.
+    Options &stripes( int height, int seedRows = 16 )
+    {
+        mStripeHeight = height;
+        mStripeSeedRows = seedRows;
+        return *this;
+    }
+    int getStripeHeight() const { return mStripeHeight; }
+    int getStripeSeedRows() const { return mStripeSeedRows; }
+
+    //! Makes black-and-white error diffusion work on luminance: each pixel is reduced to its Rec. 709 luminance once,
+    //! compared with one half, and its error spread as a single value instead of an RGBA color, which is about a
+    //! quarter of the arithmetic and error memory and takes no square roots. Colored inputs dither differently from
+    //! the default, which picks the closer of white and black in RGBA and so weighs red, green and blue equally.
+    //! Applies to the black-and-white float, 8-bit and Bitmap functions, Ditherer and VideoDitherer. Defaults to false.
+    Options &luminance( bool enable = true )
+    {
+        mLuminance = enable;
+        return *this;
+    }
+    bool getLuminance() const { return mLuminance; }
+
+    //! Sets what is written to the output's alpha, and the input alpha from which AlphaPolicy::Threshold writes
+    //! opaque pixels. Defaults to AlphaPolicy::Ignore.
+    Options &alpha( AlphaPolicy policy, float threshold = 0.5f )
+    {
+        mAlphaPolicy = policy;
+        mAlphaThreshold = threshold;
+        return *this;
+    }
+    AlphaPolicy getAlphaPolicy() const { return mAlphaPolicy; }
+    float getAlphaThreshold() const { return mAlphaThreshold; }
+
+    //! Sets the side of the tiled blue-noise mask, rounded up to a power of two between 4 and 256. Defaults to 64.
+    Options &blueNoiseSize( int size )
+    {
+        mBlueNoiseSize = size;
+        return *this;
+    }
+    int getBlueNoiseSize() const { return mBlueNoiseSize; }
+
+    //! Answers palette lookups from a precomputed table of \a resolution^3 cells, rounded up to a power of two between
+    //! 8 and 128, which turns most lookups into a single fetch with the same result. It pays off from about 16 colors.
+    //! A table is built once per palette and resolution, and cached on disk when a cache directory is set. 0, the
+    //! default, searches the palette directly.
+    Options &paletteTable( int resolution )
+    {
+        mPaletteTableResolution = resolution;
+        return *this;
+    }
+    int getPaletteTableResolution() const { return mPaletteTableResolution; }
+
+    //! Caps the pixels buildPalette() looks at. Larger images are read on an even grid, like a downsampled preview.
+    //! Defaults to 262144, a 512 x 512 preview.
+    Options &paletteSamples( size_t count )
+    {
+        mPaletteSamples = count;
+        return *this;
+    }
+    size_t getPaletteSamples() const { return mPaletteSamples; }
+
+    //! Sets the most k-means passes buildPalette() refines the median-cut colors with. Defaults to 8.
+    Options &paletteIterations( int count )
+    {
+        mPaletteIterations = count;
+        return *this;
+    }
+    int getPaletteIterations() const { return mPaletteIterations; }
+
+    //! Sets how far, per channel, a VideoDitherer frame may differ from the last dithered input of a band before the
+    //! band counts as changed. Defaults to 0, so any change counts.
+    Options &videoThreshold( float threshold )
+    {
+        mVideoThreshold = threshold;
+        return *this;
+    }
+    float getVideoThreshold() const { return mVideoThreshold; }
+
+    //! Sets the height of the bands a VideoDitherer compares and re-dithers frames in. Defaults to 16.
+    Options &videoBandHeight( int height )
+    {
+        mVideoBandHeight = height;
+        return *this;
+    }
+    int getVideoBandHeight() const { return mVideoBandHeight; }
+
+    //! Sets how many rows past the last changed band a VideoDitherer keeps re-dithering while the carried error still
+    //! differs from the previous frame's. The rest keeps the previous output, so the cost follows the changed area.
+    //! Defaults to 16. -1 re-dithers until the error matches again, which makes every frame identical to dithering
+    //! it from scratch.
+    Options &videoSettleRows( int rows )
+    {
+        mVideoSettleRows = rows;
+        return *this;
+    }
+    int getVideoSettleRows() const { return mVideoSettleRows; }
+
+    //! Sets the size, in pixels, from which a BatchDitherer dithers an image on every pool thread instead of one.
+    //! Defaults to 1048576.
+    Options &batchSplitPixels( size_t pixels )
+    {
+        mBatchSplitPixels = pixels;
+        return *this;
+    }
+    size_t getBatchSplitPixels() const { return mBatchSplitPixels; }
+
+    //! Sets how many pixels of consecutive small images a BatchDitherer packs into one task. Defaults to 65536.
+    Options &batchPackPixels( size_t pixels )
+    {
+        mBatchPackPixels = pixels;
+        return *this;
+    }
+    size_t getBatchPackPixels() const { return mBatchPackPixels; }
+
+    //! Makes calls add their timings and counters to \a stats, which must outlive them. Null, the default, records
+    //! nothing and costs nothing.
+    Options &stats( Stats *stats )
+    {
+        mStats = stats;
+        return *this;
+    }
+    Stats *getStats() const { return mStats; }
+
+  private:
+    size_t mThreads = 1;
+    int mStripeHeight = 0;
+    int mStripeSeedRows = 16;
+    bool mLuminance = false;
+    AlphaPolicy mAlphaPolicy = AlphaPolicy::Ignore;
+    float mAlphaThreshold = 0.5f;
+    int mBlueNoiseSize = 64;
+    int mPaletteTableResolution = 0;
+    size_t mPaletteSamples = 262144;
+    int mPaletteIterations = 8;
+    float mVideoThreshold = 0.0f;
+    int mVideoBandHeight = 16;
+    int mVideoSettleRows = 16;
+    size_t mBatchSplitPixels = 1 << 20;
+    size_t mBatchPackPixels = 1 << 16;
+    Stats *mStats = nullptr;
+};
+
+namespace detail {
+class PaletteSearch;
+class RowDitherer;
+}
+
+//! A palette entry: an RGB color with float channels. Converts implicitly to and from any color type with float r, g
+//! and b members, such as ci::Color, so palettes can be written and read in the caller's own color type.
+struct PaletteColor {
+    PaletteColor() {}
+    PaletteColor( float r, float g, float b )
+        : r( r ), g( g ), b( b )
+    {
+    }
+    template<typename ColorT, typename = std::enable_if_t<std::is_floating_point<decltype( std::declval<const ColorT &>().r )>::value>>
+    PaletteColor( const ColorT &color )
+        : r( static_cast<float>( color.r ) ), g( static_cast<float>( color.g ) ), b( static_cast<float>( color.b ) )
+    {
+    }
+    template<typename ColorT, typename = std::enable_if_t<std::is_floating_point<decltype( std::declval<const ColorT &>().r )>::value>>
+    operator ColorT() const
+    {
+        return ColorT( r, g, b );
+    }
+
+    float r = 0.0f, g = 0.0f, b = 0.0f;
+};
+
+//! Channel layouts of an image view, named like Cinder's SurfaceChannelOrder. X channels are padding, never read or
+//! written.
+enum class ChannelOrder { RGBA, BGRA, ARGB, ABGR, RGBX, BGRX, XRGB, XBGR, RGB, BGR };
+
+//! A view of pixels the caller owns: \a width x \a height pixels of \a T channels, with rows starting \a rowBytes
+//! apart. The functions below read and write straight through views, so pixels held by a decoder, a frame grabber or
+//! another library are dithered without a conversion copy. Copies of a view share the pixels.
+template<typename T>
+class ImageViewT {
+  public:
+    //! An empty view.
+    ImageViewT() {}
+    ImageViewT( T *data, int width, int height, ptrdiff_t rowBytes, ChannelOrder order = ChannelOrder::RGBA )
+        : mData( data ), mWidth( width ), mHeight( height ), mRowBytes( rowBytes )
+    {
+        // red, green, blue and alpha offsets of each order, -1 for no alpha
+        static const int offsets[][4] = { { 0, 1, 2, 3 }, { 2, 1, 0, 3 }, { 1, 2, 3, 0 }, { 3, 2, 1, 0 }, { 0, 1, 2, -1 }, { 2, 1, 0, -1 },
+            { 1, 2, 3, -1 }, { 3, 2, 1, -1 }, { 0, 1, 2, -1 }, { 2, 1, 0, -1 } };
+        const int *offset = offsets[static_cast<int>( order )];
+        mPixelInc = order == ChannelOrder::RGB || order == ChannelOrder::BGR ? 3 : 4;
+        mRed = offset[0];
+        mGreen = offset[1];
+        mBlue = offset[2];
+        mAlpha = offset[3];
+    }
+    //! A view of pixels of \a pixelInc channels, with red, green, blue and alpha at the given offsets. \a alpha is -1
+    //! for pixels without alpha.
+    ImageViewT( T *data, int width, int height, ptrdiff_t rowBytes, int pixelInc, int red, int green, int blue, int alpha )
+        : mData( data ), mWidth( width ), mHeight( height ), mRowBytes( rowBytes ), mPixelInc( pixelInc ), mRed( red ), mGreen( green ),
+          mBlue( blue ), mAlpha( alpha )
+    {
+    }
+
+    T *getData() const { return mData; }
+    T *getRow( int y ) const { return reinterpret_cast<T *>( reinterpret_cast<uint8_t *>( mData ) + y * mRowBytes ); }
+    int getWidth() const { return mWidth; }
+    int getHeight() const { return mHeight; }
+    ptrdiff_t getRowBytes() const { return mRowBytes; }
+
+    int getPixelInc() const { return mPixelInc; }
+    int getRedOffset() const { return mRed; }
+    int getGreenOffset() const { return mGreen; }
+    int getBlueOffset() const { return mBlue; }
+    //! Returns the offset of alpha, or -1 without alpha.
+    int getAlphaOffset() const { return mAlpha; }
+    bool hasAlpha() const { return mAlpha >= 0; }
+
+  private:
+    T *mData = nullptr;
+    int mWidth = 0, mHeight = 0;
+    ptrdiff_t mRowBytes = 0;
+    int mPixelInc = 4;
+    int mRed = 0, mGreen = 1, mBlue = 2, mAlpha = 3;
+};
+
+typedef ImageViewT<float> ImageView32f;
+typedef ImageViewT<uint8_t> ImageView8u;
+
+//! An ordered set of colors to dither to. Constructing a palette prepares its nearest-color search, so build it once
+//! and reuse it; copies are cheap and share that data.
+class Palette {
+  public:
+    //! An empty palette, which dithers everything to black.
+    Palette();
+    Palette( const std::vector<PaletteColor> &colors );
+    //! Converts \a colors of another color type first, e.g. a std::vector<ci::Color>.
+    template<typename ColorT>
+    Palette( const std::vector<ColorT> &colors )
+        : Palette( std::vector<PaletteColor>( colors.begin(), colors.end() ) )
+    {
+    }
+
+    const std::vector<PaletteColor> &getColors() const;
+    size_t size() const { return getColors().size(); }
+    bool empty() const { return getColors().empty(); }
+
+    //! Returns the index of the color closest to \a color in RGB, the lowest index on ties.
+    size_t nearest( const PaletteColor &color ) const;
+
+    const detail::PaletteSearch &getSearch() const { return *mSearch; }
+
+  private:
+    std::shared_ptr<const detail::PaletteSearch> mSearch;
+};
+
+//! A packed 1-bit-per-pixel image, the compact output of the black-and-white algorithms. Each row starts at a multiple
+//! of getRowBytes(). Copies share the pixels.
+class Bitmap {
+  public:
+    //! How pixels are packed into bytes and rows.
+    class Format {
+      public:
+        Format() {}
+
+        //! Puts the leftmost pixel of each byte in its most significant bit, the default, or with false in its least
+        //! significant bit.
+        Format &msbFirst( bool msb )
+        {
+            mMsbFirst = msb;
+            return *this;
+        }
+        bool isMsbFirst() const { return mMsbFirst; }
+
+        //! Pads every row to a multiple of \a bytes. Defaults to 1, which only pads rows to whole bytes.
+        Format &rowAlignment( int bytes )
+        {
+            mRowAlignment = bytes;
+            return *this;
+        }
+        int getRowAlignment() const { return mRowAlignment; }
+
+        //! Stores black pixels as 1 bits and white ones as 0 bits, as PBM files and most printers expect. Defaults to
+        //! false, which stores white pixels as 1 bits.
+        Format &blackIsOne( bool black )
+        {
+            mBlackIsOne = black;
+            return *this;
+        }
+        bool isBlackIsOne() const { return mBlackIsOne; }
+
+        //! Returns the bytes a row of \a width pixels takes, padding included.
+        size_t getRowBytes( int width ) const;
+
+      private:
+        bool mMsbFirst = true;
+        int mRowAlignment = 1;
+        bool mBlackIsOne = false;
+    };
+
+    //! An empty bitmap.
+    Bitmap();
+    //! Allocates a \a width x \a height bitmap with every bit cleared.
+    Bitmap( int width, int height, const Format &format = Format() );
+    //! Wraps \a data, rows of \a rowBytes bytes that the caller keeps alive, e.g. a display's frame buffer.
+    Bitmap( uint8_t *data, int width, int height, size_t rowBytes, const Format &format = Format() );
+
+    int getWidth() const { return mWidth; }
+    int getHeight() const { return mHeight; }
+    size_t getRowBytes() const { return mRowBytes; }
+    const Format &getFormat() const { return mFormat; }
+
+    uint8_t *getData() const { return mData; }
+    uint8_t *getRow( int y ) const { return mData + y * mRowBytes; }
+    //! Returns whether pixel ( \a x, \a y ) is white.
+    bool isWhite( int x, int y ) const;
+
+  private:
+    std::shared_ptr<std::vector<uint8_t>> mStorage;
+    uint8_t *mData;
+    int mWidth, mHeight;
+    size_t mRowBytes;
+    Format mFormat;
+};
+
+//! An image of 8-bit palette indices and the palette they refer to, ready for PNG-8 or GIF encoding or for upload as a
+//! single-channel texture. Each row starts at a multiple of getRowBytes(). Copies share the pixels.
+class IndexedImage {
+  public:
+    //! An empty image.
+    IndexedImage();
+    //! Allocates a \a width x \a height image, each row padded to a multiple of \a rowAlignment bytes.
+    IndexedImage( int width, int height, int rowAlignment = 1 );
+    //! Wraps \a data, rows of \a rowBytes bytes that the caller keeps alive.
+    IndexedImage( uint8_t *data, int width, int height, size_t rowBytes );
+
+    int getWidth() const { return mWidth; }
+    int getHeight() const { return mHeight; }
+    size_t getRowBytes() const { return mRowBytes; }
+
+    uint8_t *getData() const { return mData; }
+    uint8_t *getRow( int y ) const { return mData + y * mRowBytes; }
+
+    //! Returns the colors the indices refer to, which the dithering functions set.
+    const Palette &getPalette() const { return mPalette; }
+    void setPalette( const Palette &palette ) { mPalette = palette; }
+
+  private:
+    std::shared_ptr<std::vector<uint8_t>> mStorage;
+    uint8_t *mData;
+    int mWidth, mHeight;
+    size_t mRowBytes;
+    Palette mPalette;
+};
+
+//! The error diffusion kernels, for the interfaces that pick one at run time.
+enum class Kernel { Linear, FloydSteinberg, JarvisJudiceNinke, Stucki, Atkinson, Burkes, Sierra, TwoRowSierra, SierraLite };
+
+//! Error diffusion of an image that arrives one row at a time, e.g. straight from a decoder, and leaves the same way.
+//! Only the few rows of error the kernel spreads into are kept, so memory grows with the width and not the height.
+//! Rows are \a width pixels of packed r, g, b floats, followed by a when \a alpha is set. A whole image pushed
+//! through comes out the same as the Surface32f function for the kernel gives for a surface of that layout.
+class Ditherer {
+  public:
+    //! Dithers to black and white, or with \a rgb to red, green, blue and black. Of \a options only the alpha policy
+    //! and, for black and white, luminance apply.
+    Ditherer( Kernel kernel, int width, bool rgb, bool alpha = true, const Options &options = Options() );
+    //! Dithers to the colors of \a palette, through a palette table if \a options asks for one.
+    Ditherer( Kernel kernel, int width, const Palette &palette, bool alpha = true, const Options &options = Options() );
+    Ditherer( Ditherer &&other );
+    Ditherer &operator=( Ditherer &&other );
+    ~Ditherer();
+
+    int getWidth() const;
+    //! Returns the number of rows pushed since construction or the last reset().
+    int getRow() const;
+
+    //! Dithers the next row. Its output is ready to pull right away.
+    void push( const float *row );
+    //! Copies the oldest output row not pulled yet into \a row and returns true, or returns false if there is none.
+    //! Output rows are buffered until pulled, so pull as often as you push to keep memory bounded.
+    bool pull( float *row );
+    //! Dithers the next row from \a input straight into \a output, which may be \a input, without buffering.
+    void process( const float *input, float *output );
+
+    //! Starts a new image, clearing the error and dropping the rows not pulled yet.
+    void reset();
+
+  private:
+    std::unique_ptr<detail::RowDitherer> mImpl;
+};
+
+//! Error diffusion of \a input into \a output with \a kernel, to black and white or with \a rgb to red, green, blue
+//! and black. The named Surface32f functions of Dither.h are these on views of their surfaces. \a output may be
+//! \a input to dither in place; otherwise it must not overlap it. Only the area both views cover is written.
+void diffuse( Kernel kernel, const ImageView32f &input, const ImageView32f &output, bool rgb, const Options &options = Options() );
+//! Black-and-white error diffusion into the bits of \a output.
+void diffuse( Kernel kernel, const ImageView32f &input, Bitmap &output, const Options &options = Options() );
+//! Color error diffusion into the indices of red, green, blue and black, which is the palette \a output is given.
+void diffuse( Kernel kernel, const ImageView32f &input, IndexedImage &output, const Options &options = Options() );
+//! Error diffusion to the nearest colors of \a palette, written as colors or as indices.
+void diffuse( Kernel kernel, const ImageView32f &input, const ImageView32f &output, const Palette &palette, const Options &options = Options() );
+void diffuse( Kernel kernel, const ImageView32f &input, IndexedImage &output, const Palette &palette, const Options &options = Options() );
+//! 8-bit fixed-point error diffusion, bit-exact on every platform and thread count. The output alpha, if any, follows
+//! Options::alpha().
+void diffuse( Kernel kernel, const ImageView8u &input, const ImageView8u &output, bool rgb, const Options &options = Options() );
+
+//! Ordered dithering against a tiled \a size x \a size Bayer matrix, \a size rounded up to a power of two between 2
+//! and 16, to black and white or with \a rgb to red, green, blue and black.
+void bayer( int size, const ImageView32f &input, const ImageView32f &output, bool rgb, const Options &options = Options() );
+void bayer( int size, const ImageView32f &input, Bitmap &output, const Options &options = Options() );
+void bayer( int size, const ImageView32f &input, IndexedImage &output, const Options &options = Options() );
+
+//! Ordered dithering against the tiled blue-noise mask of Options::blueNoiseSize().
+void blueNoise( const ImageView32f &input, const ImageView32f &output, bool rgb, const Options &options = Options() );
+void blueNoise( const ImageView32f &input, Bitmap &output, const Options &options = Options() );
+void blueNoise( const ImageView32f &input, IndexedImage &output, const Options &options = Options() );
+
+//! Builds a palette of up to \a colors colors for \a input: median cut over a 15-bit histogram of a preview of the
+//! image, refined by k-means on the same histogram. Both the histogram and the k-means passes use Options::threads(),
+//! and the result does not depend on the thread count. Alpha is ignored and float input is clamped to [0, 1].
+Palette buildPalette( const ImageView32f &input, int colors, const Options &options = Options() );
+Palette buildPalette( const ImageView8u &input, int colors, const Options &options = Options() );
+
+//! Sets the directory where blue-noise masks are saved and looked up, so later runs skip generating them.
+//! An empty path, the default, keeps masks in memory only.
+void setBlueNoiseCacheDirectory( const std::filesystem::path &directory );
+
+//! Sets the directory where palette tables are saved and looked up by a hash of the palette, so later runs skip
+//! building them. An empty path, the default, keeps tables in memory only.
+void setPaletteTableCacheDirectory( const std::filesystem::path &directory );
+
+//! Called when a scoped zone the library marks around its phases begins or ends, with the zone's name, e.g. to forward
+//! the zones to a profiler. Zones only exist in builds with REZA_DITHER_ZONES defined; otherwise they compile to
+//! nothing and the hooks are never called. Hooks may be called from any thread.
+typedef void ( *ZoneHook )( const char *name );
+void setZoneHooks( ZoneHook begin, ZoneHook end );
+
+//! Measures how visible the seams of a striped dither with stripes of \a stripeHeight rows are. The local error
+//! ( \a dithered - \a source, box filtered over 4x4 pixels ) is averaged over the rows next to the seams and
+//! divided by its average over the whole image. Values near 1 mean the seams cannot be told apart from the rest.
+float seamVisibility( const ImageView32f &source, const ImageView32f &dithered, int stripeHeight );
+}
+}
@@ -1,1436 +1,867 @@
-#include "Dither.h"
-
-using namespace ci;
+#include "DitherCore.h"
+#include "DitherBitmap.h"
+#include "DitherCommon.h"
+#include "DitherDiffusion.h"
+#include "DitherKernels.h"
+#include "DitherPalette.h"
+#include "DitherStats.h"
+#include "DitherVideo.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
 
 namespace reza {
 namespace dither {
     
 namespace {
-    const ColorA white = ColorA( 1.0, 1.0, 1.0, 0.0 );
-    const ColorA whiteColor = ColorA( 1.0, 1.0, 1.0, 1.0 );
-    const ColorA red = ColorA( 1.0, 0.0, 0.0, 0.0 );
-    const ColorA redColor = ColorA( 1.0, 0.0, 0.0, 1.0 );
-    const ColorA green = ColorA( 0.0, 1.0, 0.0, 0.0 );
-    const ColorA greenColor = ColorA( 0.0, 1.0, 0.0, 1.0 );
-    const ColorA blue = ColorA( 0.0, 0.0, 1.0, 0.0 );
-    const ColorA blueColor = ColorA( 0.0, 0.0, 1.0, 1.0 );
-    const ColorA black = ColorA( 0.0, 0.0, 0.0, 0.0 );
-    const ColorA blackColor = ColorA( 0.0, 0.0, 0.0, 1.0 );
-}
-
-Surface32fRef linear( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
-
-    int width = input->getWidth();
-    int height = input->getHeight();
-    
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float whiteDist = length( total - white );
-            float blackDist = length( total - black );
-            
-            if( whiteDist <= blackDist ) {
-                color.set( CM_RGB, whiteColor );
-                error = total - whiteColor;
+    using namespace detail;
+    using simd::Vec4;
+
+    // Spreads the (already divided) r, g, b error over the kernel's taps, starting at tap
+    // I. The tap table is a compile-time constant, so this expands to straight-line code
+    // for every kernel; horizontally adjacent taps on the same row share their accesses.
+    template<typename Kernel, size_t I = 0>
+    void scatter( float *const *lines, int x, const Vec4 &error )
+    {
+        constexpr size_t count = Kernel::taps.size();
+        if constexpr( I < count ) {
+            constexpr Tap tap = Kernel::taps[I];
+            float *target = lines[tap.dy] + ( x + tap.dx ) * 3;
+            if constexpr( I + 1 < count && Kernel::taps[I + 1].dy == tap.dy && Kernel::taps[I + 1].dx == tap.dx + 1 ) {
+                simd::accumulate3x2( target, error * tap.weight, error * Kernel::taps[I + 1].weight );
+                scatter<Kernel, I + 2>( lines, x, error );
             }
             else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
-
-            if( x < ( width - 1 ) ) {
-                auto posRgt = ivec2( x + 1, y );
-                auto pxlRgt = output->getPixel( posRgt );
-                output->setPixel( posRgt, pxlRgt + error );
+                simd::accumulate3( target, error * tap.weight );
+                scatter<Kernel, I + 1>( lines, x, error );
             }
-
-            output->setPixel( pos, color );
         }
     }
 
-    return output;
-}
-
-Surface32fRef linearRGB( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
-    
-    int width = input->getWidth();
-    int height = input->getHeight();
-    
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float redDist = length( total - red );
-            float greenDist = length( total - green );
-            float blueDist = length( total - blue );
-            float blackDist = length( total - black );
-            
-            if( redDist <= greenDist && redDist <= blueDist && redDist <= blackDist ) {
-                color.set( CM_RGB, redColor );
-                error = total - redColor;
-            }
-            else if( greenDist <= redDist && greenDist <= blueDist && greenDist <= blackDist ) {
-                color.set( CM_RGB, greenColor );
-                error = total - greenColor;
-            }
-            else if( blueDist <= redDist && blueDist <= greenDist && blueDist <= blackDist ) {
-                color.set( CM_RGB, blueColor );
-                error = total - blueColor;
-            }
-            else if( blackDist <= redDist && blackDist <= greenDist && blackDist <= blueDist ) {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor - redColor - blueColor - greenColor;
-            }
-            
-            if( x < ( width - 1 ) ) {
-                auto posRgt = ivec2( x + 1, y );
-                auto pxlRgt = output->getPixel( posRgt );
-                output->setPixel( posRgt, pxlRgt + error );
-            }
-            
-            output->setPixel( pos, color );
-        }
+    // The accumulated color of a pixel read from \a view: its error plus its source color.
+    // Alpha takes no part in the error. The quantizers see the alpha an opaque pixel of
+    // that layout always accumulated: 1 with an alpha channel, and 2 without one, where
+    // the alpha-less accumulator surface read back opaque on top of the source's own.
+    // That keeps every opaque decision, rounding included, what it was, and makes
+    // transparent pixels dither like opaque ones.
+    inline Vec4 accumulated( const float *error, const Vec4 &source, const SurfaceView &view )
+    {
+        return ( Vec4::load3( error ) + source ).withAlpha( view.hasAlpha() ? 1.0f : 2.0f );
     }
-    
-    return output;
-}
 
-//  FloydSteinberg (1/16)
-//      X   7
-//  3   5   1
-Surface32fRef FloydSteinberg( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
+    // Spreads a single-channel error over the kernel's taps, expanded at compile time.
+    template<typename Kernel, size_t... I>
+    void scatterLuminance( float *const *lines, int x, float error, std::index_sequence<I...> )
+    {
+        ( ( lines[Kernel::taps[I].dy][x + Kernel::taps[I].dx] += error * Kernel::taps[I].weight ), ... );
+    }
 
-    int width = input->getWidth();
-    int height = input->getHeight();
-    
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float whiteDist = length( total - white );
-            float blackDist = length( total - black );
-            
-            if( whiteDist <= blackDist ) {
-                color.set( CM_RGB, whiteColor );
-                error = total - whiteColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
+    // Error diffusion of a float surface through packed r, g, b float error lines.
+    template<typename Kernel, typename Quantizer>
+    class DiffusionPass {
+      public:
+        typedef ErrorRows<Kernel, float, 3> Rows;
 
-            error /= 16.0;
+        DiffusionPass( const SurfaceView &src, const SurfaceView &dst, const Quantizer &quantize, const AlphaOutput &alpha )
+            : mSrc( src ), mDst( dst ), mQuantize( quantize ), mAlpha( alpha ), mSink( nullptr, 0 )
+        {
+        }
 
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 7.0f );
-            }
+        //! Points the pass at other surfaces, keeping its quantizer and scratch.
+        void bind( const SurfaceView &src, const SurfaceView &dst )
+        {
+            mSrc = src;
+            mDst = dst;
+        }
 
-            if( y < ( height - 1 ) ) {
-                if( ( x - 1 ) >= 0 ) {
-                    auto posLeft = ivec2( x - 1, y + 1 );
-                    auto pxlLeft = output->getPixel( posLeft );
-                    output->setPixel( posLeft, pxlLeft + error * 3.0f );
+        //! Quantizes pixels [x0, x1) of row y and spreads their error through \a lines.
+        void operator()( float *const *lines, int y, int x0, int x1, bool discard )
+        {
+            const SurfaceView &dst = discard ? sink( x1 ) : mDst;
+            const float *in = mSrc.row( y ) + x0 * mSrc.pixelInc();
+            float *out = dst.row( y ) + x0 * dst.pixelInc();
+            for( int x = x0; x < x1; x++, in += mSrc.pixelInc(), out += dst.pixelInc() ) {
+                const Vec4 source = mSrc.read( in );
+                const Vec4 total = accumulated( lines[0] + x * 3, source, mSrc );
+                const Vec4 color = mQuantize( total );
+                Vec4 error;
+                if constexpr( hasExactReciprocal( Kernel::divisor ) ) {
+                    error = ( total - color ) * ( 1.0f / Kernel::divisor );
                 }
-
-                auto posCen = ivec2( x, y + 1 );
-                auto pxlCen = output->getPixel( posCen );
-                output->setPixel( posCen, pxlCen + error * 5.0f );
-
-                if( x < ( width - 1 ) ) {
-                    auto posRgt = ivec2( x + 1, y + 1 );
-                    auto pxlRgt = output->getPixel( posRgt );
-                    output->setPixel( posRgt, pxlRgt + error * 1.0f );
+                else {
+                    error = ( total - color ) / Kernel::divisor;
                 }
-            }
-
-            output->setPixel( pos, color );
-        }
-    }
-
-    return output;
-}
-
-//  FloydSteinbergRGB (1/16)
-//      X   7
-//  3   5   1
-Surface32fRef FloydSteinbergRGB( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
 
-    int width = input->getWidth();
-    int height = input->getHeight();
+                scatter<Kernel>( lines, x, error );
 
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-
-            float redDist = length( total - red );
-            float greenDist = length( total - green );
-            float blueDist = length( total - blue );
-            float blackDist = length( total - black );
-
-            if( redDist <= greenDist && redDist <= blueDist && redDist <= blackDist ) {
-                color.set( CM_RGB, redColor );
-                error = total - redColor;
-            }
-            else if( greenDist <= redDist && greenDist <= blueDist && greenDist <= blackDist ) {
-                color.set( CM_RGB, greenColor );
-                error = total - greenColor;
-                ;
-            }
-            else if( blueDist <= redDist && blueDist <= greenDist && blueDist <= blackDist ) {
-                color.set( CM_RGB, blueColor );
-                error = total - blueColor;
-            }
-            else if( blackDist <= redDist && blackDist <= greenDist && blackDist <= blueDist ) {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor - redColor - blueColor - greenColor;
+                dst.write( out, mAlpha( color, source ) );
             }
+        }
 
-            error /= 16.0;
-
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 7.0f );
+      private:
+        // A single throwaway row that every discarded row is written to.
+        const SurfaceView &sink( int width )
+        {
+            if( mScratch.size() < size_t( width ) * 4 ) {
+                mScratch.resize( width * 4 );
+                mSink = SurfaceView( mScratch.data(), 0 );
             }
+            return mSink;
+        }
 
-            if( y < ( height - 1 ) ) {
-                if( ( x - 1 ) >= 0 ) {
-                    auto posLeft = ivec2( x - 1, y + 1 );
-                    auto pxlLeft = output->getPixel( posLeft );
-                    output->setPixel( posLeft, pxlLeft + error * 3.0f );
-                }
-
-                auto posCen = ivec2( x, y + 1 );
-                auto pxlCen = output->getPixel( posCen );
-                output->setPixel( posCen, pxlCen + error * 5.0f );
+        SurfaceView mSrc, mDst;
+        Quantizer mQuantize;
+        AlphaOutput mAlpha;
+        std::vector<float> mScratch;
+        SurfaceView mSink;
+    };
+
+    // Black-and-white error diffusion of a float surface into the bits of a Bitmap. The
+    // error is the one DiffusionPass spreads for MonoQuantizer, so the bits match its
+    // output exactly.
+    template<typename Kernel>
+    class BitmapPass {
+      public:
+        typedef ErrorRows<Kernel, float, 3> Rows;
+
+        BitmapPass( const SurfaceView &src, const Bitmap &dst )
+            : mSrc( src ), mDst( dst ), mWriter( dst.getFormat() )
+        {
+        }
 
-                if( x < ( width - 1 ) ) {
-                    auto posRgt = ivec2( x + 1, y + 1 );
-                    auto pxlRgt = output->getPixel( posRgt );
-                    output->setPixel( posRgt, pxlRgt + error * 1.0f );
+        void operator()( float *const *lines, int y, int x0, int x1, bool discard )
+        {
+            const float *in = mSrc.row( y ) + x0 * mSrc.pixelInc();
+            uint8_t *out = mDst.getRow( y );
+            uint8_t bits = 0, valid = 0;
+            for( int x = x0; x < x1; x++, in += mSrc.pixelInc() ) {
+                const Vec4 total = accumulated( lines[0] + x * 3, mSrc.read( in ), mSrc );
+                const bool on = MonoQuantizer::isWhite( total );
+                const Vec4 color = on ? whiteColor : blackColor;
+                Vec4 error;
+                if constexpr( hasExactReciprocal( Kernel::divisor ) ) {
+                    error = ( total - color ) * ( 1.0f / Kernel::divisor );
+                }
+                else {
+                    error = ( total - color ) / Kernel::divisor;
+                }
+
+                scatter<Kernel>( lines, x, error );
+
+                bits |= uint8_t( on ) << ( x & 7 );
+                valid |= uint8_t( 1 << ( x & 7 ) );
+                if( ( x & 7 ) == 7 || x + 1 == x1 ) {
+                    if( ! discard ) {
+                        mWriter.store( out, x >> 3, bits, valid );
+                    }
+                    bits = valid = 0;
                 }
             }
-
-            output->setPixel( pos, color );
         }
-    }
 
-    return output;
-}
-
-// JarvisJudiceNinke (1/48)
-//          X   7   5
-//  3   5   7   5   3
-//  1   3   5   3   1
-Surface32fRef JarvisJudiceNinke( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
+      private:
+        SurfaceView mSrc;
+        Bitmap mDst;
+        BitWriter mWriter;
+    };
+
+    // Black-and-white error diffusion of a float surface on luminance, through error lines
+    // of one float per pixel: white where the luminance plus the accumulated error reaches
+    // one half. See Options::luminance().
+    template<typename Kernel>
+    class LuminancePass {
+      public:
+        typedef ErrorRows<Kernel, float, 1> Rows;
+
+        LuminancePass( const SurfaceView &src, const SurfaceView &dst, const AlphaOutput &alpha )
+            : mSrc( src ), mDst( dst ), mAlpha( alpha ), mSink( nullptr, 0 )
+        {
+        }
 
-    int width = input->getWidth();
-    int height = input->getHeight();
+        //! Points the pass at other surfaces, keeping its scratch.
+        void bind( const SurfaceView &src, const SurfaceView &dst )
+        {
+            mSrc = src;
+            mDst = dst;
+        }
 
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float whiteDist = length( total - white );
-            float blackDist = length( total - black );
-            
-            if( whiteDist <= blackDist ) {
-                color.set( CM_RGB, whiteColor );
-                error = total - whiteColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
+        void operator()( float *const *lines, int y, int x0, int x1, bool discard )
+        {
+            const SurfaceView &dst = discard ? sink( x1 ) : mDst;
+            const float *in = mSrc.row( y ) + x0 * mSrc.pixelInc();
+            float *out = dst.row( y ) + x0 * dst.pixelInc();
+            for( int x = x0; x < x1; x++, in += mSrc.pixelInc(), out += dst.pixelInc() ) {
+                const float total = lines[0][x] + mSrc.luminance( in );
+                const bool on = total >= 0.5f;
+                float error;
+                if constexpr( hasExactReciprocal( Kernel::divisor ) ) {
+                    error = ( total - float( on ) ) * ( 1.0f / Kernel::divisor );
+                }
+                else {
+                    error = ( total - float( on ) ) / Kernel::divisor;
+                }
 
-            error /= 48.0;
+                scatterLuminance<Kernel>( lines, x, error, std::make_index_sequence<Kernel::taps.size()>() );
 
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 7.0f );
+                const Vec4 color = on ? whiteColor : blackColor;
+                dst.write( out, mAlpha.isOpaque() ? color : mAlpha( color, mSrc.read( in ) ) );
             }
+        }
 
-            if( x < ( width - 2 ) ) {
-                auto pos = ivec2( x + 2, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 5.0f );
+      private:
+        // A single throwaway row that every discarded row is written to.
+        const SurfaceView &sink( int width )
+        {
+            if( mScratch.size() < size_t( width ) * 4 ) {
+                mScratch.resize( width * 4 );
+                mSink = SurfaceView( mScratch.data(), 0 );
             }
+            return mSink;
+        }
 
-            for( int i = 1; i < 3; i++ ) {
-                float offset = ( i - 1 ) * 2.0f;
-                if( y < ( height - i ) ) {
-                    if( ( x - 1 ) >= 0 ) {
-                        auto posLeft = ivec2( x - 1, y + i );
-                        auto pxlLeft = output->getPixel( posLeft );
-                        output->setPixel( posLeft, pxlLeft + error * ( 5.0f - offset ) );
-                    }
-
-                    if( ( x - 2 ) >= 0 ) {
-                        auto posLeft = ivec2( x - 2, y + i );
-                        auto pxlLeft = output->getPixel( posLeft );
-                        output->setPixel( posLeft, pxlLeft + error * ( 3.0f - offset ) );
-                    }
-
-                    auto posCen = ivec2( x, y + i );
-                    auto pxlCen = output->getPixel( posCen );
-                    output->setPixel( posCen, pxlCen + error * ( 7.0f - offset ) );
-
-                    if( x < ( width - 1 ) ) {
-                        auto posRgt = ivec2( x + 1, y + i );
-                        auto pxlRgt = output->getPixel( posRgt );
-                        output->setPixel( posRgt, pxlRgt + error * ( 5.0f - offset ) );
-                    }
+        SurfaceView mSrc, mDst;
+        AlphaOutput mAlpha;
+        std::vector<float> mScratch;
+        SurfaceView mSink;
+    };
+
+    // LuminancePass into the bits of a Bitmap, which match its output exactly.
+    template<typename Kernel>
+    class LuminanceBitmapPass {
+      public:
+        typedef ErrorRows<Kernel, float, 1> Rows;
+
+        LuminanceBitmapPass( const SurfaceView &src, const Bitmap &dst )
+            : mSrc( src ), mDst( dst ), mWriter( dst.getFormat() )
+        {
+        }
 
-                    if( x < ( width - 2 ) ) {
-                        auto posRgtRgt = ivec2( x + 2, y + i );
-                        auto pxlRgtRgt = output->getPixel( posRgtRgt );
-                        output->setPixel( posRgtRgt, pxlRgtRgt + error * ( 3.0f - offset ) );
+        void operator()( float *const *lines, int y, int x0, int x1, bool discard )
+        {
+            const float *in = mSrc.row( y ) + x0 * mSrc.pixelInc();
+            uint8_t *out = mDst.getRow( y );
+            uint8_t bits = 0, valid = 0;
+            for( int x = x0; x < x1; x++, in += mSrc.pixelInc() ) {
+                const float total = lines[0][x] + mSrc.luminance( in );
+                const bool on = total >= 0.5f;
+                float error;
+                if constexpr( hasExactReciprocal( Kernel::divisor ) ) {
+                    error = ( total - float( on ) ) * ( 1.0f / Kernel::divisor );
+                }
+                else {
+                    error = ( total - float( on ) ) / Kernel::divisor;
+                }
+
+                scatterLuminance<Kernel>( lines, x, error, std::make_index_sequence<Kernel::taps.size()>() );
+
+                bits |= uint8_t( on ) << ( x & 7 );
+                valid |= uint8_t( 1 << ( x & 7 ) );
+                if( ( x & 7 ) == 7 || x + 1 == x1 ) {
+                    if( ! discard ) {
+                        mWriter.store( out, x >> 3, bits, valid );
                     }
+                    bits = valid = 0;
                 }
             }
-            output->setPixel( pos, color );
         }
-    }
-
-    return output;
-}
 
-// JarvisJudiceNinke (1/48)
-//          X   7   5
-//  3   5   7   5   3
-//  1   3   5   3   1
-Surface32fRef JarvisJudiceNinkeRGB( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
-    
-    int width = input->getWidth();
-    int height = input->getHeight();
-    
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float redDist = length( total - red );
-            float greenDist = length( total - green );
-            float blueDist = length( total - blue );
-            float blackDist = length( total - black );
-            
-            if( redDist <= greenDist && redDist <= blueDist && redDist <= blackDist ) {
-                color.set( CM_RGB, redColor );
-                error = total - redColor;
-            }
-            else if( greenDist <= redDist && greenDist <= blueDist && greenDist <= blackDist ) {
-                color.set( CM_RGB, greenColor );
-                error = total - greenColor;
-                ;
-            }
-            else if( blueDist <= redDist && blueDist <= greenDist && blueDist <= blackDist ) {
-                color.set( CM_RGB, blueColor );
-                error = total - blueColor;
-            }
-            else if( blackDist <= redDist && blackDist <= greenDist && blackDist <= blueDist ) {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor - redColor - blueColor - greenColor;
-            }
-            
-            error /= 48.0;
-            
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 7.0f );
-            }
-            
-            if( x < ( width - 2 ) ) {
-                auto pos = ivec2( x + 2, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 5.0f );
-            }
-            
-            for( int i = 1; i < 3; i++ ) {
-                float offset = ( i - 1 ) * 2.0f;
-                if( y < ( height - i ) ) {
-                    if( ( x - 1 ) >= 0 ) {
-                        auto posLeft = ivec2( x - 1, y + i );
-                        auto pxlLeft = output->getPixel( posLeft );
-                        output->setPixel( posLeft, pxlLeft + error * ( 5.0f - offset ) );
-                    }
-                    
-                    if( ( x - 2 ) >= 0 ) {
-                        auto posLeft = ivec2( x - 2, y + i );
-                        auto pxlLeft = output->getPixel( posLeft );
-                        output->setPixel( posLeft, pxlLeft + error * ( 3.0f - offset ) );
-                    }
-                    
-                    auto posCen = ivec2( x, y + i );
-                    auto pxlCen = output->getPixel( posCen );
-                    output->setPixel( posCen, pxlCen + error * ( 7.0f - offset ) );
-                    
-                    if( x < ( width - 1 ) ) {
-                        auto posRgt = ivec2( x + 1, y + i );
-                        auto pxlRgt = output->getPixel( posRgt );
-                        output->setPixel( posRgt, pxlRgt + error * ( 5.0f - offset ) );
-                    }
-                    
-                    if( x < ( width - 2 ) ) {
-                        auto posRgtRgt = ivec2( x + 2, y + i );
-                        auto pxlRgtRgt = output->getPixel( posRgtRgt );
-                        output->setPixel( posRgtRgt, pxlRgtRgt + error * ( 3.0f - offset ) );
-                    }
-                }
-            }
-            output->setPixel( pos, color );
+      private:
+        SurfaceView mSrc;
+        Bitmap mDst;
+        BitWriter mWriter;
+    };
+
+    // Error diffusion of a float surface into the palette indices of an IndexedImage. The
+    // quantizer reports the index of the color it picks, and the error is the one
+    // DiffusionPass spreads for the same quantizer.
+    template<typename Kernel, typename Quantizer>
+    class IndexPass {
+      public:
+        typedef ErrorRows<Kernel, float, 3> Rows;
+
+        IndexPass( const SurfaceView &src, const IndexedImage &dst, const Quantizer &quantize )
+            : mSrc( src ), mDst( dst ), mQuantize( quantize )
+        {
         }
-    }
-    
-    return output;
-}
 
-//  Stucki (1/42)
-//          X   8   4
-//  2   4   8   4   2
-//  1   2   4   2   1
-Surface32fRef Stucki( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
+        void operator()( float *const *lines, int y, int x0, int x1, bool discard )
+        {
+            const float *in = mSrc.row( y ) + x0 * mSrc.pixelInc();
+            uint8_t *out = mDst.getRow( y );
+            for( int x = x0; x < x1; x++, in += mSrc.pixelInc() ) {
+                const Vec4 total = accumulated( lines[0] + x * 3, mSrc.read( in ), mSrc );
+                const int index = mQuantize.index( total );
+                const Vec4 color = mQuantize.color( index );
+                Vec4 error;
+                if constexpr( hasExactReciprocal( Kernel::divisor ) ) {
+                    error = ( total - color ) * ( 1.0f / Kernel::divisor );
+                }
+                else {
+                    error = ( total - color ) / Kernel::divisor;
+                }
 
-    int width = input->getWidth();
-    int height = input->getHeight();
+                scatter<Kernel>( lines, x, error );
 
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float whiteDist = length( total - white );
-            float blackDist = length( total - black );
-            
-            if( whiteDist <= blackDist ) {
-                color.set( CM_RGB, whiteColor );
-                error = total - whiteColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
+                if( ! discard ) {
+                    out[x] = static_cast<uint8_t>( index );
+                }
             }
+        }
+
+      private:
+        SurfaceView mSrc;
+        IndexedImage mDst;
+        Quantizer mQuantize;
+    };
+
+    // Error diffusion shared by every algorithm. The diffusion state lives in a few rows
+    // of error lines, so scratch memory grows with the width, not the area. Every pixel
+    // is read before it is written, so \a output may be \a input.
+    template<typename Kernel, typename Quantizer>
+    void diffuseImage( const ImageView32f &input, const ImageView32f &output, const Quantizer &quantize, const Options &options )
+    {
+        const SurfaceView src( input );
+        const SurfaceView dst( output );
+        const int width = std::min( input.getWidth(), output.getWidth() );
+        const int height = std::min( input.getHeight(), output.getHeight() );
+
+        typedef DiffusionPass<Kernel, Quantizer> Pass;
+        const AlphaOutput alpha( options );
+        diffuseRows<typename Pass::Rows>( width, height, options, [&] { return Pass( src, dst, quantize, alpha ); } );
+    }
 
-            error /= 42.0;
+    template<typename Kernel>
+    void diffuseImage( const ImageView32f &input, Bitmap &output, const Options &options )
+    {
+        const SurfaceView src( input );
+        const int width = std::min( input.getWidth(), output.getWidth() );
+        const int height = std::min( input.getHeight(), output.getHeight() );
 
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 8.0f );
-            }
+        typedef BitmapPass<Kernel> Pass;
+        diffuseRows<typename Pass::Rows>( width, height, options, [&] { return Pass( src, output ); } );
+    }
 
-            if( x < ( width - 2 ) ) {
-                auto pos = ivec2( x + 2, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 4.0f );
-            }
+    template<typename Kernel, typename Quantizer>
+    void diffuseImage( const ImageView32f &input, IndexedImage &output, const Quantizer &quantize, const Options &options )
+    {
+        const SurfaceView src( input );
+        const int width = std::min( input.getWidth(), output.getWidth() );
+        const int height = std::min( input.getHeight(), output.getHeight() );
 
-            for( int i = 1; i < 3; i++ ) {
-                float offset = i;
-                if( y < ( height - i ) ) {
-                    if( ( x - 1 ) >= 0 ) {
-                        auto posLeft = ivec2( x - 1, y + i );
-                        auto pxlLeft = output->getPixel( posLeft );
-                        output->setPixel( posLeft, pxlLeft + error * ( 4.0f / offset ) );
-                    }
+        typedef IndexPass<Kernel, Quantizer> Pass;
+        diffuseRows<typename Pass::Rows>( width, height, options, [&] { return Pass( src, output, quantize ); } );
+    }
 
-                    if( ( x - 2 ) >= 0 ) {
-                        auto posLeft = ivec2( x - 2, y + i );
-                        auto pxlLeft = output->getPixel( posLeft );
-                        output->setPixel( posLeft, pxlLeft + error * ( 2.0f / offset ) );
-                    }
+    template<typename Kernel>
+    void diffuseLuminance( const ImageView32f &input, const ImageView32f &output, const Options &options )
+    {
+        const SurfaceView src( input );
+        const SurfaceView dst( output );
+        const int width = std::min( input.getWidth(), output.getWidth() );
+        const int height = std::min( input.getHeight(), output.getHeight() );
+
+        typedef LuminancePass<Kernel> Pass;
+        const AlphaOutput alpha( options );
+        diffuseRows<typename Pass::Rows>( width, height, options, [&] { return Pass( src, dst, alpha ); } );
+    }
 
-                    auto posCen = ivec2( x, y + i );
-                    auto pxlCen = output->getPixel( posCen );
-                    output->setPixel( posCen, pxlCen + error * ( 8.0f / offset ) );
+    template<typename Kernel>
+    void diffuseLuminance( const ImageView32f &input, Bitmap &output, const Options &options )
+    {
+        const SurfaceView src( input );
+        const int width = std::min( input.getWidth(), output.getWidth() );
+        const int height = std::min( input.getHeight(), output.getHeight() );
 
-                    if( x < ( width - 1 ) ) {
-                        auto posRgt = ivec2( x + 1, y + i );
-                        auto pxlRgt = output->getPixel( posRgt );
-                        output->setPixel( posRgt, pxlRgt + error * ( 4.0f / offset ) );
-                    }
+        typedef LuminanceBitmapPass<Kernel> Pass;
+        diffuseRows<typename Pass::Rows>( width, height, options, [&] { return Pass( src, output ); } );
+    }
 
-                    if( x < ( width - 2 ) ) {
-                        auto posRgtRgt = ivec2( x + 2, y + i );
-                        auto pxlRgtRgt = output->getPixel( posRgtRgt );
-                        output->setPixel( posRgtRgt, pxlRgtRgt + error * ( 2.0f / offset ) );
-                    }
-                }
-            }
-            output->setPixel( pos, color );
+    PaletteQuantizer paletteQuantizer( const Palette &palette, const Options &options )
+    {
+        if( options.getPaletteTableResolution() <= 0 || palette.empty() ) {
+            return PaletteQuantizer( palette.getSearch() );
+        }
+        int resolution = 8;
+        while( resolution < options.getPaletteTableResolution() && resolution < 128 ) {
+            resolution *= 2;
         }
+        return PaletteQuantizer( palette.getSearch(),
+            setup( options.getStats(), [&] { return paletteTable( palette.getColors(), resolution, options.getThreads() ); } ) );
     }
 
-    return output;
-}
-    
-//  Stucki (1/42)
-//          X   8   4
-//  2   4   8   4   2
-//  1   2   4   2   1
-Surface32fRef StuckiRGB( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
-    
-    int width = input->getWidth();
-    int height = input->getHeight();
-    
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float redDist = length( total - red );
-            float greenDist = length( total - green );
-            float blueDist = length( total - blue );
-            float blackDist = length( total - black );
-            
-            if( redDist <= greenDist && redDist <= blueDist && redDist <= blackDist ) {
-                color.set( CM_RGB, redColor );
-                error = total - redColor;
-            }
-            else if( greenDist <= redDist && greenDist <= blueDist && greenDist <= blackDist ) {
-                color.set( CM_RGB, greenColor );
-                error = total - greenColor;
-                ;
-            }
-            else if( blueDist <= redDist && blueDist <= greenDist && blueDist <= blackDist ) {
-                color.set( CM_RGB, blueColor );
-                error = total - blueColor;
-            }
-            else if( blackDist <= redDist && blackDist <= greenDist && blackDist <= blueDist ) {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor - redColor - blueColor - greenColor;
-            }
-            
-            error /= 42.0;
-            
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 8.0f );
-            }
-            
-            if( x < ( width - 2 ) ) {
-                auto pos = ivec2( x + 2, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 4.0f );
-            }
-            
-            for( int i = 1; i < 3; i++ ) {
-                float offset = i;
-                if( y < ( height - i ) ) {
-                    if( ( x - 1 ) >= 0 ) {
-                        auto posLeft = ivec2( x - 1, y + i );
-                        auto pxlLeft = output->getPixel( posLeft );
-                        output->setPixel( posLeft, pxlLeft + error * ( 4.0f / offset ) );
-                    }
-                    
-                    if( ( x - 2 ) >= 0 ) {
-                        auto posLeft = ivec2( x - 2, y + i );
-                        auto pxlLeft = output->getPixel( posLeft );
-                        output->setPixel( posLeft, pxlLeft + error * ( 2.0f / offset ) );
-                    }
-                    
-                    auto posCen = ivec2( x, y + i );
-                    auto pxlCen = output->getPixel( posCen );
-                    output->setPixel( posCen, pxlCen + error * ( 8.0f / offset ) );
-                    
-                    if( x < ( width - 1 ) ) {
-                        auto posRgt = ivec2( x + 1, y + i );
-                        auto pxlRgt = output->getPixel( posRgt );
-                        output->setPixel( posRgt, pxlRgt + error * ( 4.0f / offset ) );
-                    }
-                    
-                    if( x < ( width - 2 ) ) {
-                        auto posRgtRgt = ivec2( x + 2, y + i );
-                        auto pxlRgtRgt = output->getPixel( posRgtRgt );
-                        output->setPixel( posRgtRgt, pxlRgtRgt + error * ( 2.0f / offset ) );
-                    }
-                }
-            }
-            output->setPixel( pos, color );
+    // \a palette cut down to the 256 colors an 8-bit index can address.
+    Palette indexablePalette( const Palette &palette )
+    {
+        if( palette.size() <= 256 ) {
+            return palette;
         }
+        return Palette( std::vector<PaletteColor>( palette.getColors().begin(), palette.getColors().begin() + 256 ) );
     }
-    
-    return output;
 }
 
-//  Atkinson (1/8)
-//          X   1   1
-//      1   1   1
-//          1
-Surface32fRef Atkinson( Surface32fRef input )
+void diffuse( Kernel kernel, const ImageView32f &input, const ImageView32f &output, bool rgb, const Options &options )
 {
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
-
-    int width = input->getWidth();
-    int height = input->getHeight();
+    withKernel( kernel, [&]( auto k ) {
+        if( rgb ) {
+            diffuseImage<decltype( k )>( input, output, RGBQuantizer(), options );
+        }
+        else if( options.getLuminance() ) {
+            diffuseLuminance<decltype( k )>( input, output, options );
+        }
+        else {
+            diffuseImage<decltype( k )>( input, output, MonoQuantizer(), options );
+        }
+    } );
+}
 
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float whiteDist = length( total - white );
-            float blackDist = length( total - black );
-            
-            if( whiteDist <= blackDist ) {
-                color.set( CM_RGB, whiteColor );
-                error = total - whiteColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
+void diffuse( Kernel kernel, const ImageView32f &input, Bitmap &output, const Options &options )
+{
+    withKernel( kernel, [&]( auto k ) {
+        if( options.getLuminance() ) {
+            diffuseLuminance<decltype( k )>( input, output, options );
+        }
+        else {
+            diffuseImage<decltype( k )>( input, output, options );
+        }
+    } );
+}
 
-            error /= 8.0;
+void diffuse( Kernel kernel, const ImageView32f &input, IndexedImage &output, const Options &options )
+{
+    withKernel( kernel, [&]( auto k ) { diffuseImage<decltype( k )>( input, output, RGBQuantizer(), options ); } );
+    output.setPalette( rgbPalette() );
+}
 
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error );
-            }
+void diffuse( Kernel kernel, const ImageView32f &input, const ImageView32f &output, const Palette &palette, const Options &options )
+{
+    const PaletteQuantizer quantize = paletteQuantizer( palette, options );
+    withKernel( kernel, [&]( auto k ) { diffuseImage<decltype( k )>( input, output, quantize, options ); } );
+}
 
-            if( x < ( width - 2 ) ) {
-                auto pos = ivec2( x + 2, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error );
-            }
+void diffuse( Kernel kernel, const ImageView32f &input, IndexedImage &output, const Palette &palette, const Options &options )
+{
+    const Palette indexable = indexablePalette( palette );
+    const PaletteQuantizer quantize = paletteQuantizer( indexable, options );
+    withKernel( kernel, [&]( auto k ) { diffuseImage<decltype( k )>( input, output, quantize, options ); } );
+    output.setPalette( indexable );
+}
 
-            if( y < ( height - 1 ) ) {
-                if( ( x - 1 ) >= 0 ) {
-                    auto posLeft = ivec2( x - 1, y + 1 );
-                    auto pxlLeft = output->getPixel( posLeft );
-                    output->setPixel( posLeft, pxlLeft + error );
-                }
+namespace detail {
 
-                auto posCen = ivec2( x, y + 1 );
-                auto pxlCen = output->getPixel( posCen );
-                output->setPixel( posCen, pxlCen + error );
+// The kernel- and quantizer-independent side of a Ditherer: counting rows and
+// buffering the output rows that have not been pulled yet. Spent buffers are kept for
+// reuse, so a caller that pulls as it pushes doesn't allocate after the first row.
+class RowDitherer {
+  public:
+    RowDitherer( int width, bool alpha )
+        : mWidth( width ), mAlpha( alpha )
+    {
+    }
+    virtual ~RowDitherer() {}
 
-                if( x < ( width - 1 ) ) {
-                    auto posRgt = ivec2( x + 1, y + 1 );
-                    auto pxlRgt = output->getPixel( posRgt );
-                    output->setPixel( posRgt, pxlRgt + error );
-                }
-            }
+    int getWidth() const { return mWidth; }
+    int getRow() const { return mRow; }
+    size_t rowSize() const { return size_t( std::max( mWidth, 0 ) ) * ( mAlpha ? 4 : 3 ); }
 
-            if( y < ( height - 2 ) ) {
-                auto posCen = ivec2( x, y + 2 );
-                auto pxlCen = output->getPixel( posCen );
-                output->setPixel( posCen, pxlCen + error );
-            }
+    void process( const float *input, float *output )
+    {
+        processRow( input, output );
+        mRow++;
+    }
 
-            output->setPixel( pos, color );
+    void push( const float *row )
+    {
+        std::vector<float> buffer;
+        if( ! mSpare.empty() ) {
+            buffer = std::move( mSpare.back() );
+            mSpare.pop_back();
         }
+        buffer.resize( rowSize() );
+        process( row, buffer.data() );
+        mReady.push_back( std::move( buffer ) );
     }
 
-    return output;
-}
-    
-//  Atkinson (1/8)
-//          X   1   1
-//      1   1   1
-//          1
-Surface32fRef AtkinsonRGB( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
-    
-    int width = input->getWidth();
-    int height = input->getHeight();
-    
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float redDist = length( total - red );
-            float greenDist = length( total - green );
-            float blueDist = length( total - blue );
-            float blackDist = length( total - black );
-            
-            if( redDist <= greenDist && redDist <= blueDist && redDist <= blackDist ) {
-                color.set( CM_RGB, redColor );
-                error = total - redColor;
-            }
-            else if( greenDist <= redDist && greenDist <= blueDist && greenDist <= blackDist ) {
-                color.set( CM_RGB, greenColor );
-                error = total - greenColor;
-                ;
-            }
-            else if( blueDist <= redDist && blueDist <= greenDist && blueDist <= blackDist ) {
-                color.set( CM_RGB, blueColor );
-                error = total - blueColor;
-            }
-            else if( blackDist <= redDist && blackDist <= greenDist && blackDist <= blueDist ) {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor - redColor - blueColor - greenColor;
-            }
-            
-            error /= 8.0;
-            
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error );
-            }
-            
-            if( x < ( width - 2 ) ) {
-                auto pos = ivec2( x + 2, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error );
-            }
-            
-            if( y < ( height - 1 ) ) {
-                if( ( x - 1 ) >= 0 ) {
-                    auto posLeft = ivec2( x - 1, y + 1 );
-                    auto pxlLeft = output->getPixel( posLeft );
-                    output->setPixel( posLeft, pxlLeft + error );
-                }
-                
-                auto posCen = ivec2( x, y + 1 );
-                auto pxlCen = output->getPixel( posCen );
-                output->setPixel( posCen, pxlCen + error );
-                
-                if( x < ( width - 1 ) ) {
-                    auto posRgt = ivec2( x + 1, y + 1 );
-                    auto pxlRgt = output->getPixel( posRgt );
-                    output->setPixel( posRgt, pxlRgt + error );
-                }
-            }
-            
-            if( y < ( height - 2 ) ) {
-                auto posCen = ivec2( x, y + 2 );
-                auto pxlCen = output->getPixel( posCen );
-                output->setPixel( posCen, pxlCen + error );
-            }
-            
-            output->setPixel( pos, color );
+    bool pull( float *row )
+    {
+        if( mReady.empty() ) {
+            return false;
         }
+        std::copy( mReady.front().begin(), mReady.front().end(), row );
+        mSpare.push_back( std::move( mReady.front() ) );
+        mReady.pop_front();
+        return true;
     }
-    
-    return output;
-}
-
-//  Burkes (1/32)
-//          X   8   4
-//  2   4   8   4   2
-Surface32fRef Burkes( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
-
-    int width = input->getWidth();
-    int height = input->getHeight();
 
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float whiteDist = length( total - white );
-            float blackDist = length( total - black );
-            
-            if( whiteDist <= blackDist ) {
-                color.set( CM_RGB, whiteColor );
-                error = total - whiteColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
+    void reset()
+    {
+        while( ! mReady.empty() ) {
+            mSpare.push_back( std::move( mReady.front() ) );
+            mReady.pop_front();
+        }
+        mRow = 0;
+        resetErrors();
+    }
 
-            error /= 32.0;
+  protected:
+    virtual void processRow( const float *input, float *output ) = 0;
+    virtual void resetErrors() = 0;
 
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 8.0f );
-            }
+    int mWidth;
+    bool mAlpha;
+    int mRow = 0;
 
-            if( x < ( width - 2 ) ) {
-                auto pos = ivec2( x + 2, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 4.0f );
-            }
+  private:
+    std::deque<std::vector<float>> mReady;
+    std::vector<std::vector<float>> mSpare;
+};
 
-            if( y < ( height - 1 ) ) {
-                if( ( x - 1 ) >= 0 ) {
-                    auto posLeft = ivec2( x - 1, y + 1 );
-                    auto pxlLeft = output->getPixel( posLeft );
-                    output->setPixel( posLeft, pxlLeft + error * 4.0f );
-                }
+} // namespace detail
 
-                if( ( x - 2 ) >= 0 ) {
-                    auto posLeft = ivec2( x - 2, y + 1 );
-                    auto pxlLeft = output->getPixel( posLeft );
-                    output->setPixel( posLeft, pxlLeft + error * 2.0f );
-                }
+namespace {
+    // A DiffusionPass or LuminancePass over single-row views, run on the rows as they come.
+    template<typename Pass>
+    class StreamDitherer : public RowDitherer {
+      public:
+        //! \a pass is bound to each row in turn.
+        StreamDitherer( int width, bool alpha, const Pass &pass, const Palette &palette = Palette() )
+            : RowDitherer( width, alpha ), mPalette( palette ), mErrors( std::max( width, 0 ) ), mPass( pass )
+        {
+        }
 
-                auto posCen = ivec2( x, y + 1 );
-                auto pxlCen = output->getPixel( posCen );
-                output->setPixel( posCen, pxlCen + error * 8.0f );
+      protected:
+        void processRow( const float *input, float *output ) override
+        {
+            // rows of stride 0 make row( y ) the given row whatever y is
+            mPass.bind( SurfaceView( const_cast<float *>( input ), 0, mAlpha ), SurfaceView( output, 0, mAlpha ) );
+            float *lines[Pass::Rows::rows];
+            mErrors.lines( mRow, lines );
+            mPass( lines, mRow, 0, mWidth, false );
+            mErrors.recycle( mRow );
+        }
 
-                if( x < ( width - 1 ) ) {
-                    auto posRgt = ivec2( x + 1, y + 1 );
-                    auto pxlRgt = output->getPixel( posRgt );
-                    output->setPixel( posRgt, pxlRgt + error * 4.0f );
-                }
+        void resetErrors() override { mErrors.reset( std::max( mWidth, 0 ) ); }
+
+      private:
+        // keeps the palette a PaletteQuantizer points into alive
+        Palette mPalette;
+        typename Pass::Rows mErrors;
+        Pass mPass;
+    };
+
+    template<typename Quantizer>
+    std::unique_ptr<RowDitherer> makeDitherer( Kernel kernel, int width, bool alpha, const Quantizer &quantize, const Options &options, const Palette &palette = Palette() )
+    {
+        return withKernel( kernel, [&]( auto k ) -> std::unique_ptr<RowDitherer> {
+            typedef DiffusionPass<decltype( k ), Quantizer> Pass;
+            return std::make_unique<StreamDitherer<Pass>>( width, alpha, Pass( SurfaceView( nullptr, 0, alpha ), SurfaceView( nullptr, 0, alpha ), quantize, AlphaOutput( options ) ),
+                palette );
+        } );
+    }
 
-                if( x < ( width - 2 ) ) {
-                    auto posRgtRgt = ivec2( x + 2, y + 1 );
-                    auto pxlRgtRgt = output->getPixel( posRgtRgt );
-                    output->setPixel( posRgtRgt, pxlRgtRgt + error * 2.0f );
-                }
-            }
-            output->setPixel( pos, color );
-        }
+    std::unique_ptr<RowDitherer> makeLuminanceDitherer( Kernel kernel, int width, bool alpha, const Options &options )
+    {
+        return withKernel( kernel, [&]( auto k ) -> std::unique_ptr<RowDitherer> {
+            typedef LuminancePass<decltype( k )> Pass;
+            return std::make_unique<StreamDitherer<Pass>>( width, alpha, Pass( SurfaceView( nullptr, 0, alpha ), SurfaceView( nullptr, 0, alpha ), AlphaOutput( options ) ) );
+        } );
     }
 
-    return output;
-}
-    
-//  Burkes (1/32)
-//          X   8   4
-//  2   4   8   4   2
-Surface32fRef BurkesRGB( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
-    
-    int width = input->getWidth();
-    int height = input->getHeight();
-    
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float redDist = length( total - red );
-            float greenDist = length( total - green );
-            float blueDist = length( total - blue );
-            float blackDist = length( total - black );
-            
-            if( redDist <= greenDist && redDist <= blueDist && redDist <= blackDist ) {
-                color.set( CM_RGB, redColor );
-                error = total - redColor;
-            }
-            else if( greenDist <= redDist && greenDist <= blueDist && greenDist <= blackDist ) {
-                color.set( CM_RGB, greenColor );
-                error = total - greenColor;
-                ;
-            }
-            else if( blueDist <= redDist && blueDist <= greenDist && blueDist <= blackDist ) {
-                color.set( CM_RGB, blueColor );
-                error = total - blueColor;
-            }
-            else if( blackDist <= redDist && blackDist <= greenDist && blackDist <= blueDist ) {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor - redColor - blueColor - greenColor;
-            }
-            
-            error /= 32.0;
-            
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 8.0f );
-            }
-            
-            if( x < ( width - 2 ) ) {
-                auto pos = ivec2( x + 2, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 4.0f );
-            }
-            
-            if( y < ( height - 1 ) ) {
-                if( ( x - 1 ) >= 0 ) {
-                    auto posLeft = ivec2( x - 1, y + 1 );
-                    auto pxlLeft = output->getPixel( posLeft );
-                    output->setPixel( posLeft, pxlLeft + error * 4.0f );
-                }
-                
-                if( ( x - 2 ) >= 0 ) {
-                    auto posLeft = ivec2( x - 2, y + 1 );
-                    auto pxlLeft = output->getPixel( posLeft );
-                    output->setPixel( posLeft, pxlLeft + error * 2.0f );
-                }
-                
-                auto posCen = ivec2( x, y + 1 );
-                auto pxlCen = output->getPixel( posCen );
-                output->setPixel( posCen, pxlCen + error * 8.0f );
-                
-                if( x < ( width - 1 ) ) {
-                    auto posRgt = ivec2( x + 1, y + 1 );
-                    auto pxlRgt = output->getPixel( posRgt );
-                    output->setPixel( posRgt, pxlRgt + error * 4.0f );
-                }
-                
-                if( x < ( width - 2 ) ) {
-                    auto posRgtRgt = ivec2( x + 2, y + 1 );
-                    auto pxlRgtRgt = output->getPixel( posRgtRgt );
-                    output->setPixel( posRgtRgt, pxlRgtRgt + error * 2.0f );
-                }
-            }
-            output->setPixel( pos, color );
-        }
+    std::unique_ptr<RowDitherer> makeMonoDitherer( Kernel kernel, int width, bool alpha, const Options &options )
+    {
+        return options.getLuminance() ? makeLuminanceDitherer( kernel, width, alpha, options ) : makeDitherer( kernel, width, alpha, MonoQuantizer(), options );
     }
-    
-    return output;
 }
 
-//  Sierra (1/32)
-//          X   5   3
-//  2   4   5   4   2
-//      2   3   2
-Surface32fRef Sierra( Surface32fRef input )
+Ditherer::Ditherer( Kernel kernel, int width, bool rgb, bool alpha, const Options &options )
+    : mImpl( rgb ? makeDitherer( kernel, width, alpha, RGBQuantizer(), options ) : makeMonoDitherer( kernel, width, alpha, options ) )
 {
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
+}
 
-    int width = input->getWidth();
-    int height = input->getHeight();
+Ditherer::Ditherer( Kernel kernel, int width, const Palette &palette, bool alpha, const Options &options )
+    : mImpl( makeDitherer( kernel, width, alpha, paletteQuantizer( palette, options ), options, palette ) )
+{
+}
 
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float whiteDist = length( total - white );
-            float blackDist = length( total - black );
-            
-            if( whiteDist <= blackDist ) {
-                color.set( CM_RGB, whiteColor );
-                error = total - whiteColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
+Ditherer::Ditherer( Ditherer &&other ) = default;
+Ditherer &Ditherer::operator=( Ditherer &&other ) = default;
+Ditherer::~Ditherer() = default;
 
-            error /= 32.0;
+int Ditherer::getWidth() const
+{
+    return mImpl->getWidth();
+}
 
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 5.0f );
-            }
+int Ditherer::getRow() const
+{
+    return mImpl->getRow();
+}
 
-            if( x < ( width - 2 ) ) {
-                auto pos = ivec2( x + 2, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 3.0f );
-            }
+void Ditherer::push( const float *row )
+{
+    mImpl->push( row );
+}
 
-            for( int i = 1; i < 3; i++ ) {
-                float offset = ( i - 1 ) * 2.0f;
-                if( y < ( height - i ) ) {
-                    if( ( x - 1 ) >= 0 ) {
-                        auto posLeft = ivec2( x - 1, y + i );
-                        auto pxlLeft = output->getPixel( posLeft );
-                        output->setPixel( posLeft, pxlLeft + error * ( 4.0f - offset ) );
-                    }
+bool Ditherer::pull( float *row )
+{
+    return mImpl->pull( row );
+}
 
-                    if( ( x - 2 ) >= 0 ) {
-                        auto posLeft = ivec2( x - 2, y + i );
-                        auto pxlLeft = output->getPixel( posLeft );
-                        output->setPixel( posLeft, pxlLeft + error * ( 2.0f - offset ) );
-                    }
+void Ditherer::process( const float *input, float *output )
+{
+    mImpl->process( input, output );
+}
 
-                    auto posCen = ivec2( x, y + i );
-                    auto pxlCen = output->getPixel( posCen );
-                    output->setPixel( posCen, pxlCen + error * ( 5.0f - offset ) );
+void Ditherer::reset()
+{
+    mImpl->reset();
+}
 
-                    if( x < ( width - 1 ) ) {
-                        auto posRgt = ivec2( x + 1, y + i );
-                        auto pxlRgt = output->getPixel( posRgt );
-                        output->setPixel( posRgt, pxlRgt + error * ( 4.0f - offset ) );
-                    }
+namespace {
+    // Serial diffusion of a frame in bands. mInput holds the input each band was last
+    // dithered from, packed, and the caller's output view the result; mCheckpoints holds the saved error lines at
+    // the top of every band, the first all zero. Diffusion resumes at a changed band from
+    // its checkpoint and carries on while the error leaving a band differs from the saved
+    // one, within the settle limit.
+    template<typename Pass>
+    class BandDitherer : public FrameDitherer {
+      public:
+        //! \a pass is bound to each frame in turn.
+        BandDitherer( const Pass &pass, const Options &options, const Palette &palette = Palette() )
+            : mPass( pass ), mPalette( palette ), mThreshold( options.getVideoThreshold() ),
+              mBandHeight( std::max( options.getVideoBandHeight(), 1 ) ), mSettleRows( options.getVideoSettleRows() ), mErrors( 0 )
+        {
+        }
 
-                    if( x < ( width - 2 ) ) {
-                        auto posRgtRgt = ivec2( x + 2, y + i );
-                        auto pxlRgtRgt = output->getPixel( posRgtRgt );
-                        output->setPixel( posRgtRgt, pxlRgtRgt + error * ( 2.0f - offset ) );
-                    }
+        void dither( const ImageView32f &frame, const ImageView32f &output ) override
+        {
+            const int width = frame.getWidth();
+            const int height = frame.getHeight();
+            const bool full = mReset || width != mWidth || height != mHeight || frame.hasAlpha() != mAlpha;
+            if( full ) {
+                mWidth = width;
+                mHeight = height;
+                mAlpha = frame.hasAlpha();
+                mReset = false;
+                mInput.assign( size_t( std::max( width, 0 ) ) * size_t( std::max( height, 0 ) ) * ( mAlpha ? 4 : 3 ), 0.0f );
+                mErrors.reset( width );
+                mState.resize( mErrors.stateSize() );
+                mCheckpoints.assign( ( ( height + mBandHeight - 1 ) / mBandHeight + 1 ) * mErrors.stateSize(), 0.0f );
+            }
+
+            const SurfaceView next( frame );
+            const SurfaceView src( mInput.data(), ptrdiff_t( std::max( width, 0 ) ) * ( mAlpha ? 4 : 3 ), mAlpha );
+            mPass.bind( src, SurfaceView( output ) );
+            float *lines[Pass::Rows::rows];
+
+            mRowsDithered = 0;
+            // whether mErrors holds the error entering the current band
+            bool live = false;
+            // whether that error differs from the band's checkpoint, and for how many more rows it may be carried
+            bool differs = false;
+            int settle = 0;
+            for( int band = 0, y0 = 0; y0 < height; band++, y0 += mBandHeight ) {
+                const int y1 = std::min( y0 + mBandHeight, height );
+                const bool changed = update( next, src, width, y0, y1, full );
+                if( changed ) {
+                    settle = mSettleRows;
+                }
+                else if( ! differs || settle == 0 ) {
+                    live = false;
+                    differs = false;
+                    continue;
+                }
+
+                if( ! live ) {
+                    mErrors.restore( y0, checkpoint( band ) );
+                    live = true;
+                }
+                for( int y = y0; y < y1; y++ ) {
+                    mErrors.lines( y, lines );
+                    mPass( lines, y, 0, width, false );
+                    mErrors.recycle( y );
+                }
+                mRowsDithered += y1 - y0;
+                if( ! changed && settle > 0 ) {
+                    settle = std::max( settle - ( y1 - y0 ), 0 );
+                }
+
+                mErrors.save( y1, mState.data() );
+                float *saved = checkpoint( band + 1 );
+                differs = ! std::equal( mState.begin(), mState.end(), saved );
+                if( differs ) {
+                    std::copy( mState.begin(), mState.end(), saved );
                 }
             }
-            output->setPixel( pos, color );
         }
-    }
 
-    return output;
-}
-    
-//  Sierra (1/32)
-//          X   5   3
-//  2   4   5   4   2
-//      2   3   2
-Surface32fRef SierraRGB( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
-    
-    int width = input->getWidth();
-    int height = input->getHeight();
-    
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float redDist = length( total - red );
-            float greenDist = length( total - green );
-            float blueDist = length( total - blue );
-            float blackDist = length( total - black );
-            
-            if( redDist <= greenDist && redDist <= blueDist && redDist <= blackDist ) {
-                color.set( CM_RGB, redColor );
-                error = total - redColor;
-            }
-            else if( greenDist <= redDist && greenDist <= blueDist && greenDist <= blackDist ) {
-                color.set( CM_RGB, greenColor );
-                error = total - greenColor;
-                ;
-            }
-            else if( blueDist <= redDist && blueDist <= greenDist && blueDist <= blackDist ) {
-                color.set( CM_RGB, blueColor );
-                error = total - blueColor;
-            }
-            else if( blackDist <= redDist && blackDist <= greenDist && blackDist <= blueDist ) {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor - redColor - blueColor - greenColor;
-            }
-            
-            error /= 32.0;
-            
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 5.0f );
-            }
-            
-            if( x < ( width - 2 ) ) {
-                auto pos = ivec2( x + 2, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 3.0f );
-            }
-            
-            for( int i = 1; i < 3; i++ ) {
-                float offset = ( i - 1 ) * 2.0f;
-                if( y < ( height - i ) ) {
-                    if( ( x - 1 ) >= 0 ) {
-                        auto posLeft = ivec2( x - 1, y + i );
-                        auto pxlLeft = output->getPixel( posLeft );
-                        output->setPixel( posLeft, pxlLeft + error * ( 4.0f - offset ) );
+        void reset() override { mReset = true; }
+
+      private:
+        float *checkpoint( int band ) { return mCheckpoints.data() + band * mErrors.stateSize(); }
+
+        // Copies rows [y0, y1) of \a next into mInput if any channel moved by more than
+        // the threshold, or \a force is set, and returns whether it did.
+        bool update( const SurfaceView &next, const SurfaceView &src, int width, int y0, int y1, bool force ) const
+        {
+            const bool raw = next.hasLayoutOf( src );
+            const size_t rowSize = size_t( width ) * src.pixelInc();
+            bool changed = force;
+            for( int y = y0; y < y1 && ! changed; y++ ) {
+                const float *a = next.row( y );
+                const float *b = src.row( y );
+                if( raw && mThreshold == 0.0f ) {
+                    changed = std::memcmp( a, b, rowSize * sizeof( float ) ) != 0;
+                }
+                else if( raw ) {
+                    for( size_t i = 0; i < rowSize; i++ ) {
+                        // written so that NaN counts as a change
+                        changed |= ! ( std::abs( a[i] - b[i] ) <= mThreshold );
                     }
-                    
-                    if( ( x - 2 ) >= 0 ) {
-                        auto posLeft = ivec2( x - 2, y + i );
-                        auto pxlLeft = output->getPixel( posLeft );
-                        output->setPixel( posLeft, pxlLeft + error * ( 2.0f - offset ) );
+                }
+                else {
+                    for( int x = 0; x < width && ! changed; x++, a += next.pixelInc(), b += src.pixelInc() ) {
+                        float difference[4];
+                        ( next.read( a ) - src.read( b ) ).store( difference );
+                        for( float d : difference ) {
+                            changed |= ! ( std::abs( d ) <= mThreshold );
+                        }
                     }
-                    
-                    auto posCen = ivec2( x, y + i );
-                    auto pxlCen = output->getPixel( posCen );
-                    output->setPixel( posCen, pxlCen + error * ( 5.0f - offset ) );
-                    
-                    if( x < ( width - 1 ) ) {
-                        auto posRgt = ivec2( x + 1, y + i );
-                        auto pxlRgt = output->getPixel( posRgt );
-                        output->setPixel( posRgt, pxlRgt + error * ( 4.0f - offset ) );
+                }
+            }
+            if( changed ) {
+                for( int y = y0; y < y1; y++ ) {
+                    const float *a = next.row( y );
+                    float *b = src.row( y );
+                    if( raw ) {
+                        std::copy( a, a + rowSize, b );
+                        continue;
                     }
-                    
-                    if( x < ( width - 2 ) ) {
-                        auto posRgtRgt = ivec2( x + 2, y + i );
-                        auto pxlRgtRgt = output->getPixel( posRgtRgt );
-                        output->setPixel( posRgtRgt, pxlRgtRgt + error * ( 2.0f - offset ) );
+                    for( int x = 0; x < width; x++, a += next.pixelInc(), b += src.pixelInc() ) {
+                        src.write( b, next.read( a ) );
                     }
                 }
             }
-            output->setPixel( pos, color );
+            return changed;
         }
-    }
-    
-    return output;
-}
-
-//  TwoRowSierra (1/16)
-//          X   4   3
-//  1   2   3   2   1
-Surface32fRef TwoRowSierra( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
 
-    int width = input->getWidth();
-    int height = input->getHeight();
-    
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float whiteDist = length( total - white );
-            float blackDist = length( total - black );
-            
-            if( whiteDist <= blackDist ) {
-                color.set( CM_RGB, whiteColor );
-                error = total - whiteColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
-
-            error /= 16.0;
-
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 4.0f );
-            }
-
-            if( x < ( width - 2 ) ) {
-                auto pos = ivec2( x + 2, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 3.0f );
-            }
+        Pass mPass;
+        // keeps the palette a PaletteQuantizer points into alive
+        Palette mPalette;
+        float mThreshold;
+        int mBandHeight;
+        int mSettleRows;
+        // size and alpha of the last frame, and whether the next one is dithered in full
+        int mWidth = 0, mHeight = 0;
+        bool mAlpha = false;
+        bool mReset = true;
+        std::vector<float> mInput;
+        typename Pass::Rows mErrors;
+        std::vector<float> mState;
+        std::vector<float> mCheckpoints;
+    };
+
+    template<typename Quantizer>
+    std::unique_ptr<FrameDitherer> makeBandDitherer( Kernel kernel, const Quantizer &quantize, const Options &options, const Palette &palette = Palette() )
+    {
+        return withKernel( kernel, [&]( auto k ) -> std::unique_ptr<FrameDitherer> {
+            typedef DiffusionPass<decltype( k ), Quantizer> Pass;
+            return std::make_unique<BandDitherer<Pass>>( Pass( SurfaceView( nullptr, 0 ), SurfaceView( nullptr, 0 ), quantize, AlphaOutput( options ) ), options, palette );
+        } );
+    }
 
-            //  1   2   3   2   1
+    std::unique_ptr<FrameDitherer> makeLuminanceBandDitherer( Kernel kernel, const Options &options )
+    {
+        return withKernel( kernel, [&]( auto k ) -> std::unique_ptr<FrameDitherer> {
+            typedef LuminancePass<decltype( k )> Pass;
+            return std::make_unique<BandDitherer<Pass>>( Pass( SurfaceView( nullptr, 0 ), SurfaceView( nullptr, 0 ), AlphaOutput( options ) ), options );
+        } );
+    }
+}
 
-            if( y < ( height - 1 ) ) {
-                if( ( x - 1 ) >= 0 ) {
-                    auto posLeft = ivec2( x - 1, y + 1 );
-                    auto pxlLeft = output->getPixel( posLeft );
-                    output->setPixel( posLeft, pxlLeft + error * 2.0f );
-                }
+namespace detail {
 
-                if( ( x - 2 ) >= 0 ) {
-                    auto posLeft = ivec2( x - 2, y + 1 );
-                    auto pxlLeft = output->getPixel( posLeft );
-                    output->setPixel( posLeft, pxlLeft + error * 1.0f );
-                }
+std::unique_ptr<FrameDitherer> makeFrameDitherer( Kernel kernel, bool rgb, const Options &options )
+{
+    if( rgb ) {
+        return makeBandDitherer( kernel, RGBQuantizer(), options );
+    }
+    return options.getLuminance() ? makeLuminanceBandDitherer( kernel, options ) : makeBandDitherer( kernel, MonoQuantizer(), options );
+}
 
-                auto posCen = ivec2( x, y + 1 );
-                auto pxlCen = output->getPixel( posCen );
-                output->setPixel( posCen, pxlCen + error * 3.0f );
+std::unique_ptr<FrameDitherer> makeFrameDitherer( Kernel kernel, const Palette &palette, const Options &options )
+{
+    return makeBandDitherer( kernel, paletteQuantizer( palette, options ), options, palette );
+}
 
-                if( x < ( width - 1 ) ) {
-                    auto posRgt = ivec2( x + 1, y + 1 );
-                    auto pxlRgt = output->getPixel( posRgt );
-                    output->setPixel( posRgt, pxlRgt + error * 2.0f );
-                }
+} // namespace detail
 
-                if( x < ( width - 2 ) ) {
-                    auto posRgtRgt = ivec2( x + 2, y + 1 );
-                    auto pxlRgtRgt = output->getPixel( posRgtRgt );
-                    output->setPixel( posRgtRgt, pxlRgtRgt + error * 1.0f );
-                }
-            }
-            output->setPixel( pos, color );
-        }
+float seamVisibility( const ImageView32f &source, const ImageView32f &dithered, int stripeHeight )
+{
+    const int width = std::min( source.getWidth(), dithered.getWidth() );
+    const int height = std::min( source.getHeight(), dithered.getHeight() );
+    const int box = 4;
+    if( stripeHeight <= 0 || stripeHeight >= height || width < box || height < box ) {
+        return 1.0f;
     }
 
-    return output;
-}
+    const SurfaceView src( source );
+    const SurfaceView dst( dithered );
 
-//  TwoRowSierra (1/16)
-//          X   4   3
-//  1   2   3   2   1
-Surface32fRef TwoRowSierraRGB( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
-    
-    int width = input->getWidth();
-    int height = input->getHeight();
-    
+    // signed brightness error per pixel
+    std::vector<float> diff( size_t( width ) * size_t( height ) );
     for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float redDist = length( total - red );
-            float greenDist = length( total - green );
-            float blueDist = length( total - blue );
-            float blackDist = length( total - black );
-            
-            if( redDist <= greenDist && redDist <= blueDist && redDist <= blackDist ) {
-                color.set( CM_RGB, redColor );
-                error = total - redColor;
-            }
-            else if( greenDist <= redDist && greenDist <= blueDist && greenDist <= blackDist ) {
-                color.set( CM_RGB, greenColor );
-                error = total - greenColor;
-                ;
-            }
-            else if( blueDist <= redDist && blueDist <= greenDist && blueDist <= blackDist ) {
-                color.set( CM_RGB, blueColor );
-                error = total - blueColor;
-            }
-            else if( blackDist <= redDist && blackDist <= greenDist && blackDist <= blueDist ) {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor - redColor - blueColor - greenColor;
-            }
-            
-            error /= 16.0;
-            
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 4.0f );
-            }
-            
-            if( x < ( width - 2 ) ) {
-                auto pos = ivec2( x + 2, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 3.0f );
-            }
-            
-            //  1   2   3   2   1
-            
-            if( y < ( height - 1 ) ) {
-                if( ( x - 1 ) >= 0 ) {
-                    auto posLeft = ivec2( x - 1, y + 1 );
-                    auto pxlLeft = output->getPixel( posLeft );
-                    output->setPixel( posLeft, pxlLeft + error * 2.0f );
-                }
-                
-                if( ( x - 2 ) >= 0 ) {
-                    auto posLeft = ivec2( x - 2, y + 1 );
-                    auto pxlLeft = output->getPixel( posLeft );
-                    output->setPixel( posLeft, pxlLeft + error * 1.0f );
-                }
-                
-                auto posCen = ivec2( x, y + 1 );
-                auto pxlCen = output->getPixel( posCen );
-                output->setPixel( posCen, pxlCen + error * 3.0f );
-                
-                if( x < ( width - 1 ) ) {
-                    auto posRgt = ivec2( x + 1, y + 1 );
-                    auto pxlRgt = output->getPixel( posRgt );
-                    output->setPixel( posRgt, pxlRgt + error * 2.0f );
-                }
-                
-                if( x < ( width - 2 ) ) {
-                    auto posRgtRgt = ivec2( x + 2, y + 1 );
-                    auto pxlRgtRgt = output->getPixel( posRgtRgt );
-                    output->setPixel( posRgtRgt, pxlRgtRgt + error * 1.0f );
-                }
-            }
-            output->setPixel( pos, color );
+        const float *in = src.row( y );
+        const float *out = dst.row( y );
+        for( int x = 0; x < width; x++, in += src.pixelInc(), out += dst.pixelInc() ) {
+            float a[4], b[4];
+            src.read( in ).store( a );
+            dst.read( out ).store( b );
+            diff[size_t( y ) * width + x] = ( ( b[0] - a[0] ) + ( b[1] - a[1] ) + ( b[2] - a[2] ) ) / 3.0f;
         }
     }
-    
-    return output;
-}
 
-//  SierraLite (1/4)
-//      X   2
-//  1   1
-Surface32fRef SierraLite( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
-    
-    int width = input->getWidth();
-    int height = input->getHeight();
-    
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float whiteDist = length( total - white );
-            float blackDist = length( total - black );
-            
-            if( whiteDist <= blackDist ) {
-                color.set( CM_RGB, whiteColor );
-                error = total - whiteColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
-            
-            error /= 4.0;
-            
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 2.0f );
-            }
-            
-            if( y < ( height - 1 ) ) {
-                if( ( x - 1 ) >= 0 ) {
-                    auto posLeft = ivec2( x - 1, y + 1 );
-                    auto pxlLeft = output->getPixel( posLeft );
-                    output->setPixel( posLeft, pxlLeft + error );
+    // mean absolute box-filtered error of every row of boxes
+    std::vector<double> rowError( height - box + 1 );
+    for( int y = 0; y + box <= height; y++ ) {
+        double sum = 0.0;
+        for( int x = 0; x + box <= width; x++ ) {
+            float local = 0.0f;
+            for( int j = 0; j < box; j++ ) {
+                for( int i = 0; i < box; i++ ) {
+                    local += diff[size_t( y + j ) * width + x + i];
                 }
-                
-                auto posCen = ivec2( x, y + 1 );
-                auto pxlCen = output->getPixel( posCen );
-                output->setPixel( posCen, pxlCen + error );
             }
-            output->setPixel( pos, color );
+            sum += std::abs( local ) / ( box * box );
         }
+        rowError[y] = sum / ( width - box + 1 );
     }
-    
-    return output;
-}
-    
-//  SierraLite (1/4)
-//      X   2
-//  1   1
-Surface32fRef SierraLiteRGB( Surface32fRef input )
-{
-    auto output = Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() );
-
-    int width = input->getWidth();
-    int height = input->getHeight();
-    
-    for( int y = 0; y < height; y++ ) {
-        for( int x = 0; x < width; x++ ) {
-            ivec2 pos( x, y );
-            ColorA color = input->getPixel( pos );
-            ColorA error = output->getPixel( pos );
-            const ColorA total = error + color;
-            
-            float redDist = length( total - red );
-            float greenDist = length( total - green );
-            float blueDist = length( total - blue );
-            float blackDist = length( total - black );
-            
-            if( redDist <= greenDist && redDist <= blueDist && redDist <= blackDist ) {
-                color.set( CM_RGB, redColor );
-                error = total - redColor;
-            }
-            else if( greenDist <= redDist && greenDist <= blueDist && greenDist <= blackDist ) {
-                color.set( CM_RGB, greenColor );
-                error = total - greenColor;
-                ;
-            }
-            else if( blueDist <= redDist && blueDist <= greenDist && blueDist <= blackDist ) {
-                color.set( CM_RGB, blueColor );
-                error = total - blueColor;
-            }
-            else if( blackDist <= redDist && blackDist <= greenDist && blackDist <= blueDist ) {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor;
-            }
-            else {
-                color.set( CM_RGB, blackColor );
-                error = total - blackColor - redColor - blueColor - greenColor;
-            }
-
-            error /= 4.0;
-
-            if( x < ( width - 1 ) ) {
-                auto pos = ivec2( x + 1, y );
-                auto pxl = output->getPixel( pos );
-                output->setPixel( pos, pxl + error * 2.0f );
-            }
-
-            if( y < ( height - 1 ) ) {
-                if( ( x - 1 ) >= 0 ) {
-                    auto posLeft = ivec2( x - 1, y + 1 );
-                    auto pxlLeft = output->getPixel( posLeft );
-                    output->setPixel( posLeft, pxlLeft + error );
-                }
 
-                auto posCen = ivec2( x, y + 1 );
-                auto pxlCen = output->getPixel( posCen );
-                output->setPixel( posCen, pxlCen + error );
-            }
-            output->setPixel( pos, color );
+    double all = 0.0;
+    for( double e : rowError ) {
+        all += e;
+    }
+    all /= rowError.size();
+
+    // boxes that straddle a seam or start on it
+    double seams = 0.0;
+    int seamBoxes = 0;
+    for( int seam = stripeHeight; seam < height; seam += stripeHeight ) {
+        for( int y = std::max( seam - box + 1, 0 ); y <= seam && y < static_cast<int>( rowError.size() ); y++ ) {
+            seams += rowError[y];
+            seamBoxes++;
         }
     }
 
-    return output;
+    if( seamBoxes == 0 || all <= 0.0 ) {
+        return 1.0f;
+    }
+    return static_cast<float>( ( seams / seamBoxes ) / all );
 }
-    
+
 }
 }
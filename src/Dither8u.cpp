@@ -0,0 +1,322 @@
+#include "DitherCore.h"
+#include "DitherCommon.h"
+#include "DitherDiffusion.h"
+#include "DitherKernels.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace reza {
+namespace dither {
+
+// Fixed-point error diffusion of 8-bit images. This is the integer reference the
+// 8-bit overloads are defined by:
+//  - a channel value v is held as v << 4, i.e. in 1/16ths of a level;
+//  - the accumulated error is kept per r, g, b channel in int16 error lines, alpha
+//    does not take part and is written as Options::alpha() asks;
+//  - each tap adds round( error * weight / divisor ), rounding halves up: divisors
+//    that are powers of two (16, 32, 8, 4) divide with a shift, 48 and 42 multiply by
+//    round( 65536 / divisor ) and shift by 16;
+//  - the quantization error of a pixel is clamped to two full levels either way,
+//    which only engages for colors the palette can't reach, and bounds the error
+//    lines well inside int16;
+//  - with Options::luminance() black and white diffuse a single error per pixel
+//    instead, the luminance ( 54 r + 183 g + 19 b ) / 16, rounded, in the same units;
+//  - AlphaPolicy::Threshold writes opaque where the input alpha is at least the
+//    threshold times 255, rounded up.
+namespace {
+    using namespace detail;
+
+    const int kFractionBits = 4;
+    const int kFullLevel = 255 << kFractionBits;
+    const int kMaxError = 2 * kFullLevel;
+
+    struct Rgb8u {
+        uint8_t r, g, b;
+    };
+
+    // White when 2 ( r + g + b ) >= 3 * full level, the exact integer form of picking the
+    // closer of white and black.
+    struct MonoQuantizer8u {
+        static constexpr Rgb8u colors[2] = { { 0, 0, 0 }, { 255, 255, 255 } };
+
+        int operator()( const int *total ) const { return 2 * ( total[0] + total[1] + total[2] ) >= 3 * kFullLevel ? 1 : 0; }
+    };
+
+    // The closest of red, green, blue and black, preferring them in that order on ties.
+    // With |t - c|^2 = |t|^2 - 2 t.c + |c|^2, comparing distances reduces to comparing
+    // full - 2 t.r, full - 2 t.g, full - 2 t.b and 0.
+    struct RGBQuantizer8u {
+        static constexpr Rgb8u colors[4] = { { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 }, { 0, 0, 0 } };
+
+        int operator()( const int *total ) const
+        {
+            int best = 3;
+            int bestScore = 0;
+            for( int i = 2; i >= 0; i-- ) {
+                const int score = kFullLevel - 2 * total[i];
+                if( score <= bestScore ) {
+                    best = i;
+                    bestScore = score;
+                }
+            }
+            return best;
+        }
+    };
+
+    constexpr int log2( int value )
+    {
+        int bits = 0;
+        while( value > 1 ) {
+            value >>= 1;
+            bits++;
+        }
+        return bits;
+    }
+
+    // Division by the kernel divisor in fixed point, rounding halves up.
+    template<typename Kernel>
+    struct FixedDivisor {
+        static constexpr int divisor = static_cast<int>( Kernel::divisor );
+        static constexpr bool powerOfTwo = ( divisor & ( divisor - 1 ) ) == 0;
+        static constexpr int shift = powerOfTwo ? log2( divisor ) : 16;
+        static constexpr int multiplier = powerOfTwo ? 1 : ( ( 1 << 16 ) + divisor / 2 ) / divisor;
+
+        static int divide( int value )
+        {
+            if constexpr( shift == 0 ) {
+                return value;
+            }
+            else {
+                return ( value * multiplier + ( 1 << ( shift - 1 ) ) ) >> shift;
+            }
+        }
+    };
+
+    constexpr int largestWeight( const Tap *taps, size_t count )
+    {
+        int weight = 0;
+        for( size_t i = 0; i < count; i++ ) {
+            weight = static_cast<int>( taps[i].weight ) > weight ? static_cast<int>( taps[i].weight ) : weight;
+        }
+        return weight;
+    }
+
+    constexpr bool usesWeight( const Tap *taps, size_t count, int weight )
+    {
+        for( size_t i = 0; i < count; i++ ) {
+            if( static_cast<int>( taps[i].weight ) == weight ) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The divided error of each of Channels channels for every weight the kernel uses.
+    // Kernels repeat a handful of weights over many taps, so dividing once per weight
+    // rather than per tap saves most of the multiplies.
+    template<typename Kernel, int Channels = 3>
+    struct ErrorShares {
+        static constexpr int maxWeight = largestWeight( Kernel::taps.data(), Kernel::taps.size() );
+
+        ErrorShares( const int *error ) { fill( error, std::make_index_sequence<maxWeight + 1>() ); }
+
+        template<size_t... W>
+        void fill( const int *error, std::index_sequence<W...> )
+        {
+            ( fillWeight<static_cast<int>( W )>( error ), ... );
+        }
+
+        template<int W>
+        void fillWeight( const int *error )
+        {
+            if constexpr( usesWeight( Kernel::taps.data(), Kernel::taps.size(), W ) ) {
+                for( int c = 0; c < Channels; c++ ) {
+                    values[W][c] = FixedDivisor<Kernel>::divide( error[c] * W );
+                }
+            }
+        }
+
+        int values[maxWeight + 1][Channels];
+    };
+
+    template<int Channels>
+    inline void addShare( int16_t *target, const int *share )
+    {
+        for( int c = 0; c < Channels; c++ ) {
+            target[c] = static_cast<int16_t>( target[c] + share[c] );
+        }
+    }
+
+    // Spreads the error of Channels channels over the kernel's taps, expanded at compile
+    // time.
+    template<typename Kernel, int Channels = 3, size_t... I>
+    void scatter( int16_t *const *lines, int x, const int *error, std::index_sequence<I...> )
+    {
+        const ErrorShares<Kernel, Channels> shares( error );
+        ( addShare<Channels>( lines[Kernel::taps[I].dy] + ( x + Kernel::taps[I].dx ) * Channels, shares.values[static_cast<int>( Kernel::taps[I].weight )] ), ... );
+    }
+
+    int clampError( int error )
+    {
+        return error < -kMaxError ? -kMaxError : error > kMaxError ? kMaxError : error;
+    }
+
+    // Error diffusion of an 8-bit surface through int16 r, g, b error lines.
+    template<typename Kernel, typename Quantizer>
+    class FixedDiffusionPass {
+      public:
+        typedef ErrorRows<Kernel, int16_t, 3> Rows;
+
+        FixedDiffusionPass( const SurfaceView8u &src, const SurfaceView8u &dst, const AlphaOutput &alpha )
+            : mSrc( src ), mDst( dst ), mAlpha( alpha ), mSink( nullptr, 0 )
+        {
+        }
+
+        //! Quantizes pixels [x0, x1) of row y and spreads their error through \a lines.
+        void operator()( int16_t *const *lines, int y, int x0, int x1, bool discard )
+        {
+            const SurfaceView8u &dst = discard ? sink( x1 ) : mDst;
+            const uint8_t *in = mSrc.row( y ) + x0 * mSrc.pixelInc();
+            uint8_t *out = dst.row( y ) + x0 * dst.pixelInc();
+            for( int x = x0; x < x1; x++, in += mSrc.pixelInc(), out += dst.pixelInc() ) {
+                const int16_t *accumulated = lines[0] + x * 3;
+                const int total[3] = {
+                    ( in[mSrc.red()] << kFractionBits ) + accumulated[0],
+                    ( in[mSrc.green()] << kFractionBits ) + accumulated[1],
+                    ( in[mSrc.blue()] << kFractionBits ) + accumulated[2] };
+
+                const Rgb8u &color = Quantizer::colors[mQuantize( total )];
+                const int error[3] = {
+                    clampError( total[0] - ( color.r << kFractionBits ) ),
+                    clampError( total[1] - ( color.g << kFractionBits ) ),
+                    clampError( total[2] - ( color.b << kFractionBits ) ) };
+
+                scatter<Kernel>( lines, x, error, std::make_index_sequence<Kernel::taps.size()>() );
+
+                out[dst.red()] = color.r;
+                out[dst.green()] = color.g;
+                out[dst.blue()] = color.b;
+                if( dst.alpha() >= 0 ) {
+                    out[dst.alpha()] = mAlpha( mSrc.alpha() >= 0 ? in[mSrc.alpha()] : 255 );
+                }
+            }
+        }
+
+      private:
+        // A single throwaway row that every discarded row is written to.
+        const SurfaceView8u &sink( int width )
+        {
+            if( mScratch.size() < size_t( width ) * 4 ) {
+                mScratch.resize( width * 4 );
+                mSink = SurfaceView8u( mScratch.data(), 0 );
+            }
+            return mSink;
+        }
+
+        SurfaceView8u mSrc, mDst;
+        Quantizer mQuantize;
+        AlphaOutput mAlpha;
+        std::vector<uint8_t> mScratch;
+        SurfaceView8u mSink;
+    };
+
+    // Black-and-white error diffusion of an 8-bit surface on luminance, through int16 error
+    // lines of one value per pixel. See Options::luminance().
+    template<typename Kernel>
+    class FixedLuminancePass {
+      public:
+        typedef ErrorRows<Kernel, int16_t, 1> Rows;
+
+        FixedLuminancePass( const SurfaceView8u &src, const SurfaceView8u &dst, const AlphaOutput &alpha )
+            : mSrc( src ), mDst( dst ), mAlpha( alpha ), mSink( nullptr, 0 )
+        {
+        }
+
+        void operator()( int16_t *const *lines, int y, int x0, int x1, bool discard )
+        {
+            const SurfaceView8u &dst = discard ? sink( x1 ) : mDst;
+            const uint8_t *in = mSrc.row( y ) + x0 * mSrc.pixelInc();
+            uint8_t *out = dst.row( y ) + x0 * dst.pixelInc();
+            for( int x = x0; x < x1; x++, in += mSrc.pixelInc(), out += dst.pixelInc() ) {
+                // 54 + 183 + 19 = 256, so the shift leaves the luminance in 1/16ths of a level
+                const int luminance = ( 54 * in[mSrc.red()] + 183 * in[mSrc.green()] + 19 * in[mSrc.blue()] + 8 ) >> ( 8 - kFractionBits );
+                const int total = luminance + lines[0][x];
+                const bool on = 2 * total >= kFullLevel;
+                const int error = clampError( total - ( on ? kFullLevel : 0 ) );
+
+                scatter<Kernel, 1>( lines, x, &error, std::make_index_sequence<Kernel::taps.size()>() );
+
+                const uint8_t level = on ? 255 : 0;
+                out[dst.red()] = level;
+                out[dst.green()] = level;
+                out[dst.blue()] = level;
+                if( dst.alpha() >= 0 ) {
+                    out[dst.alpha()] = mAlpha( mSrc.alpha() >= 0 ? in[mSrc.alpha()] : 255 );
+                }
+            }
+        }
+
+      private:
+        // A single throwaway row that every discarded row is written to.
+        const SurfaceView8u &sink( int width )
+        {
+            if( mScratch.size() < size_t( width ) * 4 ) {
+                mScratch.resize( width * 4 );
+                mSink = SurfaceView8u( mScratch.data(), 0 );
+            }
+            return mSink;
+        }
+
+        SurfaceView8u mSrc, mDst;
+        AlphaOutput mAlpha;
+        std::vector<uint8_t> mScratch;
+        SurfaceView8u mSink;
+    };
+
+    template<typename Kernel, typename Quantizer>
+    void diffuse8u( const ImageView8u &input, const ImageView8u &output, const Options &options )
+    {
+        const SurfaceView8u src( input );
+        const SurfaceView8u dst( output );
+        const int width = std::min( input.getWidth(), output.getWidth() );
+        const int height = std::min( input.getHeight(), output.getHeight() );
+
+        typedef FixedDiffusionPass<Kernel, Quantizer> Pass;
+        const AlphaOutput alpha( options );
+        diffuseRows<typename Pass::Rows>( width, height, options, [&] { return Pass( src, dst, alpha ); } );
+    }
+
+    template<typename Kernel>
+    void diffuseLuminance8u( const ImageView8u &input, const ImageView8u &output, const Options &options )
+    {
+        const SurfaceView8u src( input );
+        const SurfaceView8u dst( output );
+        const int width = std::min( input.getWidth(), output.getWidth() );
+        const int height = std::min( input.getHeight(), output.getHeight() );
+
+        typedef FixedLuminancePass<Kernel> Pass;
+        const AlphaOutput alpha( options );
+        diffuseRows<typename Pass::Rows>( width, height, options, [&] { return Pass( src, dst, alpha ); } );
+    }
+}
+
+void diffuse( Kernel kernel, const ImageView8u &input, const ImageView8u &output, bool rgb, const Options &options )
+{
+    withKernel( kernel, [&]( auto k ) {
+        if( rgb ) {
+            diffuse8u<decltype( k ), RGBQuantizer8u>( input, output, options );
+        }
+        else if( options.getLuminance() ) {
+            diffuseLuminance8u<decltype( k )>( input, output, options );
+        }
+        else {
+            diffuse8u<decltype( k ), MonoQuantizer8u>( input, output, options );
+        }
+    } );
+}
+
+}
+}
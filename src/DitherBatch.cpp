@@ -0,0 +1,232 @@
+#include "Dither.h"
+#include "DitherPool.h"
+#include "DitherStats.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+using namespace ci;
+
+namespace reza {
+namespace dither {
+
+namespace detail {
+
+// Counts the images submitted and not finished yet, and totals the Stats of the images
+// dithered concurrently.
+class BatchState {
+  public:
+    void add( size_t count )
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        mPending += count;
+    }
+
+    void done()
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        if( --mPending == 0 ) {
+            mIdle.notify_all();
+        }
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock( mMutex );
+        mIdle.wait( lock, [this] { return mPending == 0; } );
+    }
+
+    //! Keeps \a error, unless an earlier one is still waiting to be taken.
+    void fail( std::exception_ptr error )
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        if( ! mError ) {
+            mError = error;
+        }
+    }
+
+    //! Returns the error kept by fail() and forgets it.
+    std::exception_ptr takeError()
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        return std::exchange( mError, nullptr );
+    }
+
+    void addStats( Stats *total, const Stats &stats )
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        total->setupSeconds += stats.setupSeconds;
+        total->allocationSeconds += stats.allocationSeconds;
+        total->ditherSeconds += stats.ditherSeconds;
+        total->pixels += stats.pixels;
+        total->bytesAllocated += stats.bytesAllocated;
+        total->threadSeconds += stats.threadSeconds;
+        total->busySeconds += stats.busySeconds;
+        total->waitSeconds += stats.waitSeconds;
+    }
+
+  private:
+    std::mutex mMutex;
+    std::condition_variable mIdle;
+    size_t mPending = 0;
+    std::exception_ptr mError;
+};
+
+// Marks an image done when it goes out of scope, however its task leaves, so wait()
+// can't hang on an image whose function or callback threw.
+class Finished {
+  public:
+    explicit Finished( BatchState &state )
+        : mState( state )
+    {
+    }
+    ~Finished() { mState.done(); }
+
+    Finished( const Finished & ) = delete;
+    Finished &operator=( const Finished & ) = delete;
+
+  private:
+    BatchState &mState;
+};
+
+} // namespace detail
+
+namespace {
+    using namespace detail;
+
+    // Dithers one image into a new surface, timing the call. Images run concurrently, so
+    // each records into a Stats of its own that is then added to the caller's.
+    BatchDitherer::Result ditherItem( BatchState &state, size_t index, const Surface32fRef &input, const BatchDitherer::Function &function,
+        const Options &options )
+    {
+        REZA_DITHER_ZONE( "dither::batchItem" );
+        Stats *total = options.getStats();
+        Stats stats;
+        const Options item = total ? Options( options ).stats( &stats ) : options;
+
+        BatchDitherer::Result result;
+        result.index = index;
+        const auto start = std::chrono::steady_clock::now();
+        result.output = allocate( item.getStats(), [&] { return Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() ); } );
+        function( input, result.output, item );
+        result.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        if( total ) {
+            state.addStats( total, stats );
+        }
+        return result;
+    }
+
+    // Cuts \a inputs into tasks: a large image on its own, dithered on every pool thread,
+    // and runs of small ones packed together and dithered on one thread each. \a finish( index,
+    // run ) is called for every image and must not throw; the pool has nowhere to send it.
+    template<typename Finish>
+    void schedule( Pool &pool, BatchState &state, const std::vector<Surface32fRef> &inputs, const BatchDitherer::Function &function,
+        const Options &options, const Finish &finish )
+    {
+        const Options single = Options( options ).threads( 1 );
+        const Options split = Options( options ).threads( pool.size() );
+
+        state.add( inputs.size() );
+        size_t begin = 0;
+        while( begin < inputs.size() ) {
+            const size_t pixels = size_t( inputs[begin]->getWidth() ) * size_t( inputs[begin]->getHeight() );
+            if( pixels >= options.getBatchSplitPixels() ) {
+                pool.submit( [&state, input = inputs[begin], function, split, finish, begin] {
+                    const Finished finished( state );
+                    finish( begin, [&] { return ditherItem( state, begin, input, function, split ); } );
+                } );
+                begin++;
+                continue;
+            }
+
+            size_t end = begin + 1, packed = pixels;
+            while( end < inputs.size() && packed < options.getBatchPackPixels() ) {
+                const size_t next = size_t( inputs[end]->getWidth() ) * size_t( inputs[end]->getHeight() );
+                if( next >= options.getBatchSplitPixels() ) {
+                    break;
+                }
+                packed += next;
+                end++;
+            }
+            std::vector<Surface32fRef> group( inputs.begin() + begin, inputs.begin() + end );
+            pool.submit( [&state, group = std::move( group ), function, single, finish, begin] {
+                for( size_t i = 0; i < group.size(); i++ ) {
+                    const Finished finished( state );
+                    finish( begin + i, [&] { return ditherItem( state, begin + i, group[i], function, single ); } );
+                }
+            } );
+            begin = end;
+        }
+    }
+}
+
+BatchDitherer::BatchDitherer( size_t threads )
+    : mState( std::make_unique<BatchState>() ), mPool( std::make_unique<Pool>( threads ) )
+{
+}
+
+BatchDitherer::~BatchDitherer()
+{
+    mState->wait();
+    // joins the workers before the state they report to goes
+    mPool.reset();
+}
+
+size_t BatchDitherer::getThreads() const
+{
+    return mPool->size();
+}
+
+std::vector<std::future<BatchDitherer::Result>> BatchDitherer::dither( const std::vector<Surface32fRef> &inputs, const Function &function, const Options &options )
+{
+    auto promises = std::make_shared<std::vector<std::promise<Result>>>( inputs.size() );
+    std::vector<std::future<Result>> futures;
+    for( auto &promise : *promises ) {
+        futures.push_back( promise.get_future() );
+    }
+    schedule( *mPool, *mState, inputs, function, options, [promises]( size_t index, const auto &run ) {
+        try {
+            ( *promises )[index].set_value( run() );
+        }
+        catch( ... ) {
+            ( *promises )[index].set_exception( std::current_exception() );
+        }
+    } );
+    return futures;
+}
+
+void BatchDitherer::dither( const std::vector<Surface32fRef> &inputs, const Function &function, const Callback &done, const Options &options )
+{
+    BatchState &state = *mState;
+    schedule( *mPool, state, inputs, function, options, [&state, done]( size_t index, const auto &run ) {
+        Result result;
+        try {
+            result = run();
+        }
+        catch( ... ) {
+            result.index = index;
+            result.error = std::current_exception();
+        }
+        try {
+            done( result );
+        }
+        catch( ... ) {
+            state.fail( std::current_exception() );
+        }
+    } );
+}
+
+void BatchDitherer::wait()
+{
+    mState->wait();
+    if( std::exception_ptr error = mState->takeError() ) {
+        std::rethrow_exception( error );
+    }
+}
+
+}
+}
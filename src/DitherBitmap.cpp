@@ -0,0 +1,40 @@
+#include "DitherCore.h"
+
+#include <algorithm>
+
+namespace reza {
+namespace dither {
+
+size_t Bitmap::Format::getRowBytes( int width ) const
+{
+    const size_t alignment = static_cast<size_t>( std::max( mRowAlignment, 1 ) );
+    const size_t bytes = ( static_cast<size_t>( std::max( width, 0 ) ) + 7 ) / 8;
+    return ( bytes + alignment - 1 ) / alignment * alignment;
+}
+
+Bitmap::Bitmap()
+    : mData( nullptr ), mWidth( 0 ), mHeight( 0 ), mRowBytes( 0 )
+{
+}
+
+Bitmap::Bitmap( int width, int height, const Format &format )
+    : mWidth( std::max( width, 0 ) ), mHeight( std::max( height, 0 ) ), mRowBytes( format.getRowBytes( width ) ), mFormat( format )
+{
+    mStorage = std::make_shared<std::vector<uint8_t>>( mRowBytes * mHeight );
+    mData = mStorage->data();
+}
+
+Bitmap::Bitmap( uint8_t *data, int width, int height, size_t rowBytes, const Format &format )
+    : mData( data ), mWidth( std::max( width, 0 ) ), mHeight( std::max( height, 0 ) ), mRowBytes( rowBytes ), mFormat( format )
+{
+}
+
+bool Bitmap::isWhite( int x, int y ) const
+{
+    const int bit = mFormat.isMsbFirst() ? 7 - ( x & 7 ) : x & 7;
+    const bool set = ( getRow( y )[x >> 3] >> bit ) & 1;
+    return set != mFormat.isBlackIsOne();
+}
+
+}
+}
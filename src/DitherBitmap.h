@@ -0,0 +1,55 @@
+#pragma once
+
+// Packing of black/white decisions into Bitmap rows. Decisions are gathered eight at a
+// time in a byte whose bit i is pixel 8k + i, then brought into the bitmap's format and
+// merged into the row, so a span that starts or ends mid-byte leaves its neighbours' bits
+// alone.
+
+#include "DitherCore.h"
+
+#include <array>
+#include <cstdint>
+
+namespace reza {
+namespace dither {
+namespace detail {
+
+constexpr std::array<uint8_t, 256> kReversedBits = [] {
+    std::array<uint8_t, 256> table{};
+    for( int i = 0; i < 256; i++ ) {
+        int reversed = 0;
+        for( int bit = 0; bit < 8; bit++ ) {
+            reversed |= ( ( i >> bit ) & 1 ) << ( 7 - bit );
+        }
+        table[i] = static_cast<uint8_t>( reversed );
+    }
+    return table;
+}();
+
+class BitWriter {
+  public:
+    explicit BitWriter( const Bitmap::Format &format )
+        : mMsbFirst( format.isMsbFirst() ), mBlackIsOne( format.isBlackIsOne() )
+    {
+    }
+
+    //! Merges \a white, where bit i is pixel 8 * \a byte + i, into byte \a byte of \a row. Only the bits set in
+    //! \a valid are written.
+    void store( uint8_t *row, int byte, uint8_t white, uint8_t valid ) const
+    {
+        uint8_t bits = mBlackIsOne ? static_cast<uint8_t>( ~white ) : white;
+        if( mMsbFirst ) {
+            bits = kReversedBits[bits];
+            valid = kReversedBits[valid];
+        }
+        row[byte] = static_cast<uint8_t>( ( row[byte] & ~valid ) | ( bits & valid ) );
+    }
+
+  private:
+    bool mMsbFirst;
+    bool mBlackIsOne;
+};
+
+}
+}
+} // namespace reza::dither::detail
@@ -0,0 +1,289 @@
+#include "DitherCore.h"
+#include "DitherCommon.h"
+#include "DitherFile.h"
+#include "DitherOrdered.h"
+#include "DitherStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace reza {
+namespace dither {
+
+namespace {
+    using namespace detail;
+    namespace fs = std::filesystem;
+
+    // "DRB2"; "DRBN" files hold masks made with the whole Gaussian, which generateMask() no longer reproduces
+    const uint32_t kMaskFileMagic = 0x32425244;
+
+    // A mask size's thresholds, set once by whichever caller first asks for them.
+    struct MaskEntry {
+        std::once_flag once;
+        std::shared_ptr<const std::vector<float>> thresholds;
+    };
+
+    // guards the map and the directory; the entries are never moved or removed
+    std::mutex sMaskMutex;
+    std::map<int, MaskEntry> sMasks;
+    fs::path sCacheDirectory;
+
+    // Rounds a requested mask size to a power of two in [ThresholdMask::minStride, 256].
+    int maskSize( int requested )
+    {
+        int size = ThresholdMask::minStride;
+        while( size < requested && size < 256 ) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    // Void-and-cluster threshold mask (Ulichney 1993) on a toroidal size x size grid. The
+    // energy of a pixel is the Gaussian-weighted count of set pixels around it; the
+    // tightest cluster is the set pixel with the most energy and the largest void the
+    // empty pixel with the least. Returns thresholds in ( 0, 1 ) ordered by rank.
+    //
+    // The Gaussian is cut off past 3 sigma, so setting or clearing a pixel only updates
+    // the energy of the 11 x 11 pixels around it, and each row keeps its tightest cluster
+    // and largest void so a search only rescans the rows that changed. That makes a 256
+    // mask a fraction of a second instead of half a minute.
+    std::vector<float> generateMask( int size )
+    {
+        const int count = size * size;
+        const int wrap = size - 1;
+        const float sigma = 1.5f;
+        // the offsets a pixel's energy reaches, every row and column when the grid is that small
+        const int radius = static_cast<int>( std::ceil( 3.0f * sigma ) );
+        const int first = 2 * radius + 1 < size ? -radius : -( size / 2 );
+        const int last = 2 * radius + 1 < size ? radius : size - size / 2 - 1;
+
+        // toroidal Gaussian indexed by ( dx, dy ) offset
+        std::vector<float> gaussian( count );
+        for( int dy = 0; dy < size; dy++ ) {
+            for( int dx = 0; dx < size; dx++ ) {
+                const int wx = std::min( dx, size - dx );
+                const int wy = std::min( dy, size - dy );
+                gaussian[dy * size + dx] = std::exp( -float( wx * wx + wy * wy ) / ( 2.0f * sigma * sigma ) );
+            }
+        }
+
+        std::vector<uint8_t> pattern( count, 0 );
+        std::vector<float> energy( count, 0.0f );
+        // per row, the index of its tightest cluster and largest void, or -1
+        std::vector<int> rowCluster( size, -1 ), rowVoid( size, -1 );
+        auto scanRow = [&]( int y ) {
+            int cluster = -1, hole = -1;
+            for( int i = y * size; i < ( y + 1 ) * size; i++ ) {
+                if( pattern[i] ) {
+                    if( cluster < 0 || energy[i] > energy[cluster] ) {
+                        cluster = i;
+                    }
+                }
+                else if( hole < 0 || energy[i] < energy[hole] ) {
+                    hole = i;
+                }
+            }
+            rowCluster[y] = cluster;
+            rowVoid[y] = hole;
+        };
+        auto scanRows = [&] {
+            for( int y = 0; y < size; y++ ) {
+                scanRow( y );
+            }
+        };
+        auto toggle = [&]( int index, bool set ) {
+            pattern[index] = set;
+            const float sign = set ? 1.0f : -1.0f;
+            const int px = index % size;
+            const int py = index / size;
+            for( int dy = first; dy <= last; dy++ ) {
+                const int y = ( py + dy ) & wrap;
+                const float *g = &gaussian[( dy & wrap ) * size];
+                float *e = &energy[y * size];
+                for( int dx = first; dx <= last; dx++ ) {
+                    e[( px + dx ) & wrap] += sign * g[dx & wrap];
+                }
+            }
+            for( int dy = first; dy <= last; dy++ ) {
+                scanRow( ( py + dy ) & wrap );
+            }
+        };
+        // the first index of the most extreme pixel, as a scan of the whole grid would find it
+        auto tightestCluster = [&] {
+            int best = -1;
+            for( int cluster : rowCluster ) {
+                if( cluster >= 0 && ( best < 0 || energy[cluster] > energy[best] ) ) {
+                    best = cluster;
+                }
+            }
+            return best;
+        };
+        auto largestVoid = [&] {
+            int best = -1;
+            for( int hole : rowVoid ) {
+                if( hole >= 0 && ( best < 0 || energy[hole] < energy[best] ) ) {
+                    best = hole;
+                }
+            }
+            return best;
+        };
+
+        scanRows();
+
+        // a fixed seed keeps regenerated masks identical to persisted ones
+        std::mt19937 random( 0x5eed );
+        const int initial = std::max( count / 10, 1 );
+        for( int placed = 0; placed < initial; ) {
+            const int index = std::uniform_int_distribution<int>( 0, count - 1 )( random );
+            if( ! pattern[index] ) {
+                toggle( index, true );
+                placed++;
+            }
+        }
+
+        // spread the initial pattern out until moving its tightest cluster doesn't help
+        for( int iteration = 0; iteration < count; iteration++ ) {
+            const int cluster = tightestCluster();
+            toggle( cluster, false );
+            const int hole = largestVoid();
+            toggle( hole, true );
+            if( hole == cluster ) {
+                break;
+            }
+        }
+
+        std::vector<int> rank( count, 0 );
+        const std::vector<uint8_t> prototype = pattern;
+        const std::vector<float> prototypeEnergy = energy;
+
+        // phase 1: rank the prototype's pixels by removing its tightest clusters
+        for( int ones = initial; ones > 0; ones-- ) {
+            const int cluster = tightestCluster();
+            toggle( cluster, false );
+            rank[cluster] = ones - 1;
+        }
+
+        // phases 2 and 3: fill the largest voids until the grid is full; the tightest
+        // cluster of empty pixels is the one with the least energy from set pixels
+        pattern = prototype;
+        energy = prototypeEnergy;
+        scanRows();
+        for( int ones = initial; ones < count; ones++ ) {
+            const int hole = largestVoid();
+            toggle( hole, true );
+            rank[hole] = ones;
+        }
+
+        std::vector<float> thresholds( count );
+        for( int i = 0; i < count; i++ ) {
+            thresholds[i] = ( rank[i] + 0.5f ) / count;
+        }
+        return thresholds;
+    }
+
+    fs::path maskPath( const fs::path &directory, int size )
+    {
+        return directory / ( "blue-noise-" + std::to_string( size ) + ".bin" );
+    }
+
+    bool readMask( const fs::path &path, int size, std::vector<float> *thresholds )
+    {
+        std::ifstream file( path.string(), std::ios::binary );
+        uint32_t header[2] = { 0, 0 };
+        if( ! file.read( reinterpret_cast<char *>( header ), sizeof( header ) ) || header[0] != kMaskFileMagic || header[1] != uint32_t( size ) ) {
+            return false;
+        }
+        thresholds->resize( size * size );
+        return static_cast<bool>( file.read( reinterpret_cast<char *>( thresholds->data() ), thresholds->size() * sizeof( float ) ) );
+    }
+
+    void writeMask( const fs::path &path, int size, const std::vector<float> &thresholds )
+    {
+        replaceFile( path, [&]( std::ofstream &file ) {
+            const uint32_t header[2] = { kMaskFileMagic, uint32_t( size ) };
+            file.write( reinterpret_cast<const char *>( header ), sizeof( header ) );
+            file.write( reinterpret_cast<const char *>( thresholds.data() ), thresholds.size() * sizeof( float ) );
+        } );
+    }
+
+    // Returns the mask of the given size, generating it at most once per process and,
+    // with a cache directory set, at most once per machine. Generating a large mask takes
+    // seconds, so it happens outside the lock: only callers asking for the same size
+    // wait for it.
+    std::shared_ptr<const std::vector<float>> blueNoiseMask( int size )
+    {
+        MaskEntry *entry;
+        fs::path directory;
+        {
+            std::lock_guard<std::mutex> lock( sMaskMutex );
+            entry = &sMasks[size];
+            directory = sCacheDirectory;
+        }
+
+        std::call_once( entry->once, [&] {
+            auto thresholds = std::make_shared<std::vector<float>>();
+            if( directory.empty() || ! readMask( maskPath( directory, size ), size, thresholds.get() ) ) {
+                *thresholds = generateMask( size );
+                if( ! directory.empty() ) {
+                    writeMask( maskPath( directory, size ), size, *thresholds );
+                }
+            }
+            entry->thresholds = thresholds;
+        } );
+        return entry->thresholds;
+    }
+
+    // The mask of Options::blueNoiseSize(), kept alive for as long as the mask refers to it.
+    class BlueNoiseMask {
+      public:
+        explicit BlueNoiseMask( const Options &options )
+            : mSize( maskSize( options.getBlueNoiseSize() ) ), mThresholds( setup( options.getStats(), [&] { return blueNoiseMask( mSize ); } ) )
+        {
+        }
+
+        ThresholdMask mask() const { return ThresholdMask( mThresholds->data(), mSize, mSize ); }
+
+      private:
+        int mSize;
+        std::shared_ptr<const std::vector<float>> mThresholds;
+    };
+}
+
+void setBlueNoiseCacheDirectory( const std::filesystem::path &directory )
+{
+    std::lock_guard<std::mutex> lock( sMaskMutex );
+    sCacheDirectory = directory;
+}
+
+void blueNoise( const ImageView32f &input, const ImageView32f &output, bool rgb, const Options &options )
+{
+    const BlueNoiseMask mask( options );
+    if( rgb ) {
+        threshold( input, output, mask.mask(), RGBQuantizer(), options );
+    }
+    else {
+        threshold( input, output, mask.mask(), MonoQuantizer(), options );
+    }
+}
+
+void blueNoise( const ImageView32f &input, Bitmap &output, const Options &options )
+{
+    threshold( input, output, BlueNoiseMask( options ).mask(), options );
+}
+
+void blueNoise( const ImageView32f &input, IndexedImage &output, const Options &options )
+{
+    threshold( input, output, BlueNoiseMask( options ).mask(), options );
+}
+
+}
+}
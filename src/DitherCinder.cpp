@@ -0,0 +1,924 @@
+#include "Dither.h"
+#include "DitherStats.h"
+#include "DitherVideo.h"
+
+using namespace ci;
+
+// The Cinder interface: every function here runs its DitherCore.h counterpart on views of
+// the surfaces it is given, and only allocates the surfaces it returns.
+
+namespace reza {
+namespace dither {
+
+namespace {
+    using namespace detail;
+
+    // A surface the size and alpha of \a input, timed and counted as an allocation.
+    Surface32fRef createOutput( const Surface32fRef &input, const Options &options )
+    {
+        return allocate( options.getStats(), [&] { return Surface32f::create( input->getWidth(), input->getHeight(), input->hasAlpha() ); } );
+    }
+
+    Surface8uRef createOutput( const Surface8uRef &input, const Options &options )
+    {
+        return allocate( options.getStats(), [&] { return Surface8u::create( input->getWidth(), input->getHeight(), input->hasAlpha() ); } );
+    }
+}
+
+
+Surface32fRef linear( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    linear( input, output, options );
+    return output;
+}
+
+void linear( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::Linear, toView( input ), toView( output ), false, options );
+}
+
+Surface32fRef linearRGB( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    linearRGB( input, output, options );
+    return output;
+}
+
+void linearRGB( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::Linear, toView( input ), toView( output ), true, options );
+}
+
+Surface32fRef FloydSteinberg( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    FloydSteinberg( input, output, options );
+    return output;
+}
+
+void FloydSteinberg( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::FloydSteinberg, toView( input ), toView( output ), false, options );
+}
+
+Surface32fRef FloydSteinbergRGB( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    FloydSteinbergRGB( input, output, options );
+    return output;
+}
+
+void FloydSteinbergRGB( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::FloydSteinberg, toView( input ), toView( output ), true, options );
+}
+
+Surface32fRef JarvisJudiceNinke( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    JarvisJudiceNinke( input, output, options );
+    return output;
+}
+
+void JarvisJudiceNinke( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::JarvisJudiceNinke, toView( input ), toView( output ), false, options );
+}
+
+Surface32fRef JarvisJudiceNinkeRGB( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    JarvisJudiceNinkeRGB( input, output, options );
+    return output;
+}
+
+void JarvisJudiceNinkeRGB( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::JarvisJudiceNinke, toView( input ), toView( output ), true, options );
+}
+
+Surface32fRef Stucki( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Stucki( input, output, options );
+    return output;
+}
+
+void Stucki( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::Stucki, toView( input ), toView( output ), false, options );
+}
+
+Surface32fRef StuckiRGB( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    StuckiRGB( input, output, options );
+    return output;
+}
+
+void StuckiRGB( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::Stucki, toView( input ), toView( output ), true, options );
+}
+
+Surface32fRef Atkinson( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Atkinson( input, output, options );
+    return output;
+}
+
+void Atkinson( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::Atkinson, toView( input ), toView( output ), false, options );
+}
+
+Surface32fRef AtkinsonRGB( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    AtkinsonRGB( input, output, options );
+    return output;
+}
+
+void AtkinsonRGB( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::Atkinson, toView( input ), toView( output ), true, options );
+}
+
+Surface32fRef Burkes( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Burkes( input, output, options );
+    return output;
+}
+
+void Burkes( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::Burkes, toView( input ), toView( output ), false, options );
+}
+
+Surface32fRef BurkesRGB( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    BurkesRGB( input, output, options );
+    return output;
+}
+
+void BurkesRGB( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::Burkes, toView( input ), toView( output ), true, options );
+}
+
+Surface32fRef Sierra( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Sierra( input, output, options );
+    return output;
+}
+
+void Sierra( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::Sierra, toView( input ), toView( output ), false, options );
+}
+
+Surface32fRef SierraRGB( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    SierraRGB( input, output, options );
+    return output;
+}
+
+void SierraRGB( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::Sierra, toView( input ), toView( output ), true, options );
+}
+
+Surface32fRef TwoRowSierra( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    TwoRowSierra( input, output, options );
+    return output;
+}
+
+void TwoRowSierra( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::TwoRowSierra, toView( input ), toView( output ), false, options );
+}
+
+Surface32fRef TwoRowSierraRGB( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    TwoRowSierraRGB( input, output, options );
+    return output;
+}
+
+void TwoRowSierraRGB( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::TwoRowSierra, toView( input ), toView( output ), true, options );
+}
+
+Surface32fRef SierraLite( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    SierraLite( input, output, options );
+    return output;
+}
+
+void SierraLite( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::SierraLite, toView( input ), toView( output ), false, options );
+}
+
+Surface32fRef SierraLiteRGB( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    SierraLiteRGB( input, output, options );
+    return output;
+}
+
+void SierraLiteRGB( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    diffuse( Kernel::SierraLite, toView( input ), toView( output ), true, options );
+}
+
+void linear( Surface32fRef input, Bitmap &output, const Options &options )
+{
+    diffuse( Kernel::Linear, toView( input ), output, options );
+}
+
+void FloydSteinberg( Surface32fRef input, Bitmap &output, const Options &options )
+{
+    diffuse( Kernel::FloydSteinberg, toView( input ), output, options );
+}
+
+void JarvisJudiceNinke( Surface32fRef input, Bitmap &output, const Options &options )
+{
+    diffuse( Kernel::JarvisJudiceNinke, toView( input ), output, options );
+}
+
+void Stucki( Surface32fRef input, Bitmap &output, const Options &options )
+{
+    diffuse( Kernel::Stucki, toView( input ), output, options );
+}
+
+void Atkinson( Surface32fRef input, Bitmap &output, const Options &options )
+{
+    diffuse( Kernel::Atkinson, toView( input ), output, options );
+}
+
+void Burkes( Surface32fRef input, Bitmap &output, const Options &options )
+{
+    diffuse( Kernel::Burkes, toView( input ), output, options );
+}
+
+void Sierra( Surface32fRef input, Bitmap &output, const Options &options )
+{
+    diffuse( Kernel::Sierra, toView( input ), output, options );
+}
+
+void TwoRowSierra( Surface32fRef input, Bitmap &output, const Options &options )
+{
+    diffuse( Kernel::TwoRowSierra, toView( input ), output, options );
+}
+
+void SierraLite( Surface32fRef input, Bitmap &output, const Options &options )
+{
+    diffuse( Kernel::SierraLite, toView( input ), output, options );
+}
+
+void linearRGB( Surface32fRef input, IndexedImage &output, const Options &options )
+{
+    diffuse( Kernel::Linear, toView( input ), output, options );
+}
+
+void FloydSteinbergRGB( Surface32fRef input, IndexedImage &output, const Options &options )
+{
+    diffuse( Kernel::FloydSteinberg, toView( input ), output, options );
+}
+
+void JarvisJudiceNinkeRGB( Surface32fRef input, IndexedImage &output, const Options &options )
+{
+    diffuse( Kernel::JarvisJudiceNinke, toView( input ), output, options );
+}
+
+void StuckiRGB( Surface32fRef input, IndexedImage &output, const Options &options )
+{
+    diffuse( Kernel::Stucki, toView( input ), output, options );
+}
+
+void AtkinsonRGB( Surface32fRef input, IndexedImage &output, const Options &options )
+{
+    diffuse( Kernel::Atkinson, toView( input ), output, options );
+}
+
+void BurkesRGB( Surface32fRef input, IndexedImage &output, const Options &options )
+{
+    diffuse( Kernel::Burkes, toView( input ), output, options );
+}
+
+void SierraRGB( Surface32fRef input, IndexedImage &output, const Options &options )
+{
+    diffuse( Kernel::Sierra, toView( input ), output, options );
+}
+
+void TwoRowSierraRGB( Surface32fRef input, IndexedImage &output, const Options &options )
+{
+    diffuse( Kernel::TwoRowSierra, toView( input ), output, options );
+}
+
+void SierraLiteRGB( Surface32fRef input, IndexedImage &output, const Options &options )
+{
+    diffuse( Kernel::SierraLite, toView( input ), output, options );
+}
+
+Surface32fRef linear( Surface32fRef input, const Palette &palette, const Options &options )
+{
+    auto output = createOutput( input, options );
+    linear( input, output, palette, options );
+    return output;
+}
+
+void linear( Surface32fRef input, Surface32fRef output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::Linear, toView( input ), toView( output ), palette, options );
+}
+
+Surface32fRef FloydSteinberg( Surface32fRef input, const Palette &palette, const Options &options )
+{
+    auto output = createOutput( input, options );
+    FloydSteinberg( input, output, palette, options );
+    return output;
+}
+
+void FloydSteinberg( Surface32fRef input, Surface32fRef output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::FloydSteinberg, toView( input ), toView( output ), palette, options );
+}
+
+Surface32fRef JarvisJudiceNinke( Surface32fRef input, const Palette &palette, const Options &options )
+{
+    auto output = createOutput( input, options );
+    JarvisJudiceNinke( input, output, palette, options );
+    return output;
+}
+
+void JarvisJudiceNinke( Surface32fRef input, Surface32fRef output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::JarvisJudiceNinke, toView( input ), toView( output ), palette, options );
+}
+
+Surface32fRef Stucki( Surface32fRef input, const Palette &palette, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Stucki( input, output, palette, options );
+    return output;
+}
+
+void Stucki( Surface32fRef input, Surface32fRef output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::Stucki, toView( input ), toView( output ), palette, options );
+}
+
+Surface32fRef Atkinson( Surface32fRef input, const Palette &palette, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Atkinson( input, output, palette, options );
+    return output;
+}
+
+void Atkinson( Surface32fRef input, Surface32fRef output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::Atkinson, toView( input ), toView( output ), palette, options );
+}
+
+Surface32fRef Burkes( Surface32fRef input, const Palette &palette, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Burkes( input, output, palette, options );
+    return output;
+}
+
+void Burkes( Surface32fRef input, Surface32fRef output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::Burkes, toView( input ), toView( output ), palette, options );
+}
+
+Surface32fRef Sierra( Surface32fRef input, const Palette &palette, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Sierra( input, output, palette, options );
+    return output;
+}
+
+void Sierra( Surface32fRef input, Surface32fRef output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::Sierra, toView( input ), toView( output ), palette, options );
+}
+
+Surface32fRef TwoRowSierra( Surface32fRef input, const Palette &palette, const Options &options )
+{
+    auto output = createOutput( input, options );
+    TwoRowSierra( input, output, palette, options );
+    return output;
+}
+
+void TwoRowSierra( Surface32fRef input, Surface32fRef output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::TwoRowSierra, toView( input ), toView( output ), palette, options );
+}
+
+Surface32fRef SierraLite( Surface32fRef input, const Palette &palette, const Options &options )
+{
+    auto output = createOutput( input, options );
+    SierraLite( input, output, palette, options );
+    return output;
+}
+
+void SierraLite( Surface32fRef input, Surface32fRef output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::SierraLite, toView( input ), toView( output ), palette, options );
+}
+
+void linear( Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::Linear, toView( input ), output, palette, options );
+}
+
+void FloydSteinberg( Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::FloydSteinberg, toView( input ), output, palette, options );
+}
+
+void JarvisJudiceNinke( Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::JarvisJudiceNinke, toView( input ), output, palette, options );
+}
+
+void Stucki( Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::Stucki, toView( input ), output, palette, options );
+}
+
+void Atkinson( Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::Atkinson, toView( input ), output, palette, options );
+}
+
+void Burkes( Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::Burkes, toView( input ), output, palette, options );
+}
+
+void Sierra( Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::Sierra, toView( input ), output, palette, options );
+}
+
+void TwoRowSierra( Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::TwoRowSierra, toView( input ), output, palette, options );
+}
+
+void SierraLite( Surface32fRef input, IndexedImage &output, const Palette &palette, const Options &options )
+{
+    diffuse( Kernel::SierraLite, toView( input ), output, palette, options );
+}
+
+Palette buildPalette( Surface32fRef input, int colors, const Options &options )
+{
+    return buildPalette( toView( input ), colors, options );
+}
+
+Palette buildPalette( Surface8uRef input, int colors, const Options &options )
+{
+    return buildPalette( toView( input ), colors, options );
+}
+
+Surface8uRef linear( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    linear( input, output, options );
+    return output;
+}
+
+void linear( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::Linear, toView( input ), toView( output ), false, options );
+}
+
+Surface8uRef linearRGB( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    linearRGB( input, output, options );
+    return output;
+}
+
+void linearRGB( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::Linear, toView( input ), toView( output ), true, options );
+}
+
+Surface8uRef FloydSteinberg( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    FloydSteinberg( input, output, options );
+    return output;
+}
+
+void FloydSteinberg( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::FloydSteinberg, toView( input ), toView( output ), false, options );
+}
+
+Surface8uRef FloydSteinbergRGB( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    FloydSteinbergRGB( input, output, options );
+    return output;
+}
+
+void FloydSteinbergRGB( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::FloydSteinberg, toView( input ), toView( output ), true, options );
+}
+
+Surface8uRef JarvisJudiceNinke( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    JarvisJudiceNinke( input, output, options );
+    return output;
+}
+
+void JarvisJudiceNinke( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::JarvisJudiceNinke, toView( input ), toView( output ), false, options );
+}
+
+Surface8uRef JarvisJudiceNinkeRGB( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    JarvisJudiceNinkeRGB( input, output, options );
+    return output;
+}
+
+void JarvisJudiceNinkeRGB( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::JarvisJudiceNinke, toView( input ), toView( output ), true, options );
+}
+
+Surface8uRef Stucki( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Stucki( input, output, options );
+    return output;
+}
+
+void Stucki( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::Stucki, toView( input ), toView( output ), false, options );
+}
+
+Surface8uRef StuckiRGB( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    StuckiRGB( input, output, options );
+    return output;
+}
+
+void StuckiRGB( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::Stucki, toView( input ), toView( output ), true, options );
+}
+
+Surface8uRef Atkinson( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Atkinson( input, output, options );
+    return output;
+}
+
+void Atkinson( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::Atkinson, toView( input ), toView( output ), false, options );
+}
+
+Surface8uRef AtkinsonRGB( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    AtkinsonRGB( input, output, options );
+    return output;
+}
+
+void AtkinsonRGB( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::Atkinson, toView( input ), toView( output ), true, options );
+}
+
+Surface8uRef Burkes( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Burkes( input, output, options );
+    return output;
+}
+
+void Burkes( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::Burkes, toView( input ), toView( output ), false, options );
+}
+
+Surface8uRef BurkesRGB( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    BurkesRGB( input, output, options );
+    return output;
+}
+
+void BurkesRGB( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::Burkes, toView( input ), toView( output ), true, options );
+}
+
+Surface8uRef Sierra( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Sierra( input, output, options );
+    return output;
+}
+
+void Sierra( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::Sierra, toView( input ), toView( output ), false, options );
+}
+
+Surface8uRef SierraRGB( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    SierraRGB( input, output, options );
+    return output;
+}
+
+void SierraRGB( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::Sierra, toView( input ), toView( output ), true, options );
+}
+
+Surface8uRef TwoRowSierra( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    TwoRowSierra( input, output, options );
+    return output;
+}
+
+void TwoRowSierra( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::TwoRowSierra, toView( input ), toView( output ), false, options );
+}
+
+Surface8uRef TwoRowSierraRGB( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    TwoRowSierraRGB( input, output, options );
+    return output;
+}
+
+void TwoRowSierraRGB( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::TwoRowSierra, toView( input ), toView( output ), true, options );
+}
+
+Surface8uRef SierraLite( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    SierraLite( input, output, options );
+    return output;
+}
+
+void SierraLite( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::SierraLite, toView( input ), toView( output ), false, options );
+}
+
+Surface8uRef SierraLiteRGB( Surface8uRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    SierraLiteRGB( input, output, options );
+    return output;
+}
+
+void SierraLiteRGB( Surface8uRef input, Surface8uRef output, const Options &options )
+{
+    diffuse( Kernel::SierraLite, toView( input ), toView( output ), true, options );
+}
+
+Surface32fRef Bayer2( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Bayer2( input, output, options );
+    return output;
+}
+
+void Bayer2( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    bayer( 2, toView( input ), toView( output ), false, options );
+}
+
+Surface32fRef Bayer2RGB( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Bayer2RGB( input, output, options );
+    return output;
+}
+
+void Bayer2RGB( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    bayer( 2, toView( input ), toView( output ), true, options );
+}
+
+void Bayer2( Surface32fRef input, Bitmap &output, const Options &options )
+{
+    bayer( 2, toView( input ), output, options );
+}
+
+void Bayer2RGB( Surface32fRef input, IndexedImage &output, const Options &options )
+{
+    bayer( 2, toView( input ), output, options );
+}
+
+Surface32fRef Bayer4( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Bayer4( input, output, options );
+    return output;
+}
+
+void Bayer4( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    bayer( 4, toView( input ), toView( output ), false, options );
+}
+
+Surface32fRef Bayer4RGB( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Bayer4RGB( input, output, options );
+    return output;
+}
+
+void Bayer4RGB( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    bayer( 4, toView( input ), toView( output ), true, options );
+}
+
+void Bayer4( Surface32fRef input, Bitmap &output, const Options &options )
+{
+    bayer( 4, toView( input ), output, options );
+}
+
+void Bayer4RGB( Surface32fRef input, IndexedImage &output, const Options &options )
+{
+    bayer( 4, toView( input ), output, options );
+}
+
+Surface32fRef Bayer8( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Bayer8( input, output, options );
+    return output;
+}
+
+void Bayer8( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    bayer( 8, toView( input ), toView( output ), false, options );
+}
+
+Surface32fRef Bayer8RGB( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Bayer8RGB( input, output, options );
+    return output;
+}
+
+void Bayer8RGB( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    bayer( 8, toView( input ), toView( output ), true, options );
+}
+
+void Bayer8( Surface32fRef input, Bitmap &output, const Options &options )
+{
+    bayer( 8, toView( input ), output, options );
+}
+
+void Bayer8RGB( Surface32fRef input, IndexedImage &output, const Options &options )
+{
+    bayer( 8, toView( input ), output, options );
+}
+
+Surface32fRef Bayer16( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Bayer16( input, output, options );
+    return output;
+}
+
+void Bayer16( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    bayer( 16, toView( input ), toView( output ), false, options );
+}
+
+Surface32fRef Bayer16RGB( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    Bayer16RGB( input, output, options );
+    return output;
+}
+
+void Bayer16RGB( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    bayer( 16, toView( input ), toView( output ), true, options );
+}
+
+void Bayer16( Surface32fRef input, Bitmap &output, const Options &options )
+{
+    bayer( 16, toView( input ), output, options );
+}
+
+void Bayer16RGB( Surface32fRef input, IndexedImage &output, const Options &options )
+{
+    bayer( 16, toView( input ), output, options );
+}
+
+Surface32fRef BlueNoise( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    BlueNoise( input, output, options );
+    return output;
+}
+
+void BlueNoise( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    blueNoise( toView( input ), toView( output ), false, options );
+}
+
+Surface32fRef BlueNoiseRGB( Surface32fRef input, const Options &options )
+{
+    auto output = createOutput( input, options );
+    BlueNoiseRGB( input, output, options );
+    return output;
+}
+
+void BlueNoiseRGB( Surface32fRef input, Surface32fRef output, const Options &options )
+{
+    blueNoise( toView( input ), toView( output ), true, options );
+}
+
+void BlueNoise( Surface32fRef input, Bitmap &output, const Options &options )
+{
+    blueNoise( toView( input ), output, options );
+}
+
+void BlueNoiseRGB( Surface32fRef input, IndexedImage &output, const Options &options )
+{
+    blueNoise( toView( input ), output, options );
+}
+
+VideoDitherer::VideoDitherer( Kernel kernel, bool rgb, const Options &options )
+    : mImpl( detail::makeFrameDitherer( kernel, rgb, options ) )
+{
+}
+
+VideoDitherer::VideoDitherer( Kernel kernel, const Palette &palette, const Options &options )
+    : mImpl( detail::makeFrameDitherer( kernel, palette, options ) )
+{
+}
+
+VideoDitherer::VideoDitherer( VideoDitherer &&other ) = default;
+VideoDitherer &VideoDitherer::operator=( VideoDitherer &&other ) = default;
+VideoDitherer::~VideoDitherer() = default;
+
+Surface32fRef VideoDitherer::dither( Surface32fRef frame )
+{
+    if( ! mOutput || mOutput->getWidth() != frame->getWidth() || mOutput->getHeight() != frame->getHeight() || mOutput->hasAlpha() != frame->hasAlpha() ) {
+        mOutput = Surface32f::create( frame->getWidth(), frame->getHeight(), frame->hasAlpha() );
+        mImpl->reset();
+    }
+    mImpl->dither( toView( frame ), toView( mOutput ) );
+    return mOutput;
+}
+
+int VideoDitherer::getRowsDithered() const
+{
+    return mImpl->getRowsDithered();
+}
+
+void VideoDitherer::reset()
+{
+    mImpl->reset();
+}
+
+float seamVisibility( Surface32fRef source, Surface32fRef dithered, int stripeHeight )
+{
+    return seamVisibility( toView( source ), toView( dithered ), stripeHeight );
+}
+
+}
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+// Pieces shared by the dithering translation units: the output colors, the quantizers
+// and raw access to the rows of image views.
+
+#include "DitherCore.h"
+#include "DitherSimd.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace reza {
+namespace dither {
+namespace detail {
+
+using simd::Vec4;
+
+const Vec4 white = Vec4( 1.0f, 1.0f, 1.0f, 0.0f );
+const Vec4 whiteColor = Vec4( 1.0f, 1.0f, 1.0f, 1.0f );
+const Vec4 red = Vec4( 1.0f, 0.0f, 0.0f, 0.0f );
+const Vec4 redColor = Vec4( 1.0f, 0.0f, 0.0f, 1.0f );
+const Vec4 green = Vec4( 0.0f, 1.0f, 0.0f, 0.0f );
+const Vec4 greenColor = Vec4( 0.0f, 1.0f, 0.0f, 1.0f );
+const Vec4 blue = Vec4( 0.0f, 0.0f, 1.0f, 0.0f );
+const Vec4 blueColor = Vec4( 0.0f, 0.0f, 1.0f, 1.0f );
+const Vec4 black = Vec4( 0.0f, 0.0f, 0.0f, 0.0f );
+const Vec4 blackColor = Vec4( 0.0f, 0.0f, 0.0f, 1.0f );
+
+// Rec. 709 luminance weights of red, green and blue.
+const float lumaRed = 0.2126f;
+const float lumaGreen = 0.7152f;
+const float lumaBlue = 0.0722f;
+
+// Picks white or black, whichever is closer to the accumulated color.
+struct MonoQuantizer {
+    Vec4 operator()( const Vec4 &total ) const { return isWhite( total ) ? whiteColor : blackColor; }
+
+    static bool isWhite( const Vec4 &total )
+    {
+        float whiteDist, blackDist;
+        simd::lengths( total - white, total - black, &whiteDist, &blackDist );
+        return whiteDist <= blackDist;
+    }
+};
+
+// Picks the closest of red, green, blue and black, preferring them in that order on ties.
+struct RGBQuantizer {
+    Vec4 operator()( const Vec4 &total ) const { return color( index( total ) ); }
+
+    //! Returns 0, 1, 2 or 3 for red, green, blue or black.
+    static int index( const Vec4 &total ) { return simd::firstMin( simd::lengths( total - red, total - green, total - blue, total - black ) ); }
+
+    static Vec4 color( int index )
+    {
+        switch( index ) {
+            case 0: return redColor;
+            case 1: return greenColor;
+            case 2: return blueColor;
+            default: return blackColor;
+        }
+    }
+};
+
+// The output alpha Options::alpha() asks for, from the alpha of the source pixel. The
+// quantizers always pick opaque colors; this is applied to them on the way out.
+class AlphaOutput {
+  public:
+    explicit AlphaOutput( const Options &options )
+        : mPolicy( options.getAlphaPolicy() ), mThreshold( options.getAlphaThreshold() ),
+          mThreshold8u( static_cast<int>( std::ceil( options.getAlphaThreshold() * 255.0f ) ) )
+    {
+    }
+
+    //! Whether every pixel is written opaque.
+    bool isOpaque() const { return mPolicy == AlphaPolicy::Ignore; }
+
+    //! Returns the opaque \a color with the alpha for a pixel read as \a source.
+    Vec4 operator()( const Vec4 &color, const Vec4 &source ) const
+    {
+        switch( mPolicy ) {
+            case AlphaPolicy::Preserve: return color.withAlpha( source.alpha() );
+            case AlphaPolicy::Threshold: return source.alpha() >= mThreshold ? color : color.withAlpha( 0.0f );
+            default: return color;
+        }
+    }
+
+    //! Returns the 8-bit alpha for a pixel whose alpha is \a source, 255 for surfaces without alpha.
+    uint8_t operator()( int source ) const
+    {
+        switch( mPolicy ) {
+            case AlphaPolicy::Preserve: return static_cast<uint8_t>( source );
+            case AlphaPolicy::Threshold: return source >= mThreshold8u ? 255 : 0;
+            default: return 255;
+        }
+    }
+
+  private:
+    AlphaPolicy mPolicy;
+    float mThreshold;
+    int mThreshold8u;
+};
+
+// Raw access to the rows of a float image view that honours its channel order and pixel
+// stride, so the inner loops can walk pixels with a pointer instead of going through
+// per-channel offsets for every sample.
+class SurfaceView {
+  public:
+    explicit SurfaceView( const ImageView32f &view )
+        : mData( view.getData() ), mRowStride( view.getRowBytes() / static_cast<ptrdiff_t>( sizeof( float ) ) ), mPixelInc( view.getPixelInc() ),
+          mRed( view.getRedOffset() ), mGreen( view.getGreenOffset() ), mBlue( view.getBlueOffset() ), mAlpha( view.getAlphaOffset() )
+    {
+        mPacked = mPixelInc == 4 && mRed == 0 && mGreen == 1 && mBlue == 2 && mAlpha == 3;
+    }
+
+    // A view over packed RGBA rows. A row stride of 0 maps every row onto the same memory.
+    SurfaceView( float *data, ptrdiff_t rowStride )
+        : mData( data ), mRowStride( rowStride ), mPixelInc( 4 ), mRed( 0 ), mGreen( 1 ), mBlue( 2 ), mAlpha( 3 ), mPacked( true )
+    {
+    }
+
+    // A view over rows of packed r, g, b floats, followed by a with \a alpha.
+    SurfaceView( float *data, ptrdiff_t rowStride, bool alpha )
+        : mData( data ), mRowStride( rowStride ), mPixelInc( alpha ? 4 : 3 ), mRed( 0 ), mGreen( 1 ), mBlue( 2 ), mAlpha( alpha ? 3 : -1 ),
+          mPacked( alpha )
+    {
+    }
+
+    float *row( int y ) const { return mData + y * mRowStride; }
+    int pixelInc() const { return mPixelInc; }
+    bool hasAlpha() const { return mAlpha >= 0; }
+    //! Whether pixels are stored as consecutive r, g, b, a floats.
+    bool isPacked() const { return mPacked; }
+    //! Whether pixels of \a other are laid out the same way, so rows can be compared and copied as raw floats.
+    bool hasLayoutOf( const SurfaceView &other ) const
+    {
+        return mPixelInc == other.mPixelInc && mRed == other.mRed && mGreen == other.mGreen && mBlue == other.mBlue && mAlpha == other.mAlpha;
+    }
+
+    Vec4 read( const float *pixel ) const
+    {
+        if( mPacked ) {
+            return Vec4::load( pixel );
+        }
+        return Vec4( pixel[mRed], pixel[mGreen], pixel[mBlue], mAlpha >= 0 ? pixel[mAlpha] : 1.0f );
+    }
+
+    //! Returns the Rec. 709 luminance of the pixel's r, g and b.
+    float luminance( const float *pixel ) const { return lumaRed * pixel[mRed] + lumaGreen * pixel[mGreen] + lumaBlue * pixel[mBlue]; }
+
+    void write( float *pixel, const Vec4 &color ) const
+    {
+        if( mPacked ) {
+            color.store( pixel );
+            return;
+        }
+        float rgba[4];
+        color.store( rgba );
+        pixel[mRed] = rgba[0];
+        pixel[mGreen] = rgba[1];
+        pixel[mBlue] = rgba[2];
+        if( mAlpha >= 0 ) {
+            pixel[mAlpha] = rgba[3];
+        }
+    }
+
+  private:
+    float *mData;
+    ptrdiff_t mRowStride;
+    int mPixelInc;
+    int mRed, mGreen, mBlue, mAlpha;
+    bool mPacked;
+};
+
+// Raw access to the rows of an 8-bit image view that honours its channel order.
+class SurfaceView8u {
+  public:
+    explicit SurfaceView8u( const ImageView8u &view )
+        : mData( view.getData() ), mRowBytes( view.getRowBytes() ), mPixelInc( view.getPixelInc() ), mRed( view.getRedOffset() ),
+          mGreen( view.getGreenOffset() ), mBlue( view.getBlueOffset() ), mAlpha( view.getAlphaOffset() )
+    {
+    }
+
+    // A view over packed RGBA rows. A row stride of 0 maps every row onto the same memory.
+    SurfaceView8u( uint8_t *data, ptrdiff_t rowBytes )
+        : mData( data ), mRowBytes( rowBytes ), mPixelInc( 4 ), mRed( 0 ), mGreen( 1 ), mBlue( 2 ), mAlpha( 3 )
+    {
+    }
+
+    uint8_t *row( int y ) const { return mData + y * mRowBytes; }
+    int pixelInc() const { return mPixelInc; }
+    int red() const { return mRed; }
+    int green() const { return mGreen; }
+    int blue() const { return mBlue; }
+    int alpha() const { return mAlpha; }
+
+  private:
+    uint8_t *mData;
+    ptrdiff_t mRowBytes;
+    int mPixelInc;
+    int mRed, mGreen, mBlue, mAlpha;
+};
+
+}
+}
+} // namespace reza::dither::detail
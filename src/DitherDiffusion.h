@@ -0,0 +1,208 @@
+#pragma once
+
+// Row scheduling shared by the error diffusion engines. The engines supply a "pass": a
+// per-worker object created by makePass() and called as
+//
+//     pass( lines, y, x0, x1, discard )
+//
+// to quantize pixels [x0, x1) of row y and spread their error through lines[0 .. rows).
+// With discard set the quantized pixels are only used to seed error and must not reach
+// the output. Rows is the ErrorRows type that holds the pass's error lines.
+//
+// With Options::stats() set, the drivers also report the scratch they allocate and the
+// time each worker spends working and waiting.
+
+#include "DitherCore.h"
+#include "DitherKernels.h"
+#include "DitherParallel.h"
+#include "DitherStats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace reza {
+namespace dither {
+namespace detail {
+
+// Serial error diffusion, one row after the other through a ring of kernel rows lines.
+// The ring is kept per thread and reused, so repeated calls don't allocate.
+template<typename Rows, typename MakePass>
+void diffuseSerial( int width, int height, Stats *stats, const MakePass &makePass )
+{
+    auto pass = makePass();
+    thread_local Rows errors( 0 );
+    const size_t reserved = errors.bytes();
+    errors.reset( width );
+    if( stats && errors.bytes() > reserved ) {
+        stats->bytesAllocated += errors.bytes() - reserved;
+    }
+    typename Rows::value_type *lines[Rows::rows];
+
+    for( int y = 0; y < height; y++ ) {
+        errors.lines( y, lines );
+        pass( lines, y, 0, width, false );
+        errors.recycle( y );
+    }
+}
+
+// Wavefront error diffusion. Workers claim rows in order and follow the row above at
+// a lag of twice the kernel's reach, so every error line receives its contributions
+// in exactly the serial order and the result is bit-identical to one thread. Each row
+// publishes its progress through an atomic counter, which is all the synchronization
+// there is. With N workers at most N rows are unfinished, so the error ring holds
+// N + rows lines.
+template<typename Rows, typename MakePass>
+void diffuseWavefront( int width, int height, size_t threads, Stats *stats, const MakePass &makePass )
+{
+    constexpr int rows = Rows::rows;
+    constexpr int lag = 2 * Rows::reach + 1;
+    // pixels processed between progress updates
+    constexpr int chunk = 64;
+
+    Rows errors( width, rows + static_cast<int>( threads ) );
+    std::vector<std::atomic<int>> progress( height );
+    for( auto &done : progress ) {
+        done.store( 0, std::memory_order_relaxed );
+    }
+    std::atomic<int> nextRow( 0 );
+    std::vector<WorkerTime> times( stats ? threads : 0 );
+    if( stats ) {
+        stats->bytesAllocated += errors.bytes() + progress.size() * sizeof( progress[0] );
+    }
+
+    parallel::run( threads, [&]( size_t worker ) {
+        REZA_DITHER_ZONE( "dither::wavefront" );
+        const Stopwatch busy;
+        double wait = 0.0;
+        auto pass = makePass();
+        for( int y = nextRow++; y < height; y = nextRow++ ) {
+            // this row is the first to touch the furthest line it writes
+            errors.recycle( y + rows - 1 );
+            typename Rows::value_type *lines[rows];
+            errors.lines( y, lines );
+
+            for( int x0 = 0; x0 < width; x0 += chunk ) {
+                const int x1 = std::min( x0 + chunk, width );
+                // single-row kernels wait too, which keeps rows finishing in order
+                if( y > 0 ) {
+                    const int needed = std::min( x1 - 1 + lag, width );
+                    if( progress[y - 1].load( std::memory_order_acquire ) < needed ) {
+                        const Stopwatch waiting;
+                        while( progress[y - 1].load( std::memory_order_acquire ) < needed ) {
+                            std::this_thread::yield();
+                        }
+                        if( stats ) {
+                            wait += waiting.seconds();
+                        }
+                    }
+                }
+                pass( lines, y, x0, x1, false );
+                progress[y].store( x1, std::memory_order_release );
+            }
+        }
+        if( stats ) {
+            times[worker] = { busy.seconds(), wait };
+        }
+    } );
+    addWorkers( stats, times );
+}
+
+// Striped error diffusion. Stripes are dithered independently, each starting from the
+// error state left by diffusing the seed rows above it without output. All stripes are
+// seeded before any is written, so the seed rows are read before a neighbouring stripe
+// can overwrite them when dithering in place. The seeded error is then smoothed along
+// the row: its pixel-level pattern belongs to dots the stripe doesn't draw and would sit
+// against the stripe's own first row as a visible seam, while its local average still
+// carries the tone of the rows above.
+const int kSeedSmoothing = 32;
+
+template<typename Rows, typename MakePass>
+void diffuseStripes( int width, int height, int stripeHeight, int seedRows, size_t threads, Stats *stats, const MakePass &makePass )
+{
+    const int count = ( height + stripeHeight - 1 ) / stripeHeight;
+    const size_t workers = parallel::resolveThreads( threads, count );
+    std::vector<Rows> errors( count, Rows( width ) );
+    std::vector<WorkerTime> times( stats ? workers : 0 );
+    if( stats ) {
+        stats->bytesAllocated += count * errors[0].bytes();
+    }
+
+    auto forEachStripe = [&]( auto &&function ) {
+        std::atomic<int> nextStripe( 0 );
+        parallel::run( workers, [&]( size_t worker ) {
+            REZA_DITHER_ZONE( "dither::stripes" );
+            const Stopwatch busy;
+            auto pass = makePass();
+            typename Rows::value_type *lines[Rows::rows];
+            for( int stripe = nextStripe++; stripe < count; stripe = nextStripe++ ) {
+                function( pass, lines, stripe );
+            }
+            if( stats ) {
+                times[worker].busy += busy.seconds();
+            }
+        } );
+    };
+
+    forEachStripe( [&]( auto &pass, auto *lines, int stripe ) {
+        const int y0 = stripe * stripeHeight;
+        for( int y = std::max( y0 - seedRows, 0 ); y < y0; y++ ) {
+            errors[stripe].lines( y, lines );
+            pass( lines, y, 0, width, true );
+            errors[stripe].recycle( y );
+        }
+        if( y0 > 0 && seedRows > 0 ) {
+            errors[stripe].template smooth<kSeedSmoothing>( y0 );
+        }
+    } );
+
+    forEachStripe( [&]( auto &pass, auto *lines, int stripe ) {
+        const int y1 = std::min( ( stripe + 1 ) * stripeHeight, height );
+        for( int y = stripe * stripeHeight; y < y1; y++ ) {
+            errors[stripe].lines( y, lines );
+            pass( lines, y, 0, width, false );
+            errors[stripe].recycle( y );
+        }
+    } );
+    addWorkers( stats, times );
+}
+
+// Picks the serial, wavefront or striped schedule from \a options.
+template<typename Rows, typename MakePass>
+void diffuseRows( int width, int height, const Options &options, const MakePass &makePass )
+{
+    REZA_DITHER_ZONE( "dither::diffuse" );
+    Stats *stats = options.getStats();
+    const Stopwatch wall;
+    const size_t pixels = size_t( std::max( width, 0 ) ) * size_t( std::max( height, 0 ) );
+
+    if( options.getStripeHeight() > 0 ) {
+        const int stripeHeight = options.getStripeHeight();
+        diffuseStripes<Rows>( width, height, stripeHeight, std::max( options.getStripeSeedRows(), 0 ), options.getThreads(), stats, makePass );
+        if( stats ) {
+            addDither( stats, wall.seconds(), pixels, parallel::resolveThreads( options.getThreads(), ( height + stripeHeight - 1 ) / stripeHeight ) );
+        }
+        return;
+    }
+
+    const size_t threads = parallel::resolveThreads( options.getThreads(), height );
+    if( threads > 1 ) {
+        diffuseWavefront<Rows>( width, height, threads, stats, makePass );
+        if( stats ) {
+            addDither( stats, wall.seconds(), pixels, threads );
+        }
+    }
+    else {
+        diffuseSerial<Rows>( width, height, stats, makePass );
+        if( stats ) {
+            const double seconds = wall.seconds();
+            addDither( stats, seconds, pixels, 1 );
+            stats->busySeconds += seconds;
+        }
+    }
+}
+
+}
+}
+} // namespace reza::dither::detail
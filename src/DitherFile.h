@@ -0,0 +1,44 @@
+#pragma once
+
+// Writing the cache files of palette tables and blue-noise masks, which other threads
+// and processes may be reading or writing at the same time.
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <system_error>
+
+namespace reza {
+namespace dither {
+namespace detail {
+
+//! Writes \a path through \a write( file ) into a temporary file next to it, which is renamed over \a path once it
+//! is complete, so readers only ever see a whole file and concurrent writers can't interleave. Returns whether
+//! \a path was replaced.
+template<typename Write>
+bool replaceFile( const std::filesystem::path &path, const Write &write )
+{
+    std::random_device random;
+    std::filesystem::path temporary = path;
+    temporary += ".tmp" + std::to_string( random() ) + std::to_string( random() );
+
+    std::error_code error;
+    std::ofstream file( temporary.string(), std::ios::binary | std::ios::trunc );
+    write( file );
+    file.close();
+    if( ! file ) {
+        std::filesystem::remove( temporary, error );
+        return false;
+    }
+    std::filesystem::rename( temporary, path, error );
+    if( error ) {
+        std::filesystem::remove( temporary, error );
+        return false;
+    }
+    return true;
+}
+
+}
+}
+} // namespace reza::dither::detail
@@ -0,0 +1,286 @@
+#pragma once
+
+// Error diffusion kernels and the error line storage shared by the float and 8-bit
+// diffusion engines.
+
+#include "DitherCore.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+namespace reza {
+namespace dither {
+namespace detail {
+
+// One entry of an error diffusion kernel: the neighbour at ( x + dx, y + dy )
+// receives weight / divisor of the quantization error.
+struct Tap {
+    int dx;
+    int dy;
+    float weight;
+};
+
+//  linear (1/1)
+//      X   1
+struct LinearKernel {
+    static constexpr float divisor = 1.0f;
+    static constexpr std::array<Tap, 1> taps = { {
+        { 1, 0, 1.0f } } };
+};
+
+//  FloydSteinberg (1/16)
+//      X   7
+//  3   5   1
+struct FloydSteinbergKernel {
+    static constexpr float divisor = 16.0f;
+    static constexpr std::array<Tap, 4> taps = { {
+        { 1, 0, 7.0f },
+        { -1, 1, 3.0f }, { 0, 1, 5.0f }, { 1, 1, 1.0f } } };
+};
+
+// JarvisJudiceNinke (1/48)
+//          X   7   5
+//  3   5   7   5   3
+//  1   3   5   3   1
+struct JarvisJudiceNinkeKernel {
+    static constexpr float divisor = 48.0f;
+    static constexpr std::array<Tap, 12> taps = { {
+        { 1, 0, 7.0f }, { 2, 0, 5.0f },
+        { -2, 1, 3.0f }, { -1, 1, 5.0f }, { 0, 1, 7.0f }, { 1, 1, 5.0f }, { 2, 1, 3.0f },
+        { -2, 2, 1.0f }, { -1, 2, 3.0f }, { 0, 2, 5.0f }, { 1, 2, 3.0f }, { 2, 2, 1.0f } } };
+};
+
+//  Stucki (1/42)
+//          X   8   4
+//  2   4   8   4   2
+//  1   2   4   2   1
+struct StuckiKernel {
+    static constexpr float divisor = 42.0f;
+    static constexpr std::array<Tap, 12> taps = { {
+        { 1, 0, 8.0f }, { 2, 0, 4.0f },
+        { -2, 1, 2.0f }, { -1, 1, 4.0f }, { 0, 1, 8.0f }, { 1, 1, 4.0f }, { 2, 1, 2.0f },
+        { -2, 2, 1.0f }, { -1, 2, 2.0f }, { 0, 2, 4.0f }, { 1, 2, 2.0f }, { 2, 2, 1.0f } } };
+};
+
+//  Atkinson (1/8)
+//          X   1   1
+//      1   1   1
+//          1
+struct AtkinsonKernel {
+    static constexpr float divisor = 8.0f;
+    static constexpr std::array<Tap, 6> taps = { {
+        { 1, 0, 1.0f }, { 2, 0, 1.0f },
+        { -1, 1, 1.0f }, { 0, 1, 1.0f }, { 1, 1, 1.0f },
+        { 0, 2, 1.0f } } };
+};
+
+//  Burkes (1/32)
+//          X   8   4
+//  2   4   8   4   2
+struct BurkesKernel {
+    static constexpr float divisor = 32.0f;
+    static constexpr std::array<Tap, 7> taps = { {
+        { 1, 0, 8.0f }, { 2, 0, 4.0f },
+        { -2, 1, 2.0f }, { -1, 1, 4.0f }, { 0, 1, 8.0f }, { 1, 1, 4.0f }, { 2, 1, 2.0f } } };
+};
+
+//  Sierra (1/32)
+//          X   5   3
+//  2   4   5   4   2
+//      2   3   2
+struct SierraKernel {
+    static constexpr float divisor = 32.0f;
+    static constexpr std::array<Tap, 10> taps = { {
+        { 1, 0, 5.0f }, { 2, 0, 3.0f },
+        { -2, 1, 2.0f }, { -1, 1, 4.0f }, { 0, 1, 5.0f }, { 1, 1, 4.0f }, { 2, 1, 2.0f },
+        { -1, 2, 2.0f }, { 0, 2, 3.0f }, { 1, 2, 2.0f } } };
+};
+
+//  TwoRowSierra (1/16)
+//          X   4   3
+//  1   2   3   2   1
+struct TwoRowSierraKernel {
+    static constexpr float divisor = 16.0f;
+    static constexpr std::array<Tap, 7> taps = { {
+        { 1, 0, 4.0f }, { 2, 0, 3.0f },
+        { -2, 1, 1.0f }, { -1, 1, 2.0f }, { 0, 1, 3.0f }, { 1, 1, 2.0f }, { 2, 1, 1.0f } } };
+};
+
+//  SierraLite (1/4)
+//      X   2
+//  1   1
+struct SierraLiteKernel {
+    static constexpr float divisor = 4.0f;
+    static constexpr std::array<Tap, 3> taps = { {
+        { 1, 0, 2.0f },
+        { -1, 1, 1.0f }, { 0, 1, 1.0f } } };
+};
+
+// Number of rows a kernel touches, including the current one.
+template<typename Kernel>
+constexpr int kernelRows()
+{
+    int rows = 1;
+    for( const auto &tap : Kernel::taps ) {
+        rows = tap.dy + 1 > rows ? tap.dy + 1 : rows;
+    }
+    return rows;
+}
+
+// Furthest horizontal distance a kernel spreads error, in either direction.
+template<typename Kernel>
+constexpr int kernelReach()
+{
+    int reach = 0;
+    for( const auto &tap : Kernel::taps ) {
+        const int dx = tap.dx < 0 ? -tap.dx : tap.dx;
+        reach = dx > reach ? dx : reach;
+    }
+    return reach;
+}
+
+// Returns visit( K() ) for the kernel type K that \a kernel names.
+template<typename Visit>
+auto withKernel( Kernel kernel, const Visit &visit )
+{
+    switch( kernel ) {
+    case Kernel::Linear:
+        return visit( LinearKernel() );
+    case Kernel::FloydSteinberg:
+        return visit( FloydSteinbergKernel() );
+    case Kernel::JarvisJudiceNinke:
+        return visit( JarvisJudiceNinkeKernel() );
+    case Kernel::Stucki:
+        return visit( StuckiKernel() );
+    case Kernel::Atkinson:
+        return visit( AtkinsonKernel() );
+    case Kernel::Burkes:
+        return visit( BurkesKernel() );
+    case Kernel::Sierra:
+        return visit( SierraKernel() );
+    case Kernel::TwoRowSierra:
+        return visit( TwoRowSierraKernel() );
+    case Kernel::SierraLite:
+    default:
+        return visit( SierraLiteKernel() );
+    }
+}
+
+// Whether multiplying by 1 / divisor rounds exactly like dividing by it, which holds
+// for powers of two.
+constexpr bool hasExactReciprocal( float divisor )
+{
+    while( divisor > 1.0f ) {
+        divisor *= 0.5f;
+    }
+    return divisor == 1.0f;
+}
+
+
+// Ring of error lines, at least one per kernel row, each holding Channels values of T
+// per pixel. Lines are padded by the kernel's reach on both sides so taps that fall off
+// the image land in the padding instead of needing a bounds check. Taps below the last
+// row land in lines that are never read.
+template<typename Kernel, typename T = float, int Channels = 4>
+class ErrorRows {
+  public:
+    static constexpr int rows = kernelRows<Kernel>();
+    static constexpr int reach = kernelReach<Kernel>();
+    static constexpr int channels = Channels;
+    typedef T value_type;
+
+    ErrorRows( int width, int count = rows )
+        : mStride( ( width + 2 * reach ) * Channels ), mCount( count ), mLines( count * mStride )
+    {
+    }
+
+    //! Returns the error line for row \a y, indexed from x = -reach to width + reach - 1.
+    T *line( int y ) { return mLines.data() + ( y % mCount ) * mStride + reach * Channels; }
+
+    //! Clears the line of row \a y, which must not be in use by any other row.
+    void recycle( int y )
+    {
+        T *begin = mLines.data() + ( y % mCount ) * mStride;
+        std::fill( begin, begin + mStride, T( 0 ) );
+    }
+
+    //! Resizes the lines for rows of \a width pixels and clears them, reusing the storage when it is large enough.
+    void reset( int width )
+    {
+        mStride = ( width + 2 * reach ) * Channels;
+        mLines.assign( mCount * mStride, T( 0 ) );
+    }
+
+    //! Fills \a lines with the lines row \a y reads and writes.
+    void lines( int y, T **lines )
+    {
+        for( int i = 0; i < rows; i++ ) {
+            lines[i] = line( y + i );
+        }
+    }
+
+    //! Returns the bytes the lines take.
+    size_t bytes() const { return mLines.capacity() * sizeof( T ); }
+
+    //! Returns the number of values save() writes: every line row y reads or writes, padding included.
+    size_t stateSize() const { return size_t( rows ) * mStride; }
+
+    //! Copies the lines row \a y reads and writes to \a state, which holds stateSize() values.
+    void save( int y, T *state )
+    {
+        for( int i = 0; i < rows; i++ ) {
+            const T *begin = line( y + i ) - reach * Channels;
+            state = std::copy( begin, begin + mStride, state );
+        }
+    }
+
+    //! Restores the lines row \a y reads and writes from a save() made at the same width.
+    void restore( int y, const T *state )
+    {
+        for( int i = 0; i < rows; i++, state += mStride ) {
+            std::copy( state, state + mStride, line( y + i ) - reach * Channels );
+        }
+    }
+
+    //! Replaces each value of the lines row \a y reads and writes with the average of the values up to \a radius
+    //! pixels to either side, within the row. Rounds to the nearest integer for an integral T.
+    template<int radius>
+    void smooth( int y )
+    {
+        const int width = mStride / Channels - 2 * reach;
+        // the values of the last radius + 1 pixels, before they were replaced
+        std::array<T, radius + 1> previous;
+        for( int i = 0; i < rows; i++ ) {
+            T *values = line( y + i );
+            for( int c = 0; c < Channels; c++ ) {
+                double sum = 0.0;
+                for( int x = 0; x < std::min( radius, width - 1 ) + 1; x++ ) {
+                    sum += values[x * Channels + c];
+                }
+                for( int x = 0; x < width; x++ ) {
+                    const int count = std::min( x + radius, width - 1 ) - std::max( x - radius, 0 ) + 1;
+                    previous[x % ( radius + 1 )] = values[x * Channels + c];
+                    values[x * Channels + c] = std::is_integral<T>::value ? T( std::lround( sum / count ) ) : T( sum / count );
+                    if( x + radius + 1 < width ) {
+                        sum += values[( x + radius + 1 ) * Channels + c];
+                    }
+                    if( x - radius >= 0 ) {
+                        sum -= previous[( x - radius ) % ( radius + 1 )];
+                    }
+                }
+            }
+        }
+    }
+
+  private:
+    int mStride;
+    int mCount;
+    std::vector<T> mLines;
+};
+
+}
+}
+} // namespace reza::dither::detail
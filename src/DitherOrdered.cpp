@@ -0,0 +1,295 @@
+#include "DitherCore.h"
+#include "DitherBitmap.h"
+#include "DitherCommon.h"
+#include "DitherOrdered.h"
+#include "DitherPalette.h"
+#include "DitherParallel.h"
+#include "DitherStats.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <vector>
+
+namespace reza {
+namespace dither {
+
+namespace {
+    using namespace detail;
+
+    // Entry ( x, y ) of the N x N Bayer index matrix, built by the recursive construction
+    //  M2N = | 4 MN + 0   4 MN + 2 |
+    //        | 4 MN + 3   4 MN + 1 |
+    constexpr int bayerIndex( int n, int x, int y )
+    {
+        if( n == 1 ) {
+            return 0;
+        }
+        const int half = n / 2;
+        const int corner[2][2] = { { 0, 2 }, { 3, 1 } };
+        return 4 * bayerIndex( half, x % half, y % half ) + corner[y / half][x / half];
+    }
+
+    // Bayer thresholds in ( 0, 1 ), padded to the mask's row stride.
+    template<int N>
+    struct BayerMatrix {
+        static constexpr int stride = N < ThresholdMask::minStride ? ThresholdMask::minStride : N;
+        static constexpr std::array<float, stride * N> values = [] {
+            std::array<float, stride * N> values{};
+            for( int y = 0; y < N; y++ ) {
+                for( int x = 0; x < stride; x++ ) {
+                    values[y * stride + x] = ( bayerIndex( N, x % N, y ) + 0.5f ) / ( N * N );
+                }
+            }
+            return values;
+        }();
+
+        static ThresholdMask mask() { return ThresholdMask( values.data(), N, stride ); }
+    };
+
+    // Whether a pixel thresholds to white: r + g + b >= 3 * threshold, added in the order
+    // the SSE paths add. This is MonoQuantizer's nearest of white and black for the pixel
+    // biased by 0.5 - threshold, but exact, so every path splits ties the same way.
+    bool thresholdWhite( const Vec4 &source, float threshold )
+    {
+        float c[4];
+        source.store( c );
+        return ( c[0] + c[1] ) + c[2] >= 3.0f * threshold;
+    }
+
+#if defined( REZA_DITHER_SSE2 )
+    // Mono thresholding of packed RGBA rows, four pixels at a time, by thresholdWhite().
+    int thresholdMonoPacked( const float *in, float *out, const float *thresholds, int stride, int width )
+    {
+        const __m128 three = _mm_set1_ps( 3.0f );
+        const __m128 rgb = _mm_setr_ps( 1.0f, 1.0f, 1.0f, 0.0f );
+        const __m128 alpha = _mm_setr_ps( 0.0f, 0.0f, 0.0f, 1.0f );
+
+        int x = 0;
+        for( ; x + 4 <= width; x += 4, in += 16, out += 16 ) {
+            __m128 r = _mm_loadu_ps( in );
+            __m128 g = _mm_loadu_ps( in + 4 );
+            __m128 b = _mm_loadu_ps( in + 8 );
+            __m128 a = _mm_loadu_ps( in + 12 );
+            _MM_TRANSPOSE4_PS( r, g, b, a );
+            const __m128 sum = _mm_add_ps( _mm_add_ps( r, g ), b );
+            const __m128 t = _mm_loadu_ps( thresholds + ( x & ( stride - 1 ) ) );
+            const __m128 on = _mm_cmpge_ps( sum, _mm_mul_ps( three, t ) );
+
+            _mm_storeu_ps( out, _mm_or_ps( _mm_and_ps( _mm_shuffle_ps( on, on, _MM_SHUFFLE( 0, 0, 0, 0 ) ), rgb ), alpha ) );
+            _mm_storeu_ps( out + 4, _mm_or_ps( _mm_and_ps( _mm_shuffle_ps( on, on, _MM_SHUFFLE( 1, 1, 1, 1 ) ), rgb ), alpha ) );
+            _mm_storeu_ps( out + 8, _mm_or_ps( _mm_and_ps( _mm_shuffle_ps( on, on, _MM_SHUFFLE( 2, 2, 2, 2 ) ), rgb ), alpha ) );
+            _mm_storeu_ps( out + 12, _mm_or_ps( _mm_and_ps( _mm_shuffle_ps( on, on, _MM_SHUFFLE( 3, 3, 3, 3 ) ), rgb ), alpha ) );
+        }
+        return x;
+    }
+
+    // The black/white decisions of four packed RGBA pixels as bits 0 to 3.
+    int thresholdMonoBits( const float *in, const float *thresholds )
+    {
+        __m128 r = _mm_loadu_ps( in );
+        __m128 g = _mm_loadu_ps( in + 4 );
+        __m128 b = _mm_loadu_ps( in + 8 );
+        __m128 a = _mm_loadu_ps( in + 12 );
+        _MM_TRANSPOSE4_PS( r, g, b, a );
+        const __m128 sum = _mm_add_ps( _mm_add_ps( r, g ), b );
+        return _mm_movemask_ps( _mm_cmpge_ps( sum, _mm_mul_ps( _mm_set1_ps( 3.0f ), _mm_loadu_ps( thresholds ) ) ) );
+    }
+#endif
+
+    // Packs the thresholded pixels of row y into the bits of \a out, eight pixels at a
+    // time, straight from the SSE compares for packed input.
+    void thresholdBitsRow( const SurfaceView &src, uint8_t *out, const BitWriter &writer, const ThresholdMask &mask, int y, int width )
+    {
+        const float *thresholds = mask.row( y );
+        const int stride = mask.stride();
+        int x = 0;
+#if defined( REZA_DITHER_SSE2 )
+        if( src.isPacked() ) {
+            const float *in = src.row( y );
+            for( ; x + 8 <= width; x += 8, in += 32 ) {
+                const int low = thresholdMonoBits( in, thresholds + ( x & ( stride - 1 ) ) );
+                const int high = thresholdMonoBits( in + 16, thresholds + ( ( x + 4 ) & ( stride - 1 ) ) );
+                writer.store( out, x >> 3, static_cast<uint8_t>( low | ( high << 4 ) ), 0xff );
+            }
+        }
+#endif
+        const float *in = src.row( y ) + x * src.pixelInc();
+        uint8_t bits = 0, valid = 0;
+        for( ; x < width; x++, in += src.pixelInc() ) {
+            bits |= uint8_t( thresholdWhite( src.read( in ), thresholds[x & ( stride - 1 )] ) ) << ( x & 7 );
+            valid |= uint8_t( 1 << ( x & 7 ) );
+            if( ( x & 7 ) == 7 || x + 1 == width ) {
+                writer.store( out, x >> 3, bits, valid );
+                bits = valid = 0;
+            }
+        }
+    }
+
+    // Quantizes pixels [x0, width) of row y after biasing them by their threshold.
+    template<typename Quantizer>
+    void thresholdSpan( const SurfaceView &src, const SurfaceView &dst, const Quantizer &quantize, const AlphaOutput &alpha, const float *thresholds,
+        int stride, int y, int x0, int width )
+    {
+        const float *in = src.row( y ) + x0 * src.pixelInc();
+        float *out = dst.row( y ) + x0 * dst.pixelInc();
+        for( int x = x0; x < width; x++, in += src.pixelInc(), out += dst.pixelInc() ) {
+            const float bias = 0.5f - thresholds[x & ( stride - 1 )];
+            const Vec4 source = src.read( in );
+            dst.write( out, alpha( quantize( source + Vec4( bias, bias, bias, 0.0f ) ), source ) );
+        }
+    }
+
+    template<typename Quantizer>
+    void thresholdRow( const SurfaceView &src, const SurfaceView &dst, const Quantizer &quantize, const AlphaOutput &alpha, const ThresholdMask &mask, int y,
+        int width )
+    {
+        thresholdSpan( src, dst, quantize, alpha, mask.row( y ), mask.stride(), y, 0, width );
+    }
+
+    void thresholdRow( const SurfaceView &src, const SurfaceView &dst, const MonoQuantizer &, const AlphaOutput &alpha, const ThresholdMask &mask, int y,
+        int width )
+    {
+        const float *thresholds = mask.row( y );
+        const int stride = mask.stride();
+        int x = 0;
+#if defined( REZA_DITHER_SSE2 )
+        // the packed path writes opaque pixels only
+        if( src.isPacked() && dst.isPacked() && alpha.isOpaque() ) {
+            x = thresholdMonoPacked( src.row( y ), dst.row( y ), thresholds, stride, width );
+        }
+#endif
+        const float *in = src.row( y ) + x * src.pixelInc();
+        float *out = dst.row( y ) + x * dst.pixelInc();
+        for( ; x < width; x++, in += src.pixelInc(), out += dst.pixelInc() ) {
+            const Vec4 source = src.read( in );
+            dst.write( out, alpha( thresholdWhite( source, thresholds[x & ( stride - 1 )] ) ? whiteColor : blackColor, source ) );
+        }
+    }
+
+    // Returns visit( BayerMatrix<N>::mask() ) for \a size rounded up to a power of two N in [2, 16].
+    template<typename Visit>
+    void withBayer( int size, const Visit &visit )
+    {
+        if( size <= 2 ) {
+            visit( BayerMatrix<2>::mask() );
+        }
+        else if( size <= 4 ) {
+            visit( BayerMatrix<4>::mask() );
+        }
+        else if( size <= 8 ) {
+            visit( BayerMatrix<8>::mask() );
+        }
+        else {
+            visit( BayerMatrix<16>::mask() );
+        }
+    }
+}
+
+namespace detail {
+
+namespace {
+    // Calls \a row( y ) for every row below \a height. Rows are independent; workers take
+    // them in blocks to keep the counter cold.
+    template<typename Row>
+    void thresholdRows( int width, int height, const Options &options, const Row &row )
+    {
+        REZA_DITHER_ZONE( "dither::threshold" );
+        Stats *stats = options.getStats();
+        const Stopwatch wall;
+
+        const int block = 16;
+        const int blocks = ( height + block - 1 ) / block;
+        const size_t threads = parallel::resolveThreads( options.getThreads(), blocks );
+        std::atomic<int> nextBlock( 0 );
+        std::vector<WorkerTime> times( stats ? threads : 0 );
+
+        parallel::run( threads, [&]( size_t worker ) {
+            const Stopwatch busy;
+            for( int b = nextBlock++; b < blocks; b = nextBlock++ ) {
+                const int y1 = std::min( ( b + 1 ) * block, height );
+                for( int y = b * block; y < y1; y++ ) {
+                    row( y );
+                }
+            }
+            if( stats ) {
+                times[worker].busy = busy.seconds();
+            }
+        } );
+
+        if( stats ) {
+            addDither( stats, wall.seconds(), size_t( std::max( width, 0 ) ) * size_t( std::max( height, 0 ) ), threads );
+            addWorkers( stats, times );
+        }
+    }
+}
+
+template<typename Quantizer>
+void threshold( const ImageView32f &input, const ImageView32f &output, const ThresholdMask &mask, const Quantizer &quantize, const Options &options )
+{
+    const int width = std::min( input.getWidth(), output.getWidth() );
+    const int height = std::min( input.getHeight(), output.getHeight() );
+    const SurfaceView src( input );
+    const SurfaceView dst( output );
+    const AlphaOutput alpha( options );
+
+    thresholdRows( width, height, options, [&]( int y ) { thresholdRow( src, dst, quantize, alpha, mask, y, width ); } );
+}
+
+void threshold( const ImageView32f &input, Bitmap &output, const ThresholdMask &mask, const Options &options )
+{
+    const int width = std::min( input.getWidth(), output.getWidth() );
+    const int height = std::min( input.getHeight(), output.getHeight() );
+    const SurfaceView src( input );
+    const BitWriter writer( output.getFormat() );
+
+    thresholdRows( width, height, options, [&]( int y ) { thresholdBitsRow( src, output.getRow( y ), writer, mask, y, width ); } );
+}
+
+void threshold( const ImageView32f &input, IndexedImage &output, const ThresholdMask &mask, const Options &options )
+{
+    const int width = std::min( input.getWidth(), output.getWidth() );
+    const int height = std::min( input.getHeight(), output.getHeight() );
+    const SurfaceView src( input );
+
+    thresholdRows( width, height, options, [&]( int y ) {
+        const float *thresholds = mask.row( y );
+        const float *in = src.row( y );
+        uint8_t *out = output.getRow( y );
+        for( int x = 0; x < width; x++, in += src.pixelInc() ) {
+            const float bias = 0.5f - thresholds[x & ( mask.stride() - 1 )];
+            out[x] = static_cast<uint8_t>( RGBQuantizer::index( src.read( in ) + Vec4( bias, bias, bias, 0.0f ) ) );
+        }
+    } );
+    output.setPalette( rgbPalette() );
+}
+
+template void threshold( const ImageView32f &, const ImageView32f &, const ThresholdMask &, const MonoQuantizer &, const Options & );
+template void threshold( const ImageView32f &, const ImageView32f &, const ThresholdMask &, const RGBQuantizer &, const Options & );
+
+} // namespace detail
+
+void bayer( int size, const ImageView32f &input, const ImageView32f &output, bool rgb, const Options &options )
+{
+    withBayer( size, [&]( const ThresholdMask &mask ) {
+        if( rgb ) {
+            detail::threshold( input, output, mask, RGBQuantizer(), options );
+        }
+        else {
+            detail::threshold( input, output, mask, MonoQuantizer(), options );
+        }
+    } );
+}
+
+void bayer( int size, const ImageView32f &input, Bitmap &output, const Options &options )
+{
+    withBayer( size, [&]( const ThresholdMask &mask ) { detail::threshold( input, output, mask, options ); } );
+}
+
+void bayer( int size, const ImageView32f &input, IndexedImage &output, const Options &options )
+{
+    withBayer( size, [&]( const ThresholdMask &mask ) { detail::threshold( input, output, mask, options ); } );
+}
+
+}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "DitherCommon.h"
+
+namespace reza {
+namespace dither {
+namespace detail {
+
+// A square threshold matrix, a power of two in size, tiled over the image. Rows are
+// stored at least minStride wide by repeating the matrix, so SIMD loops can always read
+// four consecutive thresholds.
+class ThresholdMask {
+  public:
+    static constexpr int minStride = 4;
+
+    ThresholdMask( const float *values, int size, int stride )
+        : mValues( values ), mSize( size ), mStride( stride )
+    {
+    }
+
+    //! Returns the thresholds for image row \a y, to be indexed with x & ( stride() - 1 ).
+    const float *row( int y ) const { return mValues + ( y & ( mSize - 1 ) ) * mStride; }
+    int size() const { return mSize; }
+    int stride() const { return mStride; }
+
+  private:
+    const float *mValues;
+    int mSize;
+    int mStride;
+};
+
+//! Ordered dithering of \a input against \a mask into \a output, which may be \a input. Every pixel is independent,
+//! so rows are spread over Options::threads().
+template<typename Quantizer>
+void threshold( const ImageView32f &input, const ImageView32f &output, const ThresholdMask &mask, const Quantizer &quantize, const Options &options );
+
+//! Black-and-white ordered dithering of \a input against \a mask into the bits of \a output.
+void threshold( const ImageView32f &input, Bitmap &output, const ThresholdMask &mask, const Options &options );
+
+//! Ordered dithering of \a input against \a mask to red, green, blue and black, written as their indices into \a output.
+void threshold( const ImageView32f &input, IndexedImage &output, const ThresholdMask &mask, const Options &options );
+
+}
+}
+} // namespace reza::dither::detail
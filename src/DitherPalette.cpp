@@ -0,0 +1,262 @@
+#include "DitherCore.h"
+#include "DitherPalette.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+
+namespace reza {
+namespace dither {
+
+namespace detail {
+
+namespace {
+    // channel value of the leaf padding, far enough away never to be picked
+    const float kPadding = 1e30f;
+
+    float channel( const PaletteColor &color, int axis )
+    {
+        return axis == 0 ? color.r : axis == 1 ? color.g : color.b;
+    }
+
+#if defined( REZA_DITHER_SSE2 )
+    // The closest color seen so far in each of four lanes.
+    struct Closest {
+        __m128 distance = _mm_set1_ps( std::numeric_limits<float>::infinity() );
+        __m128i index = _mm_set1_epi32( std::numeric_limits<int>::max() );
+
+        //! Replaces the lanes that are closer, or as close with a lower index.
+        void update( const __m128 &d, const __m128i &i )
+        {
+            const __m128i closer = _mm_or_si128( _mm_castps_si128( _mm_cmplt_ps( d, distance ) ),
+                _mm_and_si128( _mm_castps_si128( _mm_cmpeq_ps( d, distance ) ), _mm_cmplt_epi32( i, index ) ) );
+            distance = _mm_min_ps( d, distance );
+            index = _mm_or_si128( _mm_and_si128( closer, i ), _mm_andnot_si128( closer, index ) );
+        }
+
+        float bound() const
+        {
+            __m128 m = _mm_min_ps( distance, _mm_shuffle_ps( distance, distance, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+            m = _mm_min_ps( m, _mm_shuffle_ps( m, m, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+            return _mm_cvtss_f32( m );
+        }
+
+        // Distances are never negative, so their bit patterns order like the values, and a
+        // key of ( distance, index ) picks the closest lane and then the lowest index
+        // without branching on the data.
+        int result() const
+        {
+            uint32_t distances[4], indices[4];
+            _mm_storeu_si128( reinterpret_cast<__m128i *>( distances ), _mm_castps_si128( distance ) );
+            _mm_storeu_si128( reinterpret_cast<__m128i *>( indices ), index );
+            uint64_t key = ( uint64_t( distances[0] ) << 32 ) | indices[0];
+            for( int lane = 1; lane < 4; lane++ ) {
+                key = std::min( key, ( uint64_t( distances[lane] ) << 32 ) | indices[lane] );
+            }
+            return static_cast<int>( key & 0xffffffff );
+        }
+    };
+#else
+    struct Closest {
+        float distance = std::numeric_limits<float>::infinity();
+        int index = std::numeric_limits<int>::max();
+
+        void update( float d, int i )
+        {
+            if( d < distance || ( d == distance && i < index ) ) {
+                distance = d;
+                index = i;
+            }
+        }
+
+        float bound() const { return distance; }
+        int result() const { return index; }
+    };
+#endif
+}
+
+PaletteSearch::PaletteSearch( const std::vector<PaletteColor> &colors )
+    : mColors( colors )
+{
+    std::vector<int> order( mColors.size() );
+    std::iota( order.begin(), order.end(), 0 );
+    build( order, 0, static_cast<int>( order.size() ) );
+}
+
+// Builds the subtree over order[begin, end), splitting at the median of the channel
+// with the widest spread, and appends its leaves' colors to the channel arrays, each
+// leaf padded to a multiple of four. Returns the subtree's node index.
+int PaletteSearch::build( std::vector<int> &order, int begin, int end )
+{
+    const int node = static_cast<int>( mNodes.size() );
+    mNodes.push_back( Node() );
+
+    if( end - begin <= leafSize ) {
+        Node &leaf = mNodes[node];
+        leaf.axis = -1;
+        leaf.begin = static_cast<int>( mIndices.size() );
+        for( int i = begin; i < end; i++ ) {
+            mRed.push_back( mColors[order[i]].r );
+            mGreen.push_back( mColors[order[i]].g );
+            mBlue.push_back( mColors[order[i]].b );
+            mIndices.push_back( order[i] );
+        }
+        while( mIndices.size() % 4 ) {
+            mRed.push_back( kPadding );
+            mGreen.push_back( kPadding );
+            mBlue.push_back( kPadding );
+            mIndices.push_back( std::numeric_limits<int>::max() );
+        }
+        leaf.end = static_cast<int>( mIndices.size() );
+        return node;
+    }
+
+    int axis = 0;
+    float widest = -1.0f;
+    for( int a = 0; a < 3; a++ ) {
+        float lo = std::numeric_limits<float>::max();
+        float hi = std::numeric_limits<float>::lowest();
+        for( int i = begin; i < end; i++ ) {
+            lo = std::min( lo, channel( mColors[order[i]], a ) );
+            hi = std::max( hi, channel( mColors[order[i]], a ) );
+        }
+        if( hi - lo > widest ) {
+            widest = hi - lo;
+            axis = a;
+        }
+    }
+
+    const int middle = begin + ( end - begin ) / 2;
+    std::nth_element( order.begin() + begin, order.begin() + middle, order.begin() + end, [&]( int a, int b ) {
+        return channel( mColors[a], axis ) < channel( mColors[b], axis );
+    } );
+
+    // read the split before the right subtree reorders its colors
+    const float split = channel( mColors[order[middle]], axis );
+    const int left = build( order, begin, middle );
+    const int right = build( order, middle, end );
+    Node &inner = mNodes[node];
+    inner.axis = axis;
+    inner.split = split;
+    inner.children[0] = left;
+    inner.children[1] = right;
+    return node;
+}
+
+// Depth-first nearest-neighbour search that visits the query's side of every split
+// first and skips the other side when the split plane alone is further away than the
+// best color so far. Cells exactly as far as the best are still visited, for the
+// lowest-index tie break. A palette of up to leafSize colors is a single leaf, which
+// makes this a plain scan.
+int PaletteSearch::nearest( float r, float g, float b ) const
+{
+    Closest closest;
+#if defined( REZA_DITHER_SSE2 )
+    const __m128 qr = _mm_set1_ps( r );
+    const __m128 qg = _mm_set1_ps( g );
+    const __m128 qb = _mm_set1_ps( b );
+    auto scan = [&]( const Node &leaf ) {
+        for( int i = leaf.begin; i < leaf.end; i += 4 ) {
+            const __m128 dr = _mm_sub_ps( _mm_loadu_ps( &mRed[i] ), qr );
+            const __m128 dg = _mm_sub_ps( _mm_loadu_ps( &mGreen[i] ), qg );
+            const __m128 db = _mm_sub_ps( _mm_loadu_ps( &mBlue[i] ), qb );
+            closest.update( _mm_add_ps( _mm_add_ps( _mm_mul_ps( dr, dr ), _mm_mul_ps( dg, dg ) ), _mm_mul_ps( db, db ) ),
+                _mm_loadu_si128( reinterpret_cast<const __m128i *>( &mIndices[i] ) ) );
+        }
+    };
+#else
+    auto scan = [&]( const Node &leaf ) {
+        for( int i = leaf.begin; i < leaf.end; i++ ) {
+            const float dr = mRed[i] - r;
+            const float dg = mGreen[i] - g;
+            const float db = mBlue[i] - b;
+            closest.update( ( dr * dr + dg * dg ) + db * db, mIndices[i] );
+        }
+    };
+#endif
+
+    if( mNodes[0].axis < 0 ) {
+        scan( mNodes[0] );
+    }
+    else {
+        struct Pending {
+            int node;
+            float distance;
+        };
+        // a median-split tree is at most 32 levels deep, and each level defers one node
+        Pending stack[64];
+        int depth = 0;
+        stack[depth++] = { 0, 0.0f };
+        const float query[3] = { r, g, b };
+
+        while( depth > 0 ) {
+            const Pending pending = stack[--depth];
+            if( pending.distance > closest.bound() ) {
+                continue;
+            }
+
+            const Node *node = &mNodes[pending.node];
+            while( node->axis >= 0 ) {
+                const float offset = query[node->axis] - node->split;
+                const int side = offset > 0.0f ? 1 : 0;
+                stack[depth++] = { node->children[1 - side], offset * offset };
+                node = &mNodes[node->children[side]];
+            }
+            scan( *node );
+        }
+    }
+
+    const int result = closest.result();
+    return result < static_cast<int>( mColors.size() ) ? result : 0;
+}
+
+const Palette &rgbPalette()
+{
+    static const Palette palette( { PaletteColor( 1.0f, 0.0f, 0.0f ), PaletteColor( 0.0f, 1.0f, 0.0f ), PaletteColor( 0.0f, 0.0f, 1.0f ), PaletteColor( 0.0f, 0.0f, 0.0f ) } );
+    return palette;
+}
+
+} // namespace detail
+
+Palette::Palette()
+    : mSearch( std::make_shared<detail::PaletteSearch>( std::vector<PaletteColor>() ) )
+{
+}
+
+Palette::Palette( const std::vector<PaletteColor> &colors )
+    : mSearch( std::make_shared<detail::PaletteSearch>( colors ) )
+{
+}
+
+const std::vector<PaletteColor> &Palette::getColors() const
+{
+    return mSearch->getColors();
+}
+
+size_t Palette::nearest( const PaletteColor &color ) const
+{
+    return static_cast<size_t>( mSearch->nearest( color.r, color.g, color.b ) );
+}
+
+IndexedImage::IndexedImage()
+    : mData( nullptr ), mWidth( 0 ), mHeight( 0 ), mRowBytes( 0 )
+{
+}
+
+IndexedImage::IndexedImage( int width, int height, int rowAlignment )
+    : mWidth( std::max( width, 0 ) ), mHeight( std::max( height, 0 ) )
+{
+    const size_t alignment = static_cast<size_t>( std::max( rowAlignment, 1 ) );
+    mRowBytes = ( static_cast<size_t>( mWidth ) + alignment - 1 ) / alignment * alignment;
+    mStorage = std::make_shared<std::vector<uint8_t>>( mRowBytes * mHeight );
+    mData = mStorage->data();
+}
+
+IndexedImage::IndexedImage( uint8_t *data, int width, int height, size_t rowBytes )
+    : mData( data ), mWidth( std::max( width, 0 ) ), mHeight( std::max( height, 0 ) ), mRowBytes( rowBytes )
+{
+}
+
+}
+}
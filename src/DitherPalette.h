@@ -0,0 +1,161 @@
+#pragma once
+
+// Nearest-color search over an arbitrary palette: a k-d tree whose leaves hold up to
+// leafSize colors as separate channel arrays, scanned four colors per SIMD step. A
+// palette that fits a single leaf is simply scanned in full; larger ones only visit the
+// few leaves near the query. Ties go to the lowest palette index, whatever the visiting
+// order.
+
+#include "DitherCommon.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+namespace reza {
+namespace dither {
+namespace detail {
+
+class PaletteSearch {
+  public:
+    //! The most colors per leaf. Palettes up to this size are searched by brute force.
+    static const int leafSize = 32;
+
+    explicit PaletteSearch( const std::vector<PaletteColor> &colors );
+
+    const std::vector<PaletteColor> &getColors() const { return mColors; }
+
+    //! Returns the index of the color closest to ( \a r, \a g, \a b ), or 0 for an empty palette.
+    int nearest( float r, float g, float b ) const;
+
+    int nearest( const Vec4 &color ) const
+    {
+        float rgba[4];
+        color.store( rgba );
+        return nearest( rgba[0], rgba[1], rgba[2] );
+    }
+
+  private:
+    struct Node {
+        //! 0, 1 or 2 for the r, g or b split of an inner node, -1 for a leaf.
+        int axis = -1;
+        float split = 0.0f;
+        //! Children of an inner node, the first holding the colors at or below the split.
+        int children[2] = { -1, -1 };
+        //! Range of a leaf's colors in the channel arrays.
+        int begin = 0, end = 0;
+    };
+
+    int build( std::vector<int> &order, int begin, int end );
+
+    std::vector<PaletteColor> mColors;
+    // leaf colors as separate channels, in tree order
+    std::vector<float> mRed, mGreen, mBlue;
+    // palette index of every entry of the channel arrays
+    std::vector<int> mIndices;
+    std::vector<Node> mNodes;
+};
+
+// A resolution^3 grid over [minValue, maxValue]^3 that answers nearest-color queries
+// with a single fetch for most colors. Each cell stores either the one palette color
+// that can be nearest anywhere in it, or a short list of the candidates whose regions
+// reach into it, which are then compared exactly. Queries outside the grid fall back to
+// the full search. Either way the answer is the one PaletteSearch gives.
+class PaletteTable {
+  public:
+    //! The grid covers the colors error diffusion usually accumulates, not just [0, 1].
+    static constexpr float minValue = -0.5f;
+    static constexpr float maxValue = 1.5f;
+
+    //! Builds the table for \a colors, a power-of-two \a resolution cells per side, on up to \a threads threads.
+    PaletteTable( const std::vector<PaletteColor> &colors, int resolution, size_t threads );
+
+    //! Reads a table saved by save(), returning null unless it was built for \a colors at \a resolution and every
+    //! cell refers to a color or candidate list that exists.
+    static std::shared_ptr<const PaletteTable> load( const std::filesystem::path &path, const std::vector<PaletteColor> &colors, int resolution );
+    //! Writes the table to \a path, replacing the file as a whole.
+    void save( const std::filesystem::path &path ) const;
+
+    int getResolution() const { return mResolution; }
+    const std::vector<PaletteColor> &getColors() const { return mSearch.getColors(); }
+
+    int nearest( float r, float g, float b ) const
+    {
+        const float x = ( r - minValue ) * mScale;
+        const float y = ( g - minValue ) * mScale;
+        const float z = ( b - minValue ) * mScale;
+        // written so that NaN takes the fallback too
+        if( ! ( x >= 0.0f && x < mLimit && y >= 0.0f && y < mLimit && z >= 0.0f && z < mLimit ) ) {
+            return mSearch.nearest( r, g, b );
+        }
+        const uint32_t cell = mCells[( static_cast<int>( x ) * mResolution + static_cast<int>( y ) ) * mResolution + static_cast<int>( z )];
+        if( ! ( cell & listFlag ) ) {
+            return static_cast<int>( cell );
+        }
+        return nearestCandidate( &mCandidates[cell & ~listFlag], r, g, b );
+    }
+
+    int nearest( const Vec4 &color ) const
+    {
+        float rgba[4];
+        color.store( rgba );
+        return nearest( rgba[0], rgba[1], rgba[2] );
+    }
+
+  private:
+    // marks a cell holding an offset into mCandidates rather than a palette index
+    static const uint32_t listFlag = 0x80000000u;
+
+    PaletteTable( const std::vector<PaletteColor> &colors, int resolution );
+
+    int nearestCandidate( const uint32_t *list, float r, float g, float b ) const;
+    //! Whether every cell holds a palette index or the offset of a non-empty list of palette indices that fits in
+    //! mCandidates.
+    bool isValid() const;
+
+    PaletteSearch mSearch;
+    int mResolution;
+    float mScale;
+    float mLimit;
+    std::vector<uint32_t> mCells;
+    // candidate lists, each a count followed by that many palette indices
+    std::vector<uint32_t> mCandidates;
+};
+
+//! Returns the palette of the indexed *RGB functions, in RGBQuantizer's index order.
+const Palette &rgbPalette();
+
+//! Returns the table for \a colors at \a resolution, building it at most once per process and, with a cache
+//! directory set, at most once per machine. Only callers asking for the same table wait while it is made.
+std::shared_ptr<const PaletteTable> paletteTable( const std::vector<PaletteColor> &colors, int resolution, size_t threads );
+
+// Picks the palette color closest to the accumulated color, through a PaletteTable when
+// one is given. An empty palette maps everything to black.
+class PaletteQuantizer {
+  public:
+    explicit PaletteQuantizer( const PaletteSearch &search, std::shared_ptr<const PaletteTable> table = nullptr )
+        : mSearch( &search ), mTable( table )
+    {
+        for( const auto &color : search.getColors() ) {
+            mColors.push_back( Vec4( color.r, color.g, color.b, 1.0f ) );
+        }
+        if( mColors.empty() ) {
+            mColors.push_back( blackColor );
+        }
+    }
+
+    Vec4 operator()( const Vec4 &total ) const { return mColors[index( total )]; }
+
+    int index( const Vec4 &total ) const { return mTable ? mTable->nearest( total ) : mSearch->nearest( total ); }
+    const Vec4 &color( int index ) const { return mColors[index]; }
+
+  private:
+    const PaletteSearch *mSearch;
+    std::shared_ptr<const PaletteTable> mTable;
+    std::vector<Vec4> mColors;
+};
+
+}
+}
+} // namespace reza::dither::detail
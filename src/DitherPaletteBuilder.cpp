@@ -0,0 +1,296 @@
+#include "DitherCore.h"
+#include "DitherCommon.h"
+#include "DitherPalette.h"
+#include "DitherParallel.h"
+#include "DitherStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace reza {
+namespace dither {
+
+namespace {
+    using namespace detail;
+
+    // 5 bits per channel
+    const int kBinBits = 5;
+    const int kBins = 1 << ( 3 * kBinBits );
+    const int kBinShift = 8 - kBinBits;
+
+    // k-means work is cut into this many chunks whatever the thread count, and their sums
+    // are added in chunk order, so the palette does not depend on the threads used
+    const size_t kChunks = 64;
+
+    // k-means stops once no color moves by more than a quarter of an 8-bit level
+    const double kSettled = ( 0.25 / 255.0 ) * ( 0.25 / 255.0 );
+
+    // Sums of the 8-bit pixel values that fell into one histogram bin.
+    struct BinSum {
+        uint64_t count = 0;
+        uint64_t r = 0, g = 0, b = 0;
+    };
+
+    // A non-empty histogram bin: the mean color of its pixels and how many there were.
+    struct Bin {
+        float c[3];
+        double weight;
+    };
+
+    uint8_t level( float value )
+    {
+        // written so that NaN maps to 0
+        if( ! ( value > 0.0f ) ) {
+            return 0;
+        }
+        return value >= 1.0f ? 255 : static_cast<uint8_t>( value * 255.0f + 0.5f );
+    }
+
+    void add( BinSum *histogram, uint8_t r, uint8_t g, uint8_t b )
+    {
+        BinSum &bin = histogram[( ( r >> kBinShift ) << ( 2 * kBinBits ) ) | ( ( g >> kBinShift ) << kBinBits ) | ( b >> kBinShift )];
+        bin.count++;
+        bin.r += r;
+        bin.g += g;
+        bin.b += b;
+    }
+
+    // Histograms the pixels on an even grid of at most \a samples points, each thread into
+    // its own histogram over a run of the sampled rows. The counts are integers, so the
+    // merged histogram is the same for any thread count. \a read( x, y, rgb ) fetches a
+    // pixel as 8-bit levels.
+    template<typename Read>
+    std::vector<Bin> histogram( int width, int height, size_t samples, size_t threads, const Read &read )
+    {
+        std::vector<Bin> bins;
+        if( width <= 0 || height <= 0 ) {
+            return bins;
+        }
+
+        const double pixels = double( width ) * double( height );
+        const int step = std::max( 1, static_cast<int>( std::ceil( std::sqrt( pixels / double( std::max<size_t>( samples, 1 ) ) ) ) ) );
+        const int rows = ( height + step - 1 ) / step;
+        const int columns = ( width + step - 1 ) / step;
+        // centre the grid, so a preview of a small image still covers it evenly
+        const int y0 = ( height - 1 - ( rows - 1 ) * step ) / 2;
+        const int x0 = ( width - 1 - ( columns - 1 ) * step ) / 2;
+
+        const size_t count = parallel::resolveThreads( threads, static_cast<size_t>( rows ) );
+        std::vector<std::vector<BinSum>> partial( count, std::vector<BinSum>( kBins ) );
+        parallel::run( count, [&]( size_t index ) {
+            BinSum *sums = partial[index].data();
+            const int begin = static_cast<int>( rows * index / count );
+            const int end = static_cast<int>( rows * ( index + 1 ) / count );
+            uint8_t rgb[3];
+            for( int row = begin; row < end; row++ ) {
+                const int y = y0 + row * step;
+                for( int x = x0; x < width; x += step ) {
+                    read( x, y, rgb );
+                    add( sums, rgb[0], rgb[1], rgb[2] );
+                }
+            }
+        } );
+
+        for( int i = 0; i < kBins; i++ ) {
+            BinSum sum;
+            for( const auto &sums : partial ) {
+                sum.count += sums[i].count;
+                sum.r += sums[i].r;
+                sum.g += sums[i].g;
+                sum.b += sums[i].b;
+            }
+            if( sum.count ) {
+                const double scale = 1.0 / ( 255.0 * double( sum.count ) );
+                Bin bin;
+                bin.c[0] = static_cast<float>( double( sum.r ) * scale );
+                bin.c[1] = static_cast<float>( double( sum.g ) * scale );
+                bin.c[2] = static_cast<float>( double( sum.b ) * scale );
+                bin.weight = double( sum.count );
+                bins.push_back( bin );
+            }
+        }
+        return bins;
+    }
+
+    // A run of bins, split along the channel where its squared error is largest.
+    struct Box {
+        int begin, end;
+        double weight;
+        double mean[3];
+        int axis;
+        double error;
+    };
+
+    Box makeBox( const std::vector<Bin> &bins, int begin, int end )
+    {
+        Box box = { begin, end, 0.0, { 0.0, 0.0, 0.0 }, 0, 0.0 };
+        for( int i = begin; i < end; i++ ) {
+            box.weight += bins[i].weight;
+            for( int a = 0; a < 3; a++ ) {
+                box.mean[a] += bins[i].weight * bins[i].c[a];
+            }
+        }
+        for( int a = 0; a < 3; a++ ) {
+            box.mean[a] /= box.weight;
+        }
+        for( int a = 0; a < 3; a++ ) {
+            double error = 0.0;
+            for( int i = begin; i < end; i++ ) {
+                const double d = bins[i].c[a] - box.mean[a];
+                error += bins[i].weight * d * d;
+            }
+            if( error > box.error ) {
+                box.error = error;
+                box.axis = a;
+            }
+        }
+        // a single bin cannot be split further
+        if( end - begin < 2 ) {
+            box.error = 0.0;
+        }
+        return box;
+    }
+
+    // Median cut: keeps splitting the box with the largest squared error at the weighted
+    // median of its widest channel until there are \a colors boxes or none can be split.
+    std::vector<Box> medianCut( std::vector<Bin> &bins, int colors )
+    {
+        std::vector<Box> boxes;
+        boxes.push_back( makeBox( bins, 0, static_cast<int>( bins.size() ) ) );
+        while( static_cast<int>( boxes.size() ) < colors ) {
+            auto worst = std::max_element( boxes.begin(), boxes.end(), []( const Box &a, const Box &b ) { return a.error < b.error; } );
+            if( worst->error <= 0.0 ) {
+                break;
+            }
+
+            const Box box = *worst;
+            const int axis = box.axis;
+            // stable, so equal keys keep the histogram order and the result stays deterministic
+            std::stable_sort( bins.begin() + box.begin, bins.begin() + box.end, [axis]( const Bin &a, const Bin &b ) { return a.c[axis] < b.c[axis]; } );
+
+            int middle = box.begin + 1;
+            double below = bins[box.begin].weight;
+            while( middle < box.end - 1 && below + bins[middle].weight <= box.weight * 0.5 ) {
+                below += bins[middle].weight;
+                middle++;
+            }
+
+            *worst = makeBox( bins, box.begin, middle );
+            boxes.push_back( makeBox( bins, middle, box.end ) );
+        }
+        return boxes;
+    }
+
+    // Lloyd's k-means over the weighted bins, starting from \a colors. Each pass assigns
+    // every bin to its nearest color through a PaletteSearch and moves each color to the
+    // mean of its bins. Colors that lose all their bins stay where they are.
+    void refine( const std::vector<Bin> &bins, std::vector<PaletteColor> &colors, int iterations, size_t threads )
+    {
+        if( bins.empty() || colors.empty() ) {
+            return;
+        }
+
+        const size_t k = colors.size();
+        const size_t chunks = std::min( kChunks, bins.size() );
+        // weighted r, g, b sums and the weight of every color, per chunk
+        std::vector<double> sums( chunks * k * 4 );
+        const size_t count = parallel::resolveThreads( threads, chunks );
+
+        for( int iteration = 0; iteration < iterations; iteration++ ) {
+            const PaletteSearch search( colors );
+            std::fill( sums.begin(), sums.end(), 0.0 );
+            parallel::run( count, [&]( size_t index ) {
+                for( size_t chunk = index; chunk < chunks; chunk += count ) {
+                    double *sum = &sums[chunk * k * 4];
+                    const size_t begin = bins.size() * chunk / chunks;
+                    const size_t end = bins.size() * ( chunk + 1 ) / chunks;
+                    for( size_t i = begin; i < end; i++ ) {
+                        const Bin &bin = bins[i];
+                        double *s = sum + 4 * search.nearest( bin.c[0], bin.c[1], bin.c[2] );
+                        s[0] += bin.weight * bin.c[0];
+                        s[1] += bin.weight * bin.c[1];
+                        s[2] += bin.weight * bin.c[2];
+                        s[3] += bin.weight;
+                    }
+                }
+            } );
+
+            double moved = 0.0;
+            for( size_t c = 0; c < k; c++ ) {
+                double total[4] = { 0.0, 0.0, 0.0, 0.0 };
+                for( size_t chunk = 0; chunk < chunks; chunk++ ) {
+                    const double *s = &sums[( chunk * k + c ) * 4];
+                    for( int a = 0; a < 4; a++ ) {
+                        total[a] += s[a];
+                    }
+                }
+                if( total[3] <= 0.0 ) {
+                    continue;
+                }
+                const PaletteColor next( static_cast<float>( total[0] / total[3] ), static_cast<float>( total[1] / total[3] ),
+                    static_cast<float>( total[2] / total[3] ) );
+                const double dr = next.r - colors[c].r;
+                const double dg = next.g - colors[c].g;
+                const double db = next.b - colors[c].b;
+                moved = std::max( moved, dr * dr + dg * dg + db * db );
+                colors[c] = next;
+            }
+            if( moved <= kSettled ) {
+                break;
+            }
+        }
+    }
+
+    Palette build( std::vector<Bin> bins, int colors, const Options &options )
+    {
+        std::vector<PaletteColor> palette;
+        if( bins.empty() || colors <= 0 ) {
+            return Palette( palette );
+        }
+
+        for( const auto &box : medianCut( bins, colors ) ) {
+            palette.push_back( PaletteColor( static_cast<float>( box.mean[0] ), static_cast<float>( box.mean[1] ), static_cast<float>( box.mean[2] ) ) );
+        }
+        refine( bins, palette, options.getPaletteIterations(), options.getThreads() );
+        return Palette( palette );
+    }
+}
+
+Palette buildPalette( const ImageView32f &input, int colors, const Options &options )
+{
+    REZA_DITHER_ZONE( "dither::buildPalette" );
+    return setup( options.getStats(), [&] {
+        const SurfaceView view( input );
+        auto bins = histogram( input.getWidth(), input.getHeight(), options.getPaletteSamples(), options.getThreads(),
+            [&]( int x, int y, uint8_t *rgb ) {
+                float rgba[4];
+                view.read( view.row( y ) + x * view.pixelInc() ).store( rgba );
+                rgb[0] = level( rgba[0] );
+                rgb[1] = level( rgba[1] );
+                rgb[2] = level( rgba[2] );
+            } );
+        return build( std::move( bins ), colors, options );
+    } );
+}
+
+Palette buildPalette( const ImageView8u &input, int colors, const Options &options )
+{
+    REZA_DITHER_ZONE( "dither::buildPalette" );
+    return setup( options.getStats(), [&] {
+        const SurfaceView8u view( input );
+        auto bins = histogram( input.getWidth(), input.getHeight(), options.getPaletteSamples(), options.getThreads(),
+            [&]( int x, int y, uint8_t *rgb ) {
+                const uint8_t *pixel = view.row( y ) + x * view.pixelInc();
+                rgb[0] = pixel[view.red()];
+                rgb[1] = pixel[view.green()];
+                rgb[2] = pixel[view.blue()];
+            } );
+        return build( std::move( bins ), colors, options );
+    } );
+}
+
+}
+}
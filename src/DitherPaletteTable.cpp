@@ -0,0 +1,384 @@
+#include "DitherCore.h"
+#include "DitherFile.h"
+#include "DitherPalette.h"
+#include "DitherParallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <numeric>
+
+namespace reza {
+namespace dither {
+
+namespace {
+    using namespace detail;
+    namespace fs = std::filesystem;
+
+    const uint32_t kTableFileMagic = 0x54505244; // "DRPT"
+    const uint32_t kTableFileVersion = 1;
+
+    // widening of every cell, in color units, that covers queries rounded into a
+    // neighbouring cell
+    const double kCellMargin = 1e-5;
+    // slack on the candidate test that covers the float rounding of the distances the
+    // query compares
+    const double kDistanceSlack = 1e-5;
+
+    // A palette and resolution's table, set once by whichever caller first asks for it.
+    struct TableEntry {
+        explicit TableEntry( const std::vector<PaletteColor> &colors )
+            : colors( colors )
+        {
+        }
+
+        const std::vector<PaletteColor> colors;
+        std::once_flag once;
+        std::shared_ptr<const PaletteTable> table;
+    };
+
+    // guards the map and the directory; an entry is only replaced by a colliding palette, and callers hold on to
+    // the entry they found
+    std::mutex sTableMutex;
+    std::map<std::pair<uint64_t, int>, std::shared_ptr<TableEntry>> sTables;
+    fs::path sCacheDirectory;
+
+    struct Box {
+        double lo[3], hi[3];
+    };
+
+    double channel( const PaletteColor &color, int axis )
+    {
+        return axis == 0 ? color.r : axis == 1 ? color.g : color.b;
+    }
+
+    double minDistance2( const Box &box, const PaletteColor &color )
+    {
+        double sum = 0.0;
+        for( int a = 0; a < 3; a++ ) {
+            const double v = channel( color, a );
+            const double d = v < box.lo[a] ? box.lo[a] - v : v > box.hi[a] ? v - box.hi[a] : 0.0;
+            sum += d * d;
+        }
+        return sum;
+    }
+
+    double maxDistance2( const Box &box, const PaletteColor &color )
+    {
+        double sum = 0.0;
+        for( int a = 0; a < 3; a++ ) {
+            const double v = channel( color, a );
+            const double d = std::max( v - box.lo[a], box.hi[a] - v );
+            sum += d * d;
+        }
+        return sum;
+    }
+
+    // The largest value of |x - a|^2 - |x - b|^2 over \a box. The difference is linear in
+    // x, so it peaks at a corner.
+    double maxDifference( const Box &box, const PaletteColor &a, const PaletteColor &b )
+    {
+        double sum = 0.0;
+        for( int axis = 0; axis < 3; axis++ ) {
+            const double ca = channel( a, axis );
+            const double cb = channel( b, axis );
+            const double x = ca > cb ? box.lo[axis] : box.hi[axis];
+            sum += ( ca * ca - cb * cb ) - 2.0 * x * ( ca - cb );
+        }
+        return sum;
+    }
+
+    // Keeps the colors of \a from that can be the nearest one somewhere in \a box. A color
+    // is dropped when no point of the box is closer to it than the furthest point is to
+    // some other color, or when another color is closer everywhere in the box.
+    void narrow( const std::vector<PaletteColor> &colors, const Box &box, const std::vector<uint32_t> &from, std::vector<uint32_t> *to )
+    {
+        double bound = std::numeric_limits<double>::infinity();
+        for( uint32_t i : from ) {
+            bound = std::min( bound, maxDistance2( box, colors[i] ) );
+        }
+        std::vector<uint32_t> reachable;
+        for( uint32_t i : from ) {
+            if( minDistance2( box, colors[i] ) <= bound + kDistanceSlack ) {
+                reachable.push_back( i );
+            }
+        }
+
+        to->clear();
+        for( uint32_t j : reachable ) {
+            const bool dominated = std::any_of( reachable.begin(), reachable.end(), [&]( uint32_t i ) {
+                return maxDifference( box, colors[i], colors[j] ) < -kDistanceSlack;
+            } );
+            if( ! dominated ) {
+                to->push_back( j );
+            }
+        }
+    }
+
+    // FNV-1a over the colors' bits.
+    uint64_t paletteHash( const std::vector<PaletteColor> &colors )
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for( const auto &color : colors ) {
+            const float channels[3] = { color.r, color.g, color.b };
+            const unsigned char *bytes = reinterpret_cast<const unsigned char *>( channels );
+            for( size_t i = 0; i < sizeof( channels ); i++ ) {
+                hash = ( hash ^ bytes[i] ) * 0x100000001b3ull;
+            }
+        }
+        return hash;
+    }
+
+    bool sameColors( const std::vector<PaletteColor> &a, const std::vector<PaletteColor> &b )
+    {
+        return a.size() == b.size() && std::equal( a.begin(), a.end(), b.begin(), []( const PaletteColor &x, const PaletteColor &y ) {
+            return x.r == y.r && x.g == y.g && x.b == y.b;
+        } );
+    }
+
+    fs::path tablePath( const fs::path &directory, uint64_t hash, int resolution )
+    {
+        char name[64];
+        std::snprintf( name, sizeof( name ), "palette-%016llx-%d.bin", static_cast<unsigned long long>( hash ), resolution );
+        return directory / name;
+    }
+}
+
+namespace detail {
+
+PaletteTable::PaletteTable( const std::vector<PaletteColor> &colors, int resolution )
+    : mSearch( colors ), mResolution( resolution ), mScale( resolution / ( maxValue - minValue ) ), mLimit( static_cast<float>( resolution ) ),
+      mCells( size_t( resolution ) * resolution * resolution, 0 )
+{
+}
+
+// Cells are filled top-down, octree style: a block whose candidates narrow down to one
+// color is filled with it, otherwise it is split in eight with the narrowed candidates,
+// so most of the palette is discarded after the first few levels. The grid is cut into
+// blocks that are built concurrently, each collecting its own candidate lists, which
+// are then joined.
+PaletteTable::PaletteTable( const std::vector<PaletteColor> &colors, int resolution, size_t threads )
+    : PaletteTable( colors, resolution )
+{
+    const double cellSize = double( maxValue - minValue ) / resolution;
+    const int block = std::max( resolution / 8, 1 );
+    const int blocksPerSide = resolution / block;
+    const int blockCount = blocksPerSide * blocksPerSide * blocksPerSide;
+
+    std::vector<uint32_t> all( colors.size() );
+    std::iota( all.begin(), all.end(), 0 );
+    std::vector<std::vector<uint32_t>> lists( blockCount );
+
+    auto cellIndex = [&]( int x, int y, int z ) { return ( size_t( x ) * resolution + y ) * resolution + z; };
+    auto forEachCell = [&]( int x0, int y0, int z0, int size, auto &&function ) {
+        for( int x = x0; x < x0 + size; x++ ) {
+            for( int y = y0; y < y0 + size; y++ ) {
+                for( int z = z0; z < z0 + size; z++ ) {
+                    function( mCells[cellIndex( x, y, z )] );
+                }
+            }
+        }
+    };
+
+    auto fill = [&]( auto &&self, int x0, int y0, int z0, int size, const std::vector<uint32_t> &from, std::vector<uint32_t> *list ) -> void {
+        Box box;
+        const int origin[3] = { x0, y0, z0 };
+        for( int a = 0; a < 3; a++ ) {
+            box.lo[a] = minValue + origin[a] * cellSize - kCellMargin;
+            box.hi[a] = minValue + ( origin[a] + size ) * cellSize + kCellMargin;
+        }
+        std::vector<uint32_t> candidates;
+        narrow( colors, box, from, &candidates );
+
+        if( candidates.size() == 1 ) {
+            forEachCell( x0, y0, z0, size, [&]( uint32_t &cell ) { cell = candidates[0]; } );
+        }
+        else if( size == 1 ) {
+            mCells[cellIndex( x0, y0, z0 )] = listFlag | static_cast<uint32_t>( list->size() );
+            list->push_back( static_cast<uint32_t>( candidates.size() ) );
+            list->insert( list->end(), candidates.begin(), candidates.end() );
+        }
+        else {
+            const int half = size / 2;
+            for( int i = 0; i < 8; i++ ) {
+                self( self, x0 + ( i & 1 ) * half, y0 + ( ( i >> 1 ) & 1 ) * half, z0 + ( i >> 2 ) * half, half, candidates, list );
+            }
+        }
+    };
+
+    auto blockOrigin = [&]( int b, int *x, int *y, int *z ) {
+        *x = ( b / ( blocksPerSide * blocksPerSide ) ) * block;
+        *y = ( ( b / blocksPerSide ) % blocksPerSide ) * block;
+        *z = ( b % blocksPerSide ) * block;
+    };
+
+    std::atomic<int> nextBlock( 0 );
+    parallel::run( parallel::resolveThreads( threads, blockCount ), [&]( size_t ) {
+        for( int b = nextBlock++; b < blockCount; b = nextBlock++ ) {
+            int x, y, z;
+            blockOrigin( b, &x, &y, &z );
+            fill( fill, x, y, z, block, all, &lists[b] );
+        }
+    } );
+
+    // join the lists, moving every block's offsets past the lists before it
+    for( int b = 0; b < blockCount; b++ ) {
+        const uint32_t base = static_cast<uint32_t>( mCandidates.size() );
+        int x, y, z;
+        blockOrigin( b, &x, &y, &z );
+        forEachCell( x, y, z, block, [&]( uint32_t &cell ) {
+            if( cell & listFlag ) {
+                cell += base;
+            }
+        } );
+        mCandidates.insert( mCandidates.end(), lists[b].begin(), lists[b].end() );
+    }
+}
+
+int PaletteTable::nearestCandidate( const uint32_t *list, float r, float g, float b ) const
+{
+    // Distances are never negative, so their bit patterns order like the values, and a
+    // key of ( distance, index ) picks the closest candidate and then the lowest index
+    // without branching on the data.
+    const std::vector<PaletteColor> &colors = mSearch.getColors();
+    uint64_t closest = std::numeric_limits<uint64_t>::max();
+    for( uint32_t i = 1; i <= list[0]; i++ ) {
+        const PaletteColor &color = colors[list[i]];
+        const float dr = color.r - r;
+        const float dg = color.g - g;
+        const float db = color.b - b;
+        const float distance = ( dr * dr + dg * dg ) + db * db;
+        uint32_t bits;
+        std::memcpy( &bits, &distance, sizeof( bits ) );
+        closest = std::min( closest, ( uint64_t( bits ) << 32 ) | list[i] );
+    }
+    return static_cast<int>( closest & 0xffffffff );
+}
+
+std::shared_ptr<const PaletteTable> PaletteTable::load( const std::filesystem::path &path, const std::vector<PaletteColor> &colors, int resolution )
+{
+    std::ifstream file( path.string(), std::ios::binary );
+    uint32_t header[5] = { 0, 0, 0, 0, 0 };
+    if( ! file.read( reinterpret_cast<char *>( header ), sizeof( header ) ) || header[0] != kTableFileMagic || header[1] != kTableFileVersion
+        || header[2] != uint32_t( resolution ) || header[3] != colors.size() ) {
+        return nullptr;
+    }
+
+    std::vector<float> stored( colors.size() * 3 );
+    if( ! file.read( reinterpret_cast<char *>( stored.data() ), stored.size() * sizeof( float ) ) ) {
+        return nullptr;
+    }
+    for( size_t i = 0; i < colors.size(); i++ ) {
+        if( stored[i * 3] != colors[i].r || stored[i * 3 + 1] != colors[i].g || stored[i * 3 + 2] != colors[i].b ) {
+            return nullptr;
+        }
+    }
+
+    // the cells and candidate lists must be all that is left, which also bounds the
+    // candidate count before anything is allocated for it
+    std::shared_ptr<PaletteTable> table( new PaletteTable( colors, resolution ) );
+    const std::streamoff start = file.tellg();
+    file.seekg( 0, std::ios::end );
+    const std::streamoff size = file.tellg();
+    file.seekg( start );
+    const uint64_t expected = ( uint64_t( table->mCells.size() ) + header[4] ) * sizeof( uint32_t );
+    if( start < 0 || size < start || uint64_t( size - start ) != expected ) {
+        return nullptr;
+    }
+
+    table->mCandidates.resize( header[4] );
+    if( ! file.read( reinterpret_cast<char *>( table->mCells.data() ), table->mCells.size() * sizeof( uint32_t ) )
+        || ! file.read( reinterpret_cast<char *>( table->mCandidates.data() ), table->mCandidates.size() * sizeof( uint32_t ) ) || ! table->isValid() ) {
+        return nullptr;
+    }
+    return table;
+}
+
+void PaletteTable::save( const std::filesystem::path &path ) const
+{
+    const std::vector<PaletteColor> &colors = getColors();
+    replaceFile( path, [&]( std::ofstream &file ) {
+        const uint32_t header[5] = { kTableFileMagic, kTableFileVersion, uint32_t( mResolution ), uint32_t( colors.size() ), uint32_t( mCandidates.size() ) };
+        file.write( reinterpret_cast<const char *>( header ), sizeof( header ) );
+        for( const auto &color : colors ) {
+            const float channels[3] = { color.r, color.g, color.b };
+            file.write( reinterpret_cast<const char *>( channels ), sizeof( channels ) );
+        }
+        file.write( reinterpret_cast<const char *>( mCells.data() ), mCells.size() * sizeof( uint32_t ) );
+        file.write( reinterpret_cast<const char *>( mCandidates.data() ), mCandidates.size() * sizeof( uint32_t ) );
+    } );
+}
+
+bool PaletteTable::isValid() const
+{
+    const size_t colors = getColors().size();
+    for( uint32_t cell : mCells ) {
+        if( ! ( cell & listFlag ) ) {
+            if( cell >= colors ) {
+                return false;
+            }
+            continue;
+        }
+        const size_t offset = cell & ~listFlag;
+        if( offset >= mCandidates.size() || mCandidates[offset] == 0 || mCandidates[offset] > mCandidates.size() - offset - 1 ) {
+            return false;
+        }
+        const uint32_t *list = &mCandidates[offset];
+        if( std::any_of( list + 1, list + 1 + list[0], [&]( uint32_t index ) { return index >= colors; } ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<const PaletteTable> paletteTable( const std::vector<PaletteColor> &colors, int resolution, size_t threads )
+{
+    const uint64_t hash = paletteHash( colors );
+    std::shared_ptr<TableEntry> entry;
+    fs::path directory;
+    {
+        std::lock_guard<std::mutex> lock( sTableMutex );
+        auto &slot = sTables[std::make_pair( hash, resolution )];
+        // a colliding palette replaces the cached one
+        if( ! slot || ! sameColors( slot->colors, colors ) ) {
+            slot = std::make_shared<TableEntry>( colors );
+        }
+        entry = slot;
+        directory = sCacheDirectory;
+    }
+
+    // Loading, building and saving happen outside the lock, so only callers asking for the same table wait for it,
+    // and the parallel build never runs under a lock its workers could need.
+    std::call_once( entry->once, [&] {
+        std::shared_ptr<const PaletteTable> table;
+        if( ! directory.empty() ) {
+            table = PaletteTable::load( tablePath( directory, hash, resolution ), colors, resolution );
+        }
+        if( ! table ) {
+            auto built = std::make_shared<PaletteTable>( colors, resolution, threads );
+            if( ! directory.empty() ) {
+                built->save( tablePath( directory, hash, resolution ) );
+            }
+            table = built;
+        }
+        entry->table = table;
+    } );
+    return entry->table;
+}
+
+} // namespace detail
+
+void setPaletteTableCacheDirectory( const std::filesystem::path &directory )
+{
+    std::lock_guard<std::mutex> lock( sTableMutex );
+    sCacheDirectory = directory;
+}
+
+}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace reza {
+namespace dither {
+namespace parallel {
+
+//! Resolves a requested thread count, where 0 means every hardware thread, and caps it at \a maxUseful.
+inline size_t resolveThreads( size_t requested, size_t maxUseful )
+{
+    size_t count = requested ? requested : std::thread::hardware_concurrency();
+    if( count > maxUseful ) {
+        count = maxUseful;
+    }
+    return count ? count : 1;
+}
+
+//! Runs \a worker( index ) for every index below \a count on the pool the calling thread works for, if any, and
+//! returns whether it did.
+bool runOnPool( size_t count, const std::function<void( size_t )> &worker );
+
+//! Runs \a worker( index ) on \a count threads, one of them the calling thread, and waits for all of them. On a pool
+//! worker the other indices become pool tasks, which may run one after the other, so workers must not wait for each
+//! other to start.
+template<typename Worker>
+void run( size_t count, const Worker &worker )
+{
+    if( count > 1 && runOnPool( count, std::cref( worker ) ) ) {
+        return;
+    }
+    std::vector<std::thread> threads;
+    threads.reserve( count - 1 );
+    for( size_t i = 1; i < count; i++ ) {
+        threads.emplace_back( [&worker, i] { worker( i ); } );
+    }
+    worker( 0 );
+    for( auto &thread : threads ) {
+        thread.join();
+    }
+}
+
+}
+}
+} // namespace reza::dither::parallel
@@ -0,0 +1,166 @@
+#include "DitherPool.h"
+#include "DitherParallel.h"
+
+#include <utility>
+
+namespace reza {
+namespace dither {
+namespace detail {
+
+namespace {
+    thread_local Pool *sCurrentPool = nullptr;
+    thread_local size_t sCurrentQueue = 0;
+}
+
+Pool::Pool( size_t threads )
+    : mQueued( 0 ), mNextQueue( 0 ), mStop( false )
+{
+    const size_t count = parallel::resolveThreads( threads, static_cast<size_t>( -1 ) );
+    for( size_t i = 0; i < count; i++ ) {
+        mQueues.push_back( std::make_unique<Queue>() );
+    }
+    for( size_t i = 0; i < count; i++ ) {
+        mThreads.emplace_back( [this, i] { work( i ); } );
+    }
+}
+
+Pool::~Pool()
+{
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        mStop = true;
+    }
+    mWake.notify_all();
+    for( auto &thread : mThreads ) {
+        thread.join();
+    }
+}
+
+Pool *Pool::current()
+{
+    return sCurrentPool;
+}
+
+void Pool::submit( std::function<void()> task )
+{
+    const size_t queue = sCurrentPool == this ? sCurrentQueue : mNextQueue++ % mQueues.size();
+    {
+        std::lock_guard<std::mutex> lock( mQueues[queue]->mutex );
+        mQueues[queue]->tasks.push_back( std::move( task ) );
+    }
+    {
+        // taken so that a worker can't miss the wake-up between checking and sleeping
+        std::lock_guard<std::mutex> lock( mMutex );
+        mQueued++;
+    }
+    mWake.notify_one();
+}
+
+bool Pool::runOne( size_t home )
+{
+    std::function<void()> task;
+    for( size_t i = 0; i < mQueues.size() && ! task; i++ ) {
+        Queue &queue = *mQueues[( home + i ) % mQueues.size()];
+        std::lock_guard<std::mutex> lock( queue.mutex );
+        if( queue.tasks.empty() ) {
+            continue;
+        }
+        // the newest of our own tasks, the oldest of anyone else's
+        if( i == 0 ) {
+            task = std::move( queue.tasks.back() );
+            queue.tasks.pop_back();
+        }
+        else {
+            task = std::move( queue.tasks.front() );
+            queue.tasks.pop_front();
+        }
+    }
+    if( ! task ) {
+        return false;
+    }
+    mQueued--;
+    task();
+    return true;
+}
+
+void Pool::work( size_t index )
+{
+    sCurrentPool = this;
+    sCurrentQueue = index;
+    for( ;; ) {
+        if( runOne( index ) ) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock( mMutex );
+        mWake.wait( lock, [this] { return mQueued > 0 || mStop; } );
+        if( mQueued == 0 && mStop ) {
+            return;
+        }
+    }
+}
+
+void Pool::run( size_t count, const std::function<void( size_t )> &worker )
+{
+    // The indices are claimed from a counter shared by the caller and the queued tasks, so while the caller waits it
+    // only runs indices of this call. Running other queued tasks instead, such as a batch's next image, could take a
+    // lock the caller already holds and would keep it away from its own work for as long as that task takes.
+    struct Claims {
+        const std::function<void( size_t )> *worker;
+        size_t count;
+        std::atomic<size_t> next;
+        std::atomic<size_t> remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+
+        // runs the next unclaimed index, or returns false if every index is taken
+        bool runNext()
+        {
+            const size_t index = next.fetch_add( 1, std::memory_order_relaxed );
+            if( index >= count ) {
+                return false;
+            }
+            ( *worker )( index );
+            if( remaining.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+                std::lock_guard<std::mutex> lock( mutex );
+                done.notify_all();
+            }
+            return true;
+        }
+    };
+    if( count == 0 ) {
+        return;
+    }
+
+    // shared with the tasks, which may only get to run after every index is done and this call has returned
+    auto claims = std::make_shared<Claims>();
+    claims->worker = &worker;
+    claims->count = count;
+    claims->next = 0;
+    claims->remaining = count;
+    for( size_t i = 1; i < count; i++ ) {
+        submit( [claims] { claims->runNext(); } );
+    }
+    while( claims->runNext() ) {
+    }
+    std::unique_lock<std::mutex> lock( claims->mutex );
+    claims->done.wait( lock, [&] { return claims->remaining.load( std::memory_order_acquire ) == 0; } );
+}
+
+} // namespace detail
+
+namespace parallel {
+
+bool runOnPool( size_t count, const std::function<void( size_t )> &worker )
+{
+    detail::Pool *pool = detail::Pool::current();
+    if( ! pool ) {
+        return false;
+    }
+    pool->run( count, worker );
+    return true;
+}
+
+} // namespace parallel
+
+}
+}
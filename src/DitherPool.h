@@ -0,0 +1,67 @@
+#pragma once
+
+// A persistent pool of worker threads with a task queue per worker. Workers take their
+// own newest task first and steal the oldest from the others when they run dry, so a
+// worker that splits its task keeps the pieces warm while idle workers take the rest.
+// parallel::run() called on a worker spreads over the pool instead of starting threads.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace reza {
+namespace dither {
+namespace detail {
+
+class Pool {
+  public:
+    //! Starts \a threads workers, 0 for every hardware thread.
+    explicit Pool( size_t threads );
+    //! Runs the tasks still queued, then stops the workers.
+    ~Pool();
+
+    Pool( const Pool & ) = delete;
+    Pool &operator=( const Pool & ) = delete;
+
+    size_t size() const { return mThreads.size(); }
+
+    //! Queues \a task, on the calling worker's own queue when called from a worker.
+    void submit( std::function<void()> task );
+
+    //! Runs \a worker( index ) for every index below \a count and waits for them. The calling thread and up to
+    //! \a count - 1 tasks claim the indices one at a time, so the caller runs whichever no worker has taken yet and
+    //! never another queued task. It may therefore be called from a worker, even one that holds a lock other tasks
+    //! take.
+    void run( size_t count, const std::function<void( size_t )> &worker );
+
+    //! Returns the pool the calling thread works for, or null.
+    static Pool *current();
+
+  private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void work( size_t index );
+    //! Runs one queued task, preferring queue \a home, and returns whether there was one.
+    bool runOne( size_t home );
+
+    std::vector<std::unique_ptr<Queue>> mQueues;
+    std::vector<std::thread> mThreads;
+    std::atomic<size_t> mQueued;
+    std::atomic<size_t> mNextQueue;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    bool mStop;
+};
+
+}
+}
+} // namespace reza::dither::detail
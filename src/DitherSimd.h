@@ -0,0 +1,223 @@
+#pragma once
+
+// SIMD helpers for the error diffusion loops. An RGBA float pixel fits a single 128-bit
+// register. Errors are stored as packed r, g, b floats and move through the lower three
+// lanes, so a pair of neighbouring pixels' errors takes one 16-byte and one 8-byte access.
+// Wider registers don't help here: a 256-bit access would either spill into the next
+// pixel, which a neighbouring row's worker may be writing, or have to be masked, and
+// masked stores can't forward to the overlapping loads of the very next pixel.
+//
+// Every lane operation is the same IEEE operation the scalar fallback performs, and
+// the distance sums are added in the same order ( ( r + g ) + b ) + a. The SIMD and
+// scalar paths therefore agree bit for bit, with two exceptions. A compiler allowed to
+// contract the scalar fallback into fused multiply-adds can round differently by up to
+// 1 ulp per operation. The distances may also round differently from glm::length() by
+// up to 1 ulp. Either can only flip a quantization decision where two candidate colors
+// are equally close to within that tolerance.
+//
+// Define REZA_DITHER_NO_SIMD to force the scalar fallback.
+
+#if ! defined( REZA_DITHER_NO_SIMD )
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define REZA_DITHER_SSE2 1
+#endif
+#endif
+
+#if defined( REZA_DITHER_SSE2 )
+#include <emmintrin.h>
+#endif
+
+#include <cmath>
+
+namespace reza {
+namespace dither {
+namespace simd {
+
+#if defined( REZA_DITHER_SSE2 )
+
+struct Vec4 {
+    __m128 v;
+
+    Vec4() : v( _mm_setzero_ps() ) {}
+    explicit Vec4( __m128 v ) : v( v ) {}
+    explicit Vec4( float s ) : v( _mm_set1_ps( s ) ) {}
+    Vec4( float r, float g, float b, float a ) : v( _mm_setr_ps( r, g, b, a ) ) {}
+
+    static Vec4 load( const float *p ) { return Vec4( _mm_loadu_ps( p ) ); }
+    //! Loads the three floats at \a p into r, g and b, with a zero alpha.
+    static Vec4 load3( const float *p )
+    {
+        const __m128 rg = _mm_castpd_ps( _mm_load_sd( reinterpret_cast<const double *>( p ) ) );
+        return Vec4( _mm_movelh_ps( rg, _mm_load_ss( p + 2 ) ) );
+    }
+    void store( float *p ) const { _mm_storeu_ps( p, v ); }
+    //! Stores r, g and b to the three floats at \a p.
+    void store3( float *p ) const
+    {
+        _mm_store_sd( reinterpret_cast<double *>( p ), _mm_castps_pd( v ) );
+        _mm_store_ss( p + 2, _mm_movehl_ps( v, v ) );
+    }
+
+    float alpha() const { return _mm_cvtss_f32( _mm_shuffle_ps( v, v, _MM_SHUFFLE( 3, 3, 3, 3 ) ) ); }
+
+    //! Returns a copy with the alpha lane replaced by \a a.
+    Vec4 withAlpha( float a ) const
+    {
+        const __m128 ba = _mm_shuffle_ps( v, _mm_set1_ps( a ), _MM_SHUFFLE( 0, 0, 2, 2 ) );
+        return Vec4( _mm_shuffle_ps( v, ba, _MM_SHUFFLE( 2, 0, 1, 0 ) ) );
+    }
+};
+
+inline Vec4 operator+( const Vec4 &a, const Vec4 &b ) { return Vec4( _mm_add_ps( a.v, b.v ) ); }
+inline Vec4 operator-( const Vec4 &a, const Vec4 &b ) { return Vec4( _mm_sub_ps( a.v, b.v ) ); }
+inline Vec4 operator*( const Vec4 &a, float s ) { return Vec4( _mm_mul_ps( a.v, _mm_set1_ps( s ) ) ); }
+inline Vec4 operator/( const Vec4 &a, float s ) { return Vec4( _mm_div_ps( a.v, _mm_set1_ps( s ) ) ); }
+
+//! Euclidean lengths of \a a and \a b, computed side by side.
+inline void lengths( const Vec4 &a, const Vec4 &b, float *lengthA, float *lengthB )
+{
+    const __m128 a2 = _mm_mul_ps( a.v, a.v );
+    const __m128 b2 = _mm_mul_ps( b.v, b.v );
+    const __m128 lo = _mm_unpacklo_ps( a2, b2 ); // ar ba ag bg
+    const __m128 hi = _mm_unpackhi_ps( a2, b2 ); // ab bb aa ba
+    __m128 sum = _mm_add_ps( lo, _mm_movehl_ps( lo, lo ) );
+    sum = _mm_add_ps( sum, hi );
+    sum = _mm_add_ps( sum, _mm_movehl_ps( hi, hi ) );
+    sum = _mm_sqrt_ps( sum );
+    *lengthA = _mm_cvtss_f32( sum );
+    *lengthB = _mm_cvtss_f32( _mm_shuffle_ps( sum, sum, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+}
+
+//! Euclidean lengths of four vectors, one per lane of the result.
+inline Vec4 lengths( const Vec4 &a, const Vec4 &b, const Vec4 &c, const Vec4 &d )
+{
+    __m128 a2 = _mm_mul_ps( a.v, a.v );
+    __m128 b2 = _mm_mul_ps( b.v, b.v );
+    __m128 c2 = _mm_mul_ps( c.v, c.v );
+    __m128 d2 = _mm_mul_ps( d.v, d.v );
+    _MM_TRANSPOSE4_PS( a2, b2, c2, d2 );
+    const __m128 sum = _mm_add_ps( _mm_add_ps( _mm_add_ps( a2, b2 ), c2 ), d2 );
+    return Vec4( _mm_sqrt_ps( sum ) );
+}
+
+//! Index of the first lane holding the smallest value, or 3 if any lane is NaN.
+inline int firstMin( const Vec4 &a )
+{
+    __m128 m = _mm_min_ps( a.v, _mm_shuffle_ps( a.v, a.v, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+    m = _mm_min_ps( m, _mm_shuffle_ps( m, m, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+    if( _mm_movemask_ps( _mm_cmpunord_ps( a.v, a.v ) ) ) {
+        return 3;
+    }
+    const int mask = _mm_movemask_ps( _mm_cmpeq_ps( a.v, m ) );
+    return ( mask & 1 ) ? 0 : ( mask & 2 ) ? 1 : ( mask & 4 ) ? 2 : 3;
+}
+
+//! Adds the r, g and b of \a v to the three floats at \a p, leaving the float after them alone.
+inline void accumulate3( float *p, const Vec4 &v )
+{
+    ( Vec4::load3( p ) + v ).store3( p );
+}
+
+//! Adds the r, g and b of \a lo to the pixel at \a p and those of \a hi to the pixel right after it, six floats
+//! in one 16-byte and one 8-byte access.
+inline void accumulate3x2( float *p, const Vec4 &lo, const Vec4 &hi )
+{
+    const __m128 br = _mm_shuffle_ps( lo.v, hi.v, _MM_SHUFFLE( 0, 0, 2, 2 ) );
+    const __m128 first = _mm_shuffle_ps( lo.v, br, _MM_SHUFFLE( 2, 0, 1, 0 ) );
+    const __m128 second = _mm_shuffle_ps( hi.v, hi.v, _MM_SHUFFLE( 2, 1, 2, 1 ) );
+    _mm_storeu_ps( p, _mm_add_ps( _mm_loadu_ps( p ), first ) );
+    const __m128 gb = _mm_castpd_ps( _mm_load_sd( reinterpret_cast<const double *>( p + 4 ) ) );
+    _mm_store_sd( reinterpret_cast<double *>( p + 4 ), _mm_castps_pd( _mm_add_ps( gb, second ) ) );
+}
+
+#else
+
+struct Vec4 {
+    float v[4];
+
+    Vec4() : v{ 0.0f, 0.0f, 0.0f, 0.0f } {}
+    explicit Vec4( float s ) : v{ s, s, s, s } {}
+    Vec4( float r, float g, float b, float a ) : v{ r, g, b, a } {}
+
+    static Vec4 load( const float *p ) { return Vec4( p[0], p[1], p[2], p[3] ); }
+    //! Loads the three floats at \a p into r, g and b, with a zero alpha.
+    static Vec4 load3( const float *p ) { return Vec4( p[0], p[1], p[2], 0.0f ); }
+    void store( float *p ) const
+    {
+        p[0] = v[0];
+        p[1] = v[1];
+        p[2] = v[2];
+        p[3] = v[3];
+    }
+    //! Stores r, g and b to the three floats at \a p.
+    void store3( float *p ) const
+    {
+        p[0] = v[0];
+        p[1] = v[1];
+        p[2] = v[2];
+    }
+
+    float alpha() const { return v[3]; }
+
+    //! Returns a copy with the alpha lane replaced by \a a.
+    Vec4 withAlpha( float a ) const { return Vec4( v[0], v[1], v[2], a ); }
+};
+
+inline Vec4 operator+( const Vec4 &a, const Vec4 &b ) { return Vec4( a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] ); }
+inline Vec4 operator-( const Vec4 &a, const Vec4 &b ) { return Vec4( a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] ); }
+inline Vec4 operator*( const Vec4 &a, float s ) { return Vec4( a.v[0] * s, a.v[1] * s, a.v[2] * s, a.v[3] * s ); }
+inline Vec4 operator/( const Vec4 &a, float s ) { return Vec4( a.v[0] / s, a.v[1] / s, a.v[2] / s, a.v[3] / s ); }
+
+inline float length( const Vec4 &a )
+{
+    return std::sqrt( a.v[0] * a.v[0] + a.v[1] * a.v[1] + a.v[2] * a.v[2] + a.v[3] * a.v[3] );
+}
+
+//! Euclidean lengths of \a a and \a b.
+inline void lengths( const Vec4 &a, const Vec4 &b, float *lengthA, float *lengthB )
+{
+    *lengthA = length( a );
+    *lengthB = length( b );
+}
+
+//! Euclidean lengths of four vectors, one per lane of the result.
+inline Vec4 lengths( const Vec4 &a, const Vec4 &b, const Vec4 &c, const Vec4 &d )
+{
+    return Vec4( length( a ), length( b ), length( c ), length( d ) );
+}
+
+//! Index of the first lane holding the smallest value, or 3 if any lane is NaN.
+inline int firstMin( const Vec4 &a )
+{
+    for( int i = 0; i < 4; i++ ) {
+        bool smallest = true;
+        for( int j = 0; j < 4; j++ ) {
+            smallest = smallest && a.v[i] <= a.v[j];
+        }
+        if( smallest ) {
+            return i;
+        }
+    }
+    return 3;
+}
+
+//! Adds the r, g and b of \a v to the three floats at \a p.
+inline void accumulate3( float *p, const Vec4 &v )
+{
+    p[0] += v.v[0];
+    p[1] += v.v[1];
+    p[2] += v.v[2];
+}
+
+//! Adds the r, g and b of \a lo to the pixel at \a p and those of \a hi to the pixel right after it.
+inline void accumulate3x2( float *p, const Vec4 &lo, const Vec4 &hi )
+{
+    accumulate3( p, lo );
+    accumulate3( p + 3, hi );
+}
+
+#endif
+
+}
+}
+} // namespace reza::dither::simd
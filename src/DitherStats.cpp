@@ -0,0 +1,40 @@
+#include "DitherCore.h"
+#include "DitherStats.h"
+
+#include <atomic>
+
+namespace reza {
+namespace dither {
+
+namespace {
+    std::atomic<ZoneHook> sZoneBegin( nullptr );
+    std::atomic<ZoneHook> sZoneEnd( nullptr );
+}
+
+namespace detail {
+
+Zone::Zone( const char *name )
+    : mName( name )
+{
+    if( ZoneHook begin = sZoneBegin.load( std::memory_order_acquire ) ) {
+        begin( mName );
+    }
+}
+
+Zone::~Zone()
+{
+    if( ZoneHook end = sZoneEnd.load( std::memory_order_acquire ) ) {
+        end( mName );
+    }
+}
+
+} // namespace detail
+
+void setZoneHooks( ZoneHook begin, ZoneHook end )
+{
+    sZoneBegin.store( begin, std::memory_order_release );
+    sZoneEnd.store( end, std::memory_order_release );
+}
+
+}
+}
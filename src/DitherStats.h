@@ -0,0 +1,103 @@
+#pragma once
+
+// Helpers behind Options::stats() and the scoped zones. Everything here checks for a
+// Stats first, so calls without one only pay for a null test per phase, and zones
+// compile to nothing unless REZA_DITHER_ZONES is defined.
+
+#include "DitherCore.h"
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+namespace reza {
+namespace dither {
+namespace detail {
+
+class Stopwatch {
+  public:
+    Stopwatch()
+        : mStart( std::chrono::steady_clock::now() )
+    {
+    }
+
+    double seconds() const { return std::chrono::duration<double>( std::chrono::steady_clock::now() - mStart ).count(); }
+
+  private:
+    std::chrono::steady_clock::time_point mStart;
+};
+
+// Time one worker of a parallel phase spent working, and waiting for the other workers.
+struct WorkerTime {
+    double busy = 0.0;
+    double wait = 0.0;
+};
+
+//! Adds a dither phase over \a pixels pixels that took \a seconds on \a threads threads to \a stats.
+inline void addDither( Stats *stats, double seconds, size_t pixels, size_t threads )
+{
+    if( stats ) {
+        stats->ditherSeconds += seconds;
+        stats->pixels += pixels;
+        stats->threadSeconds += seconds * threads;
+    }
+}
+
+inline void addWorkers( Stats *stats, const std::vector<WorkerTime> &times )
+{
+    if( stats ) {
+        for( const auto &time : times ) {
+            stats->busySeconds += time.busy;
+            stats->waitSeconds += time.wait;
+        }
+    }
+}
+
+//! Returns create(), an output surface, adding the time and its bytes to \a stats.
+template<typename Create>
+auto allocate( Stats *stats, const Create &create )
+{
+    const Stopwatch watch;
+    auto output = create();
+    if( stats ) {
+        stats->allocationSeconds += watch.seconds();
+        stats->bytesAllocated += output->getRowBytes() * output->getHeight();
+    }
+    return output;
+}
+
+//! Returns build(), a mask or table, adding the time to \a stats.
+template<typename Build>
+auto setup( Stats *stats, const Build &build )
+{
+    const Stopwatch watch;
+    auto result = build();
+    if( stats ) {
+        stats->setupSeconds += watch.seconds();
+    }
+    return result;
+}
+
+// Calls the zone hooks for the lifetime of the object.
+class Zone {
+  public:
+    explicit Zone( const char *name );
+    ~Zone();
+
+  private:
+    const char *mName;
+};
+
+}
+}
+} // namespace reza::dither::detail
+
+#define REZA_DITHER_CONCAT_( a, b ) a##b
+#define REZA_DITHER_CONCAT( a, b ) REZA_DITHER_CONCAT_( a, b )
+
+//! Marks the rest of the enclosing scope as zone \a name, a string literal.
+#if defined( REZA_DITHER_ZONES )
+#define REZA_DITHER_ZONE( name ) const ::reza::dither::detail::Zone REZA_DITHER_CONCAT( rezaDitherZone, __LINE__ )( name )
+#else
+#define REZA_DITHER_ZONE( name )
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+
+// The frame-to-frame engine behind VideoDitherer, on image views so that it stays
+// independent of Cinder. The caller owns the output pixels and passes the same ones
+// with every frame; the engine keeps its own copy of the input each band was last
+// dithered from.
+
+#include "DitherCore.h"
+
+#include <memory>
+
+namespace reza {
+namespace dither {
+namespace detail {
+
+class FrameDitherer {
+  public:
+    virtual ~FrameDitherer() {}
+
+    //! Dithers \a frame into \a output, which must hold the previous frame's output unless the frame's size or alpha
+    //! changed, or reset() was called, either of which dithers the frame in full.
+    virtual void dither( const ImageView32f &frame, const ImageView32f &output ) = 0;
+    virtual void reset() = 0;
+
+    int getRowsDithered() const { return mRowsDithered; }
+
+  protected:
+    int mRowsDithered = 0;
+};
+
+//! Returns an engine that dithers to black and white, or with \a rgb to red, green, blue and black.
+std::unique_ptr<FrameDitherer> makeFrameDitherer( Kernel kernel, bool rgb, const Options &options );
+//! Returns an engine that dithers to the colors of \a palette.
+std::unique_ptr<FrameDitherer> makeFrameDitherer( Kernel kernel, const Palette &palette, const Options &options );
+
+}
+}
+} // namespace reza::dither::detail
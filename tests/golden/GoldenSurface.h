@@ -0,0 +1,118 @@
+#pragma once
+
+// Just enough of Cinder's ColorA and Surface32f for the frozen reference loops to build
+// unchanged without Cinder. Only the behaviour those loops depend on is reproduced:
+//  - getPixel() of a surface without alpha reads alpha back as 1, and setPixel() drops
+//    it, so an alpha-less accumulator adds 1 to every total's alpha
+//  - new surfaces are zeroed, as the loops assume of the error they accumulate in them
+//  - color arithmetic is per channel in float, and /= divides rather than multiplying
+//    by the reciprocal
+//  - length() sums the squares as ( ( r + g ) + b ) + a, the order the library's SIMD
+//    and scalar paths use; glm::length() may round the last bit differently, which can
+//    only flip a decision between two colors at the same distance
+// getPixel() and setPixel() also do the work Cinder's do on every call, clamping the
+// position and reading the row bytes and channel offsets from the surface, so that
+// DitherBench times the original loops at their real cost.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace golden {
+
+struct ivec2 {
+    ivec2( int x, int y )
+        : x( x ), y( y )
+    {
+    }
+
+    int x, y;
+};
+
+enum ColorModel { CM_RGB };
+
+struct ColorA {
+    ColorA() {}
+    ColorA( float r, float g, float b, float a = 1.0f )
+        : r( r ), g( g ), b( b ), a( a )
+    {
+    }
+
+    ColorA operator+( const ColorA &rhs ) const { return ColorA( r + rhs.r, g + rhs.g, b + rhs.b, a + rhs.a ); }
+    ColorA operator-( const ColorA &rhs ) const { return ColorA( r - rhs.r, g - rhs.g, b - rhs.b, a - rhs.a ); }
+    ColorA operator*( float rhs ) const { return ColorA( r * rhs, g * rhs, b * rhs, a * rhs ); }
+    ColorA &operator/=( float rhs )
+    {
+        r /= rhs;
+        g /= rhs;
+        b /= rhs;
+        a /= rhs;
+        return *this;
+    }
+
+    void set( ColorModel, const ColorA &color ) { *this = color; }
+
+    float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
+};
+
+inline float length( const ColorA &c )
+{
+    return std::sqrt( ( ( c.r * c.r + c.g * c.g ) + c.b * c.b ) + c.a * c.a );
+}
+
+// Packed r, g, b( , a ) float pixels with no row padding.
+class Surface32f {
+  public:
+    Surface32f( int width, int height, bool alpha )
+        : mWidth( width ), mHeight( height ), mAlpha( alpha ), mPixelInc( alpha ? 4 : 3 ), mAlphaOffset( alpha ? 3 : -1 ),
+          mRowBytes( size_t( width ) * mPixelInc * sizeof( float ) ), mData( size_t( width ) * height * mPixelInc, 0.0f )
+    {
+    }
+
+    static std::shared_ptr<Surface32f> create( int width, int height, bool alpha ) { return std::make_shared<Surface32f>( width, height, alpha ); }
+
+    int getWidth() const { return mWidth; }
+    int getHeight() const { return mHeight; }
+    bool hasAlpha() const { return mAlpha; }
+    int getPixelInc() const { return mPixelInc; }
+    float *getData() { return mData.data(); }
+
+    ColorA getPixel( ivec2 pos ) const
+    {
+        const float *pixel = pixelAt( pos );
+        return ColorA( pixel[mRedOffset], pixel[mGreenOffset], pixel[mBlueOffset], mAlphaOffset >= 0 ? pixel[mAlphaOffset] : 1.0f );
+    }
+
+    void setPixel( ivec2 pos, const ColorA &color )
+    {
+        float *pixel = const_cast<float *>( pixelAt( pos ) );
+        pixel[mRedOffset] = color.r;
+        pixel[mGreenOffset] = color.g;
+        pixel[mBlueOffset] = color.b;
+        if( mAlphaOffset >= 0 ) {
+            pixel[mAlphaOffset] = color.a;
+        }
+    }
+
+  private:
+    const float *pixelAt( ivec2 pos ) const
+    {
+        pos.x = std::min( std::max( pos.x, 0 ), mWidth - 1 );
+        pos.y = std::min( std::max( pos.y, 0 ), mHeight - 1 );
+        return reinterpret_cast<const float *>( reinterpret_cast<const uint8_t *>( mData.data() + pos.x * mPixelInc ) + pos.y * mRowBytes );
+    }
+
+    int mWidth, mHeight;
+    bool mAlpha;
+    uint8_t mPixelInc;
+    int8_t mRedOffset = 0, mGreenOffset = 1, mBlueOffset = 2, mAlphaOffset;
+    size_t mRowBytes;
+    std::vector<float> mData;
+};
+
+typedef std::shared_ptr<Surface32f> Surface32fRef;
+
+} // namespace golden
@@ -0,0 +1,517 @@
+// Golden-image test: holds the library's error diffusion paths to the frozen reference
+// loops of ReferenceDither.cpp, headless and without Cinder. Build it from the block's
+// root against the Cinder-independent sources:
+//
+//     g++ -std=c++17 -O2 -Iinclude -Isrc tests/golden/*.cpp $( ls src/*.cpp | grep -v -e Cinder -e Batch ) -lpthread -o golden
+//
+// ./golden prints a table of differing pixels per algorithm and check, 0 meaning bit
+// exact, and exits with 1 if any check fails. The SIMD and scalar builds can't meet in
+// one binary, so ./golden --digests prints a hash of every output instead: build a
+// second binary with -DREZA_DITHER_NO_SIMD and diff the two listings.
+//
+// Every check runs over random, ramp, gradient and flat images, with and without alpha,
+// from 1 x 1 up to 512 x 384:
+//  - float       the float functions against the reference
+//  - threads     wavefront diffusion on 3 threads against the reference
+//  - in place    output == input against the reference
+//  - stream      the row-by-row Ditherer against the reference
+//  - video       exact VideoDitherer frames ( settle rows -1 ) against the reference
+//  - bits/index  Bitmap bits or IndexedImage indices against the reference's colors
+//  - alpha       transparent input with AlphaPolicy::Preserve: colors against the
+//                reference on its opaque copy, alpha against the input
+//  - 8-bit       the fixed-point functions on 3 threads against 1 thread
+//  - 8-bit tone  how far the 8-bit output strays from the reference on an in-gamut copy
+//                of the input, as the largest per-channel difference of 16 x 16 block
+//                averages ( the whole image when it is smaller ); the fixed-point error
+//                makes other decisions, so this is bounded rather than exact
+// followed by the Ditherer with Options::luminance() against the float function with it
+// and mono Bayer thresholding of packed against unpacked pixels at threshold ties, both
+// of which must match, and the seam visibility of striped diffusion, where seeded
+// stripes must stay under a bound and show no more seams than unseeded ones.
+
+#include "DitherCore.h"
+#include "DitherVideo.h"
+#include "ReferenceDither.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace reza::dither;
+
+namespace {
+
+typedef golden::Surface32fRef ( *ReferenceFunction )( golden::Surface32fRef input );
+
+struct Algorithm {
+    const char *name;
+    Kernel kernel;
+    bool rgb;
+    ReferenceFunction reference;
+};
+
+const Algorithm kAlgorithms[] = {
+    { "linear", Kernel::Linear, false, reza::dither_reference::linear },
+    { "linearRGB", Kernel::Linear, true, reza::dither_reference::linearRGB },
+    { "FloydSteinberg", Kernel::FloydSteinberg, false, reza::dither_reference::FloydSteinberg },
+    { "FloydSteinbergRGB", Kernel::FloydSteinberg, true, reza::dither_reference::FloydSteinbergRGB },
+    { "JarvisJudiceNinke", Kernel::JarvisJudiceNinke, false, reza::dither_reference::JarvisJudiceNinke },
+    { "JarvisJudiceNinkeRGB", Kernel::JarvisJudiceNinke, true, reza::dither_reference::JarvisJudiceNinkeRGB },
+    { "Stucki", Kernel::Stucki, false, reza::dither_reference::Stucki },
+    { "StuckiRGB", Kernel::Stucki, true, reza::dither_reference::StuckiRGB },
+    { "Atkinson", Kernel::Atkinson, false, reza::dither_reference::Atkinson },
+    { "AtkinsonRGB", Kernel::Atkinson, true, reza::dither_reference::AtkinsonRGB },
+    { "Burkes", Kernel::Burkes, false, reza::dither_reference::Burkes },
+    { "BurkesRGB", Kernel::Burkes, true, reza::dither_reference::BurkesRGB },
+    { "Sierra", Kernel::Sierra, false, reza::dither_reference::Sierra },
+    { "SierraRGB", Kernel::Sierra, true, reza::dither_reference::SierraRGB },
+    { "TwoRowSierra", Kernel::TwoRowSierra, false, reza::dither_reference::TwoRowSierra },
+    { "TwoRowSierraRGB", Kernel::TwoRowSierra, true, reza::dither_reference::TwoRowSierraRGB },
+    { "SierraLite", Kernel::SierraLite, false, reza::dither_reference::SierraLite },
+    { "SierraLiteRGB", Kernel::SierraLite, true, reza::dither_reference::SierraLiteRGB },
+};
+
+enum Check { Float, Threads, InPlace, Stream, Video, BitsIndex, Alpha, Fixed, FixedTone, CheckCount };
+const char *const kCheckNames[CheckCount] = { "float", "threads", "in place", "stream", "video", "bits/index", "alpha", "8-bit", "8-bit tone" };
+
+// The most the 8-bit output's 16 x 16 block averages may differ from the reference's.
+const double kToneBound = 0.1;
+// The most seamVisibility() may report for seeded stripes on the gradient, which must
+// also report no more than unseeded ones.
+const float kSeamBound = 1.12f;
+
+const int kSizes[][2] = { { 1, 1 }, { 3, 2 }, { 37, 23 }, { 200, 150 }, { 512, 384 } };
+const char *const kContents[] = { "random", "ramp", "gradient", "flat" };
+
+ImageView32f viewOf( const golden::Surface32fRef &surface )
+{
+    return ImageView32f( surface->getData(), surface->getWidth(), surface->getHeight(), ptrdiff_t( surface->getWidth() ) * surface->getPixelInc() * sizeof( float ),
+        surface->hasAlpha() ? ChannelOrder::RGBA : ChannelOrder::RGB );
+}
+
+golden::Surface32fRef makeInput( const char *content, int width, int height, bool alpha, std::mt19937 &random )
+{
+    std::uniform_real_distribution<float> unit( 0.0f, 1.0f );
+    auto surface = golden::Surface32f::create( width, height, alpha );
+    const std::string kind = content;
+    for( int y = 0; y < height; y++ ) {
+        for( int x = 0; x < width; x++ ) {
+            golden::ColorA color( 0.5f, 0.5f, 0.5f, 1.0f );
+            if( kind == "random" ) {
+                color = golden::ColorA( unit( random ), unit( random ), unit( random ), 1.0f );
+            }
+            else if( kind == "ramp" ) {
+                const float v = float( x + y ) / float( width + height );
+                color = golden::ColorA( v, v, v, 1.0f );
+            }
+            else if( kind == "gradient" ) {
+                color = golden::ColorA( float( x ) / width, float( y ) / height, 1.0f - float( x ) / width, 1.0f );
+            }
+            surface->setPixel( golden::ivec2( x, y ), color );
+        }
+    }
+    return surface;
+}
+
+golden::Surface32fRef copyOf( const golden::Surface32fRef &surface )
+{
+    return std::make_shared<golden::Surface32f>( *surface );
+}
+
+// Counts the pixels whose channels differ between \a a and \a b, which share a layout.
+size_t countDifferences( const float *a, const float *b, size_t pixels, int pixelInc )
+{
+    size_t count = 0;
+    for( size_t i = 0; i < pixels; i++ ) {
+        count += std::memcmp( a + i * pixelInc, b + i * pixelInc, pixelInc * sizeof( float ) ) != 0;
+    }
+    return count;
+}
+
+// The largest difference, over every channel and whole 16 x 16 block, between the block averages of \a a and \a b;
+// an image smaller than a block is one block. Partial blocks at the edges are skipped: a handful of pixels says
+// more about where diffusion happened to place its dots than about tone.
+double toneDifference( const std::function<float( int, int, int )> &a, const std::function<float( int, int, int )> &b, int width, int height )
+{
+    const int blockWidth = std::min( 16, width ), blockHeight = std::min( 16, height );
+    double largest = 0.0;
+    for( int by = 0; by + blockHeight <= height; by += blockHeight ) {
+        for( int bx = 0; bx + blockWidth <= width; bx += blockWidth ) {
+            for( int c = 0; c < 3; c++ ) {
+                double sumA = 0.0, sumB = 0.0;
+                int count = 0;
+                for( int y = by; y < by + blockHeight; y++ ) {
+                    for( int x = bx; x < bx + blockWidth; x++, count++ ) {
+                        sumA += a( x, y, c );
+                        sumB += b( x, y, c );
+                    }
+                }
+                largest = std::max( largest, std::abs( sumA - sumB ) / count );
+            }
+        }
+    }
+    return largest;
+}
+
+// FNV-1a over \a size bytes.
+uint64_t digest( const void *data, size_t size )
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const uint8_t *bytes = static_cast<const uint8_t *>( data );
+    for( size_t i = 0; i < size; i++ ) {
+        hash = ( hash ^ bytes[i] ) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Differing pixels, or for the tone check the largest difference, per algorithm and check.
+struct Results {
+    double values[sizeof( kAlgorithms ) / sizeof( kAlgorithms[0] )][CheckCount] = {};
+    bool applies[sizeof( kAlgorithms ) / sizeof( kAlgorithms[0] )][CheckCount] = {};
+
+    void add( size_t algorithm, Check check, double value )
+    {
+        applies[algorithm][check] = true;
+        values[algorithm][check] = check == FixedTone ? std::max( values[algorithm][check], value ) : values[algorithm][check] + value;
+    }
+};
+
+// The reference's color index: 0 to 3 for red, green, blue and black.
+int referenceIndex( const golden::ColorA &color )
+{
+    return color.r == 1.0f ? 0 : color.g == 1.0f ? 1 : color.b == 1.0f ? 2 : 3;
+}
+
+void runChecks( size_t index, const golden::Surface32fRef &input, Results *results, std::vector<std::string> *digests )
+{
+    const Algorithm &algorithm = kAlgorithms[index];
+    const int width = input->getWidth();
+    const int height = input->getHeight();
+    const int pixelInc = input->getPixelInc();
+    const size_t pixels = size_t( width ) * height;
+    const golden::Surface32fRef reference = algorithm.reference( input );
+    const ImageView32f inputView = viewOf( input );
+
+    auto output = golden::Surface32f::create( width, height, input->hasAlpha() );
+    diffuse( algorithm.kernel, inputView, viewOf( output ), algorithm.rgb );
+    results->add( index, Float, double( countDifferences( output->getData(), reference->getData(), pixels, pixelInc ) ) );
+    if( digests ) {
+        char line[160];
+        std::snprintf( line, sizeof( line ), "%s %dx%d%s float %016llx", algorithm.name, width, height, input->hasAlpha() ? " alpha" : "",
+            static_cast<unsigned long long>( digest( output->getData(), pixels * pixelInc * sizeof( float ) ) ) );
+        digests->push_back( line );
+    }
+
+    auto threaded = golden::Surface32f::create( width, height, input->hasAlpha() );
+    diffuse( algorithm.kernel, inputView, viewOf( threaded ), algorithm.rgb, Options().threads( 3 ) );
+    results->add( index, Threads, double( countDifferences( threaded->getData(), reference->getData(), pixels, pixelInc ) ) );
+
+    auto inPlace = copyOf( input );
+    diffuse( algorithm.kernel, viewOf( inPlace ), viewOf( inPlace ), algorithm.rgb );
+    results->add( index, InPlace, double( countDifferences( inPlace->getData(), reference->getData(), pixels, pixelInc ) ) );
+
+    Ditherer ditherer( algorithm.kernel, width, algorithm.rgb, input->hasAlpha() );
+    auto streamed = golden::Surface32f::create( width, height, input->hasAlpha() );
+    const size_t rowFloats = size_t( width ) * pixelInc;
+    for( int y = 0; y < height; y++ ) {
+        ditherer.push( input->getData() + y * rowFloats );
+        ditherer.pull( streamed->getData() + y * rowFloats );
+    }
+    results->add( index, Stream, double( countDifferences( streamed->getData(), reference->getData(), pixels, pixelInc ) ) );
+
+    // three frames: the input, one pixel changed near the top, then one near the bottom
+    auto engine = detail::makeFrameDitherer( algorithm.kernel, algorithm.rgb, Options().videoSettleRows( -1 ).videoBandHeight( 8 ) );
+    auto frame = copyOf( input );
+    auto video = golden::Surface32f::create( width, height, input->hasAlpha() );
+    size_t videoDifferences = 0;
+    for( int f = 0; f < 3; f++ ) {
+        if( f > 0 ) {
+            const golden::ivec2 pos( width / 2, f == 1 ? height / 4 : height - 1 );
+            golden::ColorA color = frame->getPixel( pos );
+            color.r = 1.0f - color.r;
+            frame->setPixel( pos, color );
+        }
+        engine->dither( viewOf( frame ), viewOf( video ) );
+        const golden::Surface32fRef expected = f == 0 ? reference : algorithm.reference( frame );
+        videoDifferences += countDifferences( video->getData(), expected->getData(), pixels, pixelInc );
+    }
+    results->add( index, Video, double( videoDifferences ) );
+
+    size_t packedDifferences = 0;
+    if( algorithm.rgb ) {
+        IndexedImage indexed( width, height );
+        diffuse( algorithm.kernel, inputView, indexed );
+        for( int y = 0; y < height; y++ ) {
+            for( int x = 0; x < width; x++ ) {
+                packedDifferences += indexed.getRow( y )[x] != referenceIndex( reference->getPixel( golden::ivec2( x, y ) ) );
+            }
+        }
+    }
+    else {
+        Bitmap bitmap( width, height );
+        diffuse( algorithm.kernel, inputView, bitmap );
+        for( int y = 0; y < height; y++ ) {
+            for( int x = 0; x < width; x++ ) {
+                packedDifferences += bitmap.isWhite( x, y ) != ( reference->getPixel( golden::ivec2( x, y ) ).r == 1.0f );
+            }
+        }
+    }
+    results->add( index, BitsIndex, double( packedDifferences ) );
+
+    if( input->hasAlpha() ) {
+        // the same colors with a random alpha must dither like the opaque input
+        std::mt19937 random( static_cast<uint32_t>( pixels ) );
+        std::uniform_real_distribution<float> unit( 0.0f, 1.0f );
+        auto transparent = copyOf( input );
+        for( size_t i = 0; i < pixels; i++ ) {
+            transparent->getData()[i * 4 + 3] = unit( random );
+        }
+        auto kept = golden::Surface32f::create( width, height, true );
+        diffuse( algorithm.kernel, viewOf( transparent ), viewOf( kept ), algorithm.rgb, Options().alpha( AlphaPolicy::Preserve ) );
+        size_t alphaDifferences = 0;
+        for( size_t i = 0; i < pixels; i++ ) {
+            const float *pixel = kept->getData() + i * 4;
+            const float *expected = reference->getData() + i * 4;
+            alphaDifferences += std::memcmp( pixel, expected, 3 * sizeof( float ) ) != 0 || pixel[3] != transparent->getData()[i * 4 + 3];
+        }
+        results->add( index, Alpha, double( alphaDifferences ) );
+    }
+
+    // 8-bit: the same image at 8 bits, held to itself across threads
+    const ChannelOrder order = input->hasAlpha() ? ChannelOrder::RGBA : ChannelOrder::RGB;
+    std::vector<uint8_t> bytes( pixels * pixelInc );
+    for( size_t i = 0; i < bytes.size(); i++ ) {
+        bytes[i] = static_cast<uint8_t>( std::lround( input->getData()[i] * 255.0f ) );
+    }
+    std::vector<uint8_t> fixed( bytes.size() ), fixedThreaded( bytes.size() );
+    const ptrdiff_t rowBytes = ptrdiff_t( width ) * pixelInc;
+    diffuse( algorithm.kernel, ImageView8u( bytes.data(), width, height, rowBytes, order ), ImageView8u( fixed.data(), width, height, rowBytes, order ), algorithm.rgb );
+    diffuse( algorithm.kernel, ImageView8u( bytes.data(), width, height, rowBytes, order ), ImageView8u( fixedThreaded.data(), width, height, rowBytes, order ),
+        algorithm.rgb, Options().threads( 3 ) );
+    size_t fixedDifferences = 0;
+    for( size_t i = 0; i < pixels; i++ ) {
+        fixedDifferences += std::memcmp( &fixed[i * pixelInc], &fixedThreaded[i * pixelInc], pixelInc ) != 0;
+    }
+    results->add( index, Fixed, double( fixedDifferences ) );
+
+
+    // and to the reference's tone. Only colors the palette can mix are comparable: outside its gamut the
+    // reference's float error grows without bound while the fixed-point error saturates. So the input is
+    // turned gray for black and white, and scaled into r + g + b <= 1 for red, green, blue and black.
+    std::vector<uint8_t> inGamut( bytes.size() ), inGamutFixed( bytes.size() );
+    auto quantized = golden::Surface32f::create( width, height, input->hasAlpha() );
+    for( size_t i = 0; i < pixels; i++ ) {
+        const float *pixel = input->getData() + i * pixelInc;
+        const float gray = ( pixel[0] + pixel[1] + pixel[2] ) / 3.0f;
+        for( int c = 0; c < pixelInc; c++ ) {
+            const float value = c == 3 ? pixel[c] : algorithm.rgb ? pixel[c] / 3.0f : gray;
+            inGamut[i * pixelInc + c] = static_cast<uint8_t>( std::lround( value * 255.0f ) );
+            quantized->getData()[i * pixelInc + c] = inGamut[i * pixelInc + c] / 255.0f;
+        }
+    }
+    diffuse( algorithm.kernel, ImageView8u( inGamut.data(), width, height, rowBytes, order ), ImageView8u( inGamutFixed.data(), width, height, rowBytes, order ),
+        algorithm.rgb );
+    const golden::Surface32fRef quantizedReference = algorithm.reference( quantized );
+    const float *expected = quantizedReference->getData();
+    results->add( index, FixedTone,
+        toneDifference( [&]( int x, int y, int c ) { return inGamutFixed[( size_t( y ) * width + x ) * pixelInc + c] / 255.0f; },
+            [&]( int x, int y, int c ) { return expected[( size_t( y ) * width + x ) * pixelInc + c]; }, width, height ) );
+    if( digests ) {
+        char line[160];
+        std::snprintf( line, sizeof( line ), "%s %dx%d%s 8-bit %016llx", algorithm.name, width, height, input->hasAlpha() ? " alpha" : "",
+            static_cast<unsigned long long>( digest( fixed.data(), fixed.size() ) ) );
+        digests->push_back( line );
+    }
+}
+
+// Seeded stripes on a 512 x 512 gradient, the case user-facing seams show up on first.
+// Holds the row-by-row Ditherer with Options::luminance() to the float function with it,
+// with and without alpha.
+bool checkLuminanceStream( std::mt19937 &random )
+{
+    bool passed = true;
+    const std::pair<const char *, Kernel> kernels[] = { { "FloydSteinberg", Kernel::FloydSteinberg }, { "Stucki", Kernel::Stucki }, { "Atkinson", Kernel::Atkinson } };
+    for( const auto &[name, kernel] : kernels ) {
+        size_t differences = 0;
+        for( bool alpha : { false, true } ) {
+            const golden::Surface32fRef input = makeInput( "random", 200, 150, alpha, random );
+            const int pixelInc = input->getPixelInc();
+            auto expected = golden::Surface32f::create( 200, 150, alpha );
+            diffuse( kernel, viewOf( input ), viewOf( expected ), false, Options().luminance() );
+
+            Ditherer ditherer( kernel, 200, false, alpha, Options().luminance() );
+            auto streamed = golden::Surface32f::create( 200, 150, alpha );
+            const size_t rowFloats = size_t( 200 ) * pixelInc;
+            for( int y = 0; y < 150; y++ ) {
+                ditherer.push( input->getData() + y * rowFloats );
+                ditherer.pull( streamed->getData() + y * rowFloats );
+            }
+            differences += countDifferences( streamed->getData(), expected->getData(), size_t( 200 ) * 150, pixelInc );
+        }
+        passed = passed && differences == 0;
+        std::printf( "luminance stream %-17s %zu differences: %s\n", name, differences, differences ? "FAILED" : "ok" );
+    }
+    return passed;
+}
+
+// Entry ( x, y ) of the N x N Bayer threshold matrix, built like DitherOrdered.cpp builds it.
+float bayerThreshold( int n, int x, int y )
+{
+    int index = 0;
+    // the corner of the whole matrix is the least significant digit
+    for( int half = 1; half < n; half *= 2 ) {
+        const int corner[2][2] = { { 0, 2 }, { 3, 1 } };
+        index = 4 * index + corner[( y / half ) % 2][( x / half ) % 2];
+    }
+    return ( index + 0.5f ) / ( n * n );
+}
+
+// Holds mono Bayer thresholding of packed RGBA input, which takes the SSE path, to the
+// same pixels in RGB, which doesn't, on pixels that sit exactly on their threshold or
+// one float step to either side, in gray and in colors whose channels sum to the tie.
+bool checkThresholdTies()
+{
+    const int width = 67, height = 64;
+    bool passed = true;
+    for( int n : { 2, 4, 8, 16 } ) {
+        std::vector<float> rgba( size_t( width ) * height * 4 ), rgb( size_t( width ) * height * 3 );
+        for( int y = 0; y < height; y++ ) {
+            for( int x = 0; x < width; x++ ) {
+                const float t = bayerThreshold( n, x, y );
+                const float d = 1.0f / 1024.0f;
+                float color[3] = { t, t, t };
+                const int kind = ( x + 2 * y ) % 5;
+                if( kind == 1 || kind == 2 ) {
+                    color[0] = color[1] = color[2] = std::nextafter( t, kind == 1 ? 0.0f : 1.0f );
+                }
+                else if( kind == 3 ) {
+                    color[0] = t - d;
+                    color[2] = t + d;
+                }
+                else if( kind == 4 ) {
+                    color[0] = t + d;
+                    color[1] = t - d;
+                }
+                const size_t i = size_t( y ) * width + x;
+                std::copy( color, color + 3, &rgba[i * 4] );
+                rgba[i * 4 + 3] = 1.0f;
+                std::copy( color, color + 3, &rgb[i * 3] );
+            }
+        }
+
+        std::vector<float> packedOut( rgba.size() ), unpackedOut( rgb.size() );
+        const ImageView32f packed( rgba.data(), width, height, width * 4 * sizeof( float ), ChannelOrder::RGBA );
+        const ImageView32f unpacked( rgb.data(), width, height, width * 3 * sizeof( float ), ChannelOrder::RGB );
+        bayer( n, packed, ImageView32f( packedOut.data(), width, height, width * 4 * sizeof( float ), ChannelOrder::RGBA ), false );
+        bayer( n, unpacked, ImageView32f( unpackedOut.data(), width, height, width * 3 * sizeof( float ), ChannelOrder::RGB ), false );
+        Bitmap packedBits( width, height ), unpackedBits( width, height );
+        bayer( n, packed, packedBits );
+        bayer( n, unpacked, unpackedBits );
+
+        size_t differences = 0;
+        for( size_t i = 0; i < size_t( width ) * height; i++ ) {
+            const int x = int( i % width ), y = int( i / width );
+            differences += std::memcmp( &packedOut[i * 4], &unpackedOut[i * 3], 3 * sizeof( float ) ) != 0
+                || packedBits.isWhite( x, y ) != unpackedBits.isWhite( x, y ) || packedBits.isWhite( x, y ) != ( unpackedOut[i * 3] == 1.0f );
+        }
+        passed = passed && differences == 0;
+        std::printf( "threshold ties bayer %-2d RGBA against RGB, float and bits: %zu differences: %s\n", n, differences, differences ? "FAILED" : "ok" );
+    }
+    return passed;
+}
+
+bool checkSeams()
+{
+    auto input = golden::Surface32f::create( 512, 512, true );
+    for( int y = 0; y < 512; y++ ) {
+        for( int x = 0; x < 512; x++ ) {
+            const float v = x / 512.0f;
+            input->setPixel( golden::ivec2( x, y ), golden::ColorA( v, v * 0.8f, y / 512.0f, 1.0f ) );
+        }
+    }
+
+    bool passed = true;
+    for( Kernel kernel : { Kernel::FloydSteinberg, Kernel::Stucki } ) {
+        auto serial = golden::Surface32f::create( 512, 512, true );
+        auto unseeded = golden::Surface32f::create( 512, 512, true );
+        auto seeded = golden::Surface32f::create( 512, 512, true );
+        diffuse( kernel, viewOf( input ), viewOf( serial ), false );
+        diffuse( kernel, viewOf( input ), viewOf( unseeded ), false, Options().stripes( 64, 0 ).threads( 3 ) );
+        diffuse( kernel, viewOf( input ), viewOf( seeded ), false, Options().stripes( 64, 16 ).threads( 3 ) );
+        const float serialRatio = seamVisibility( viewOf( input ), viewOf( serial ), 64 );
+        const float unseededRatio = seamVisibility( viewOf( input ), viewOf( unseeded ), 64 );
+        const float seededRatio = seamVisibility( viewOf( input ), viewOf( seeded ), 64 );
+        const bool ok = seededRatio <= unseededRatio && seededRatio <= kSeamBound;
+        passed = passed && ok;
+        std::printf( "seams %-17s serial %.3f, 64-row stripes unseeded %.3f, with 16 seed rows %.3f, bound %.2f: %s\n",
+            kernel == Kernel::FloydSteinberg ? "FloydSteinberg" : "Stucki", serialRatio, unseededRatio, seededRatio, kSeamBound, ok ? "ok" : "FAILED" );
+    }
+    return passed;
+}
+
+}
+
+int main( int argc, char **argv )
+{
+    const bool printDigests = argc > 1 && std::strcmp( argv[1], "--digests" ) == 0;
+
+    Results results;
+    std::vector<std::string> digests;
+    std::mt19937 random( 1 );
+    for( const auto &size : kSizes ) {
+        for( const char *content : kContents ) {
+            for( bool alpha : { false, true } ) {
+                const golden::Surface32fRef input = makeInput( content, size[0], size[1], alpha, random );
+                for( size_t i = 0; i < sizeof( kAlgorithms ) / sizeof( kAlgorithms[0] ); i++ ) {
+                    runChecks( i, input, &results, printDigests ? &digests : nullptr );
+                }
+            }
+        }
+    }
+
+    if( printDigests ) {
+        for( const std::string &line : digests ) {
+            std::printf( "%s\n", line.c_str() );
+        }
+        return 0;
+    }
+
+    bool passed = true;
+    std::printf( "%-21s", "algorithm" );
+    for( const char *name : kCheckNames ) {
+        std::printf( " %10s", name );
+    }
+    std::printf( "\n" );
+    for( size_t i = 0; i < sizeof( kAlgorithms ) / sizeof( kAlgorithms[0] ); i++ ) {
+        std::printf( "%-21s", kAlgorithms[i].name );
+        for( int check = 0; check < CheckCount; check++ ) {
+            const double value = results.values[i][check];
+            if( ! results.applies[i][check] ) {
+                std::printf( " %10s", "-" );
+            }
+            else if( check == FixedTone ) {
+                std::printf( " %10.3f", value );
+                passed = passed && value <= kToneBound;
+            }
+            else {
+                std::printf( " %10.0f", value );
+                passed = passed && value == 0.0;
+            }
+        }
+        std::printf( "\n" );
+    }
+    std::printf( "8-bit tone bound %.3f\n", kToneBound );
+
+    passed = checkLuminanceStream( random ) && passed;
+    passed = checkThresholdTies() && passed;
+    passed = checkSeams() && passed;
+    std::printf( passed ? "PASS\n" : "FAIL\n" );
+    return passed ? 0 : 1;
+}
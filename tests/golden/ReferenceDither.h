@@ -0,0 +1,28 @@
+#pragma once
+
+// The frozen reference implementations, see ReferenceDither.cpp.
+
+#include "GoldenSurface.h"
+
+namespace reza {
+namespace dither_reference {
+golden::Surface32fRef linear( golden::Surface32fRef input );
+golden::Surface32fRef linearRGB( golden::Surface32fRef input );
+golden::Surface32fRef FloydSteinberg( golden::Surface32fRef input );
+golden::Surface32fRef FloydSteinbergRGB( golden::Surface32fRef input );
+golden::Surface32fRef JarvisJudiceNinke( golden::Surface32fRef input );
+golden::Surface32fRef JarvisJudiceNinkeRGB( golden::Surface32fRef input );
+golden::Surface32fRef Stucki( golden::Surface32fRef input );
+golden::Surface32fRef StuckiRGB( golden::Surface32fRef input );
+golden::Surface32fRef Atkinson( golden::Surface32fRef input );
+golden::Surface32fRef AtkinsonRGB( golden::Surface32fRef input );
+golden::Surface32fRef Burkes( golden::Surface32fRef input );
+golden::Surface32fRef BurkesRGB( golden::Surface32fRef input );
+golden::Surface32fRef Sierra( golden::Surface32fRef input );
+golden::Surface32fRef SierraRGB( golden::Surface32fRef input );
+golden::Surface32fRef TwoRowSierra( golden::Surface32fRef input );
+golden::Surface32fRef TwoRowSierraRGB( golden::Surface32fRef input );
+golden::Surface32fRef SierraLite( golden::Surface32fRef input );
+golden::Surface32fRef SierraLiteRGB( golden::Surface32fRef input );
+}
+}
@@ -0,0 +1,126 @@
+// Worker pool test: checks that Pool::run waits for its indices by running only those,
+// never another queued task, so that a task may hold a lock across parallel::run while
+// other tasks wait for that lock. Build it from the block's root like the golden test:
+//
+//     g++ -std=c++17 -O2 -Iinclude -Isrc tests/pool/PoolTest.cpp $( ls src/*.cpp | grep -v -e Cinder -e Batch ) -lpthread -o pool
+//
+// ./pool prints each check and exits with 1 if any fails. A pool that runs other tasks
+// while it waits deadlocks instead, which ctest reports as a timeout:
+//  - locked run   tasks that hold a lock across parallel::run, queued among tasks that
+//                 take the same lock; none of the latter may run under the lock
+//  - every index  nested parallel::run calls cover each of their indices exactly once
+//  - table build  batch-like tasks that build shared palette tables through
+//                 paletteTable(), which builds on the pool while the tasks asking for the
+//                 same table wait for it
+
+#include "DitherPalette.h"
+#include "DitherParallel.h"
+#include "DitherPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace reza::dither;
+
+namespace {
+
+const size_t kThreads = 4;
+const size_t kTasks = 64;
+const size_t kIndices = 16;
+
+bool lockedRun()
+{
+    std::mutex mutex;
+    // the thread holding mutex, to tell a re-entered task from one that waits its turn
+    std::atomic<std::thread::id> holder{ std::thread::id() };
+    std::atomic<size_t> reentered( 0 ), indices( 0 );
+    {
+        detail::Pool pool( kThreads );
+        for( size_t i = 0; i < kTasks; i++ ) {
+            pool.submit( [&, i] {
+                if( holder.load() == std::this_thread::get_id() ) {
+                    reentered++;
+                    return;
+                }
+                std::lock_guard<std::mutex> lock( mutex );
+                holder = std::this_thread::get_id();
+                if( i % 2 == 0 ) {
+                    // long enough for the other workers to take some of the indices, leaving this one to wait
+                    parallel::run( kIndices, [&]( size_t ) {
+                        std::this_thread::sleep_for( std::chrono::microseconds( 500 ) );
+                        indices++;
+                    } );
+                }
+                holder = std::thread::id();
+            } );
+        }
+    }
+    const bool passed = reentered == 0 && indices == kTasks / 2 * kIndices;
+    std::printf( "locked run   %s ( %zu re-entered, %zu of %zu indices )\n", passed ? "ok" : "FAILED", reentered.load(),
+        indices.load(), kTasks / 2 * kIndices );
+    return passed;
+}
+
+bool everyIndex()
+{
+    std::vector<std::atomic<int>> counts( kTasks * kIndices * kIndices );
+    {
+        detail::Pool pool( kThreads );
+        for( size_t task = 0; task < kTasks; task++ ) {
+            pool.submit( [&, task] {
+                parallel::run( kIndices, [&]( size_t outer ) {
+                    parallel::run( kIndices, [&]( size_t inner ) { counts[( task * kIndices + outer ) * kIndices + inner]++; } );
+                } );
+            } );
+        }
+    }
+    size_t wrong = 0;
+    for( const auto &count : counts ) {
+        wrong += count != 1;
+    }
+    std::printf( "every index  %s ( %zu of %zu indices not run once )\n", wrong ? "FAILED" : "ok", wrong, counts.size() );
+    return wrong == 0;
+}
+
+bool tableBuild()
+{
+    // a few palettes shared between many tasks, so that most tasks wait for a build in progress
+    const size_t palettes = 3;
+    std::mt19937 random( 1 );
+    std::uniform_real_distribution<float> channel( 0.0f, 1.0f );
+    std::vector<std::vector<PaletteColor>> colors( palettes );
+    for( auto &palette : colors ) {
+        for( int i = 0; i < 48; i++ ) {
+            palette.push_back( PaletteColor( channel( random ), channel( random ), channel( random ) ) );
+        }
+    }
+
+    std::vector<std::shared_ptr<const detail::PaletteTable>> tables( kTasks );
+    {
+        detail::Pool pool( kThreads );
+        for( size_t i = 0; i < kTasks; i++ ) {
+            pool.submit( [&, i] { tables[i] = detail::paletteTable( colors[i % palettes], 32, kThreads ); } );
+        }
+    }
+    size_t wrong = 0;
+    for( size_t i = 0; i < kTasks; i++ ) {
+        wrong += ! tables[i] || tables[i] != tables[i % palettes];
+    }
+    std::printf( "table build  %s ( %zu of %zu tasks without the shared table )\n", wrong ? "FAILED" : "ok", wrong, kTasks );
+    return wrong == 0;
+}
+
+}
+
+int main()
+{
+    bool passed = lockedRun();
+    passed = everyIndex() && passed;
+    passed = tableBuild() && passed;
+    return passed ? 0 : 1;
+}
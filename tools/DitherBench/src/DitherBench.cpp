@@ -0,0 +1,618 @@
+// Times every entry point of the library over a grid of image sizes, contents, channel
+// counts and thread counts, and prints the results as JSON:
+//
+//     DitherBench [options] [-o <file>]
+//
+// The float and 8-bit functions run with every kernel. The other entry points run with
+// Floyd-Steinberg, since the kernel only changes the diffusion they share:
+//  - luminance, bitmap and indexed output
+//  - palette output, searched directly and through a palette table
+//  - striped diffusion
+//  - the row-by-row Ditherer
+//  - VideoDitherer frames that change one band
+// Bayer and blue-noise dithering and palette building are timed as well. So are the
+// block's original getPixel() / setPixel() loops, frozen in tests/golden, single
+// threaded as they always were: the JSON ends with how much faster the row-pointer
+// functions are than them at every size and content. Like the original functions,
+// they allocate their output on every run.
+//
+// Each case is run once untimed, which builds any mask or table it needs and records
+// the process's peak resident memory, then repeated for at least the minimum time. The
+// median run gives the megapixels per second and nanoseconds per pixel. Heap
+// allocations are counted over the timed runs and reported per run, so scratch that is
+// reused shows up as none.
+//
+// The defaults sweep 256 x 256 to 7680 x 4320, which takes a while and needs up to
+// 2.5 GB at the largest size; -q keeps to the two smallest sizes. Progress goes to stderr.
+//
+// The tool is headless and needs no Cinder: compile this file and
+// tests/golden/ReferenceDither.cpp with the block's src/*.cpp except DitherCinder.cpp
+// and DitherBatch.cpp, and include/, src/ and tests/golden/ on the include path.
+
+#include "DitherCore.h"
+#include "DitherSimd.h"
+#include "DitherVideo.h"
+#include "ReferenceDither.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined( __linux__ ) || defined( __APPLE__ )
+#include <sys/resource.h>
+#endif
+
+using namespace reza::dither;
+
+namespace {
+
+std::atomic<size_t> sAllocations{ 0 };
+std::atomic<size_t> sAllocatedBytes{ 0 };
+
+}
+
+// Counts every heap allocation, the library's included. GCC inlines the replacement
+// delete into each delete expression and then mistakes its free() for a mismatch.
+#if defined( __GNUC__ ) && ! defined( __clang__ ) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new( size_t size )
+{
+    sAllocations.fetch_add( 1, std::memory_order_relaxed );
+    sAllocatedBytes.fetch_add( size, std::memory_order_relaxed );
+    if( void *pointer = std::malloc( size ? size : 1 ) ) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete( void *pointer ) noexcept
+{
+    std::free( pointer );
+}
+
+void operator delete( void *pointer, size_t ) noexcept
+{
+    std::free( pointer );
+}
+
+namespace {
+
+typedef golden::Surface32fRef ( *AccessorFunction )( golden::Surface32fRef input );
+
+namespace ref = reza::dither_reference;
+
+const struct {
+    const char *name;
+    Kernel kernel;
+    //! The original accessor loops to black and white and to red, green, blue and black.
+    AccessorFunction accessor, accessorRGB;
+} kKernels[] = {
+    { "linear", Kernel::Linear, ref::linear, ref::linearRGB },
+    { "FloydSteinberg", Kernel::FloydSteinberg, ref::FloydSteinberg, ref::FloydSteinbergRGB },
+    { "JarvisJudiceNinke", Kernel::JarvisJudiceNinke, ref::JarvisJudiceNinke, ref::JarvisJudiceNinkeRGB },
+    { "Stucki", Kernel::Stucki, ref::Stucki, ref::StuckiRGB },
+    { "Atkinson", Kernel::Atkinson, ref::Atkinson, ref::AtkinsonRGB },
+    { "Burkes", Kernel::Burkes, ref::Burkes, ref::BurkesRGB },
+    { "Sierra", Kernel::Sierra, ref::Sierra, ref::SierraRGB },
+    { "TwoRowSierra", Kernel::TwoRowSierra, ref::TwoRowSierra, ref::TwoRowSierraRGB },
+    { "SierraLite", Kernel::SierraLite, ref::SierraLite, ref::SierraLiteRGB },
+};
+
+const char *const kAccessorPrefix = "accessor/";
+
+const char *const kContents[] = { "gradient", "noise", "photo", "flat" };
+
+struct Settings {
+    std::vector<std::pair<int, int>> sizes = { { 256, 256 }, { 1024, 1024 }, { 1920, 1080 }, { 3840, 2160 }, { 7680, 4320 } };
+    std::vector<std::string> contents = { "gradient", "noise", "photo", "flat" };
+    std::vector<int> channels = { 3, 4 };
+    //! Thread counts, 0 for every hardware thread.
+    std::vector<size_t> threads = { 1, 0 };
+    //! Runs only the entries whose name contains this.
+    std::string filter;
+    double minSeconds = 0.25;
+    std::string output;
+};
+
+// A test image, as packed floats and as the same pixels rounded to bytes.
+struct Image {
+    int width = 0, height = 0, channels = 0;
+    std::vector<float> pixels;
+    std::vector<uint8_t> bytes;
+
+    ChannelOrder getOrder() const { return channels == 4 ? ChannelOrder::RGBA : ChannelOrder::RGB; }
+    size_t getPixelCount() const { return size_t( width ) * height; }
+    ImageView32f view( float *data ) const { return ImageView32f( data, width, height, ptrdiff_t( width ) * channels * sizeof( float ), getOrder() ); }
+    ImageView8u view( uint8_t *data ) const { return ImageView8u( data, width, height, ptrdiff_t( width ) * channels, getOrder() ); }
+};
+
+Image makeImage( const std::string &content, int width, int height, int channels )
+{
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.channels = channels;
+    image.pixels.resize( image.getPixelCount() * channels );
+
+    std::mt19937 random( 1 );
+    std::uniform_real_distribution<float> unit( 0.0f, 1.0f );
+    // hard-edged discs of a synthetic photograph, in image-relative units
+    const float discs[][6] = { { 0.3f, 0.4f, 0.12f, 0.9f, 0.8f, 0.2f }, { 0.7f, 0.6f, 0.2f, 0.1f, 0.3f, 0.6f }, { 0.55f, 0.2f, 0.08f, 0.8f, 0.1f, 0.1f },
+        { 0.15f, 0.8f, 0.1f, 0.95f, 0.95f, 0.9f } };
+    for( int y = 0; y < height; y++ ) {
+        for( int x = 0; x < width; x++ ) {
+            const float u = float( x ) / width, v = float( y ) / height;
+            float color[3] = { 0.5f, 0.5f, 0.5f };
+            if( content == "gradient" ) {
+                color[0] = u;
+                color[1] = v;
+                color[2] = 1.0f - ( u + v ) * 0.5f;
+            }
+            else if( content == "noise" ) {
+                color[0] = unit( random );
+                color[1] = unit( random );
+                color[2] = unit( random );
+            }
+            else if( content == "photo" ) {
+                // smooth shading, hard edges and fine grain
+                color[0] = 0.5f + 0.25f * std::sin( 6.3f * u + 1.7f * v ) + 0.1f * std::cos( 9.1f * v );
+                color[1] = 0.45f + 0.3f * std::sin( 4.1f * v - 2.3f * u );
+                color[2] = 0.4f + 0.3f * std::cos( 5.3f * u * v * 3.0f );
+                for( const float *disc : discs ) {
+                    const float dx = ( u - disc[0] ) * width / height, dy = v - disc[1];
+                    if( dx * dx + dy * dy < disc[2] * disc[2] ) {
+                        const float shade = 1.0f - 0.4f * std::sqrt( dx * dx + dy * dy ) / disc[2];
+                        for( int c = 0; c < 3; c++ ) {
+                            color[c] = disc[3 + c] * shade;
+                        }
+                    }
+                }
+                for( float &channel : color ) {
+                    channel = std::min( std::max( channel + ( unit( random ) - 0.5f ) * 0.04f, 0.0f ), 1.0f );
+                }
+            }
+            float *pixel = &image.pixels[( size_t( y ) * width + x ) * channels];
+            std::copy( color, color + 3, pixel );
+            if( channels == 4 ) {
+                pixel[3] = 1.0f;
+            }
+        }
+    }
+
+    image.bytes.resize( image.pixels.size() );
+    for( size_t i = 0; i < image.pixels.size(); i++ ) {
+        image.bytes[i] = static_cast<uint8_t>( std::lround( image.pixels[i] * 255.0f ) );
+    }
+    return image;
+}
+
+// Sets up a case outside the timing, e.g. allocating its output, and returns the work
+// to time, or nothing to skip the case.
+typedef std::function<std::function<void()>( Image &image, const Options &options )> Prepare;
+
+struct Entry {
+    std::string name;
+    Prepare prepare;
+};
+
+std::shared_ptr<std::vector<float>> floatOutput( const Image &image )
+{
+    return std::make_shared<std::vector<float>>( image.pixels.size() );
+}
+
+std::vector<Entry> listEntries()
+{
+    std::vector<Entry> entries;
+    for( const auto &kernel : kKernels ) {
+        for( bool rgb : { false, true } ) {
+            const std::string name = std::string( kernel.name ) + ( rgb ? "RGB" : "" );
+            const Kernel k = kernel.kernel;
+            entries.push_back( { name, [k, rgb]( Image &image, const Options &options ) -> std::function<void()> {
+                                    auto output = floatOutput( image );
+                                    return [&image, output, k, rgb, options] { diffuse( k, image.view( image.pixels.data() ), image.view( output->data() ), rgb, options ); };
+                                } } );
+            entries.push_back( { "8-bit/" + name, [k, rgb]( Image &image, const Options &options ) -> std::function<void()> {
+                                    auto output = std::make_shared<std::vector<uint8_t>>( image.bytes.size() );
+                                    return [&image, output, k, rgb, options] { diffuse( k, image.view( image.bytes.data() ), image.view( output->data() ), rgb, options ); };
+                                } } );
+            const AccessorFunction accessor = rgb ? kernel.accessorRGB : kernel.accessor;
+            entries.push_back( { kAccessorPrefix + name, [accessor]( Image &image, const Options &options ) -> std::function<void()> {
+                                    if( options.getThreads() != 1 ) {
+                                        return nullptr;
+                                    }
+                                    auto input = golden::Surface32f::create( image.width, image.height, image.channels == 4 );
+                                    std::copy( image.pixels.begin(), image.pixels.end(), input->getData() );
+                                    return [input, accessor] { accessor( input ); };
+                                } } );
+        }
+    }
+
+    const Kernel fs = Kernel::FloydSteinberg;
+    entries.push_back( { "luminance/FloydSteinberg", [fs]( Image &image, const Options &options ) -> std::function<void()> {
+                            auto output = floatOutput( image );
+                            return [&image, output, fs, options] {
+                                diffuse( fs, image.view( image.pixels.data() ), image.view( output->data() ), false, Options( options ).luminance() );
+                            };
+                        } } );
+    entries.push_back( { "bitmap/FloydSteinberg", [fs]( Image &image, const Options &options ) -> std::function<void()> {
+                            auto output = std::make_shared<Bitmap>( image.width, image.height );
+                            return [&image, output, fs, options] { diffuse( fs, image.view( image.pixels.data() ), *output, options ); };
+                        } } );
+    entries.push_back( { "indexed/FloydSteinbergRGB", [fs]( Image &image, const Options &options ) -> std::function<void()> {
+                            auto output = std::make_shared<IndexedImage>( image.width, image.height );
+                            return [&image, output, fs, options] { diffuse( fs, image.view( image.pixels.data() ), *output, options ); };
+                        } } );
+    for( int resolution : { 0, 32 } ) {
+        entries.push_back( { resolution ? "palette16-table/FloydSteinberg" : "palette16/FloydSteinberg",
+            [fs, resolution]( Image &image, const Options &options ) -> std::function<void()> {
+                auto output = floatOutput( image );
+                const Palette palette = buildPalette( image.view( image.pixels.data() ), 16 );
+                const Options paletteOptions = Options( options ).paletteTable( resolution );
+                return [&image, output, fs, palette, paletteOptions] {
+                    diffuse( fs, image.view( image.pixels.data() ), image.view( output->data() ), palette, paletteOptions );
+                };
+            } } );
+    }
+    entries.push_back( { "stripes/FloydSteinberg", [fs]( Image &image, const Options &options ) -> std::function<void()> {
+                            auto output = floatOutput( image );
+                            return [&image, output, fs, options] {
+                                diffuse( fs, image.view( image.pixels.data() ), image.view( output->data() ), false, Options( options ).stripes( 64 ) );
+                            };
+                        } } );
+    entries.push_back( { "stream/FloydSteinberg", [fs]( Image &image, const Options & ) -> std::function<void()> {
+                            auto output = floatOutput( image );
+                            auto ditherer = std::make_shared<Ditherer>( fs, image.width, false, image.channels == 4 );
+                            return [&image, output, ditherer] {
+                                const size_t rowFloats = size_t( image.width ) * image.channels;
+                                ditherer->reset();
+                                for( int y = 0; y < image.height; y++ ) {
+                                    ditherer->process( image.pixels.data() + y * rowFloats, output->data() + y * rowFloats );
+                                }
+                            };
+                        } } );
+    entries.push_back( { "video/FloydSteinberg", [fs]( Image &image, const Options &options ) -> std::function<void()> {
+                            // each frame flips a pixel in the middle band, so one band and the rows it settles over
+                            // are dithered again
+                            auto output = floatOutput( image );
+                            auto frame = std::make_shared<std::vector<float>>( image.pixels );
+                            std::shared_ptr<detail::FrameDitherer> engine = detail::makeFrameDitherer( fs, false, options );
+                            engine->dither( image.view( frame->data() ), image.view( output->data() ) );
+                            return [&image, output, frame, engine] {
+                                float &channel = ( *frame )[( size_t( image.height / 2 ) * image.width + image.width / 2 ) * image.channels];
+                                channel = 1.0f - channel;
+                                engine->dither( image.view( frame->data() ), image.view( output->data() ) );
+                            };
+                        } } );
+
+    for( int size : { 2, 4, 8, 16 } ) {
+        for( bool rgb : { false, true } ) {
+            entries.push_back( { "Bayer" + std::to_string( size ) + ( rgb ? "RGB" : "" ), [size, rgb]( Image &image, const Options &options ) -> std::function<void()> {
+                                    auto output = floatOutput( image );
+                                    return [&image, output, size, rgb, options] { bayer( size, image.view( image.pixels.data() ), image.view( output->data() ), rgb, options ); };
+                                } } );
+        }
+    }
+    entries.push_back( { "bitmap/Bayer8", []( Image &image, const Options &options ) -> std::function<void()> {
+                            auto output = std::make_shared<Bitmap>( image.width, image.height );
+                            return [&image, output, options] { bayer( 8, image.view( image.pixels.data() ), *output, options ); };
+                        } } );
+    for( bool rgb : { false, true } ) {
+        entries.push_back( { rgb ? "BlueNoiseRGB" : "BlueNoise", [rgb]( Image &image, const Options &options ) -> std::function<void()> {
+                                auto output = floatOutput( image );
+                                return [&image, output, rgb, options] { blueNoise( image.view( image.pixels.data() ), image.view( output->data() ), rgb, options ); };
+                            } } );
+    }
+
+    entries.push_back( { "buildPalette16", []( Image &image, const Options &options ) -> std::function<void()> {
+                            return [&image, options] { buildPalette( image.view( image.pixels.data() ), 16, options ); };
+                        } } );
+    entries.push_back( { "8-bit/buildPalette16", []( Image &image, const Options &options ) -> std::function<void()> {
+                            return [&image, options] { buildPalette( image.view( image.bytes.data() ), 16, options ); };
+                        } } );
+    return entries;
+}
+
+// Forgets the process's peak resident memory so far, where the platform allows it.
+// Returns false if peakResidentBytes() will report the peak since the start instead.
+bool resetPeakResident()
+{
+#if defined( __linux__ )
+    if( FILE *file = std::fopen( "/proc/self/clear_refs", "w" ) ) {
+        const bool reset = std::fputs( "5", file ) >= 0;
+        return std::fclose( file ) == 0 && reset;
+    }
+#endif
+    return false;
+}
+
+// Returns the peak resident memory in bytes, or -1 where it can't be read.
+long long peakResidentBytes()
+{
+#if defined( __linux__ )
+    if( FILE *file = std::fopen( "/proc/self/status", "r" ) ) {
+        char line[256];
+        long long kilobytes = -1;
+        while( std::fgets( line, sizeof( line ), file ) ) {
+            if( std::sscanf( line, "VmHWM: %lld kB", &kilobytes ) == 1 ) {
+                break;
+            }
+        }
+        std::fclose( file );
+        if( kilobytes >= 0 ) {
+            return kilobytes * 1024;
+        }
+    }
+#endif
+#if defined( __linux__ ) || defined( __APPLE__ )
+    rusage usage;
+    if( getrusage( RUSAGE_SELF, &usage ) == 0 ) {
+#if defined( __APPLE__ )
+        return static_cast<long long>( usage.ru_maxrss );
+#else
+        return static_cast<long long>( usage.ru_maxrss ) * 1024;
+#endif
+    }
+#endif
+    return -1;
+}
+
+struct Measurement {
+    size_t runs = 0;
+    double medianSeconds = 0.0;
+    double minSeconds = 0.0;
+    double allocationsPerRun = 0.0;
+    double allocatedBytesPerRun = 0.0;
+    long long peakResidentBytes = -1;
+    //! Whether the peak is the case's own rather than the process's since it started.
+    bool peakIsReset = false;
+};
+
+// A case's median time, kept to compare entries once every case has run.
+struct Timing {
+    std::string entry;
+    int width, height;
+    std::string content;
+    int channels;
+    size_t threads;
+    double medianSeconds;
+};
+
+Measurement measure( const std::function<void()> &task, double minSeconds )
+{
+    typedef std::chrono::steady_clock Clock;
+    Measurement measurement;
+    measurement.peakIsReset = resetPeakResident();
+    task();
+    measurement.peakResidentBytes = peakResidentBytes();
+
+    std::vector<double> times;
+    size_t allocations = 0, allocatedBytes = 0;
+    // at least the minimum time, and three runs unless one takes longer than that alone
+    const Clock::time_point start = Clock::now();
+    double elapsed = 0.0;
+    do {
+        const size_t allocationsBefore = sAllocations.load();
+        const size_t allocatedBytesBefore = sAllocatedBytes.load();
+        const Clock::time_point begin = Clock::now();
+        task();
+        const Clock::time_point end = Clock::now();
+        allocations += sAllocations.load() - allocationsBefore;
+        allocatedBytes += sAllocatedBytes.load() - allocatedBytesBefore;
+        times.push_back( std::chrono::duration<double>( end - begin ).count() );
+        elapsed = std::chrono::duration<double>( Clock::now() - start ).count();
+    } while( elapsed < minSeconds || ( times.size() < 3 && times.front() < minSeconds ) );
+
+    measurement.runs = times.size();
+    measurement.allocationsPerRun = double( allocations ) / times.size();
+    measurement.allocatedBytesPerRun = double( allocatedBytes ) / times.size();
+    std::sort( times.begin(), times.end() );
+    measurement.medianSeconds = times[times.size() / 2];
+    measurement.minSeconds = times.front();
+    return measurement;
+}
+
+void printUsage()
+{
+    std::fprintf( stderr,
+        "usage: DitherBench [options]\n"
+        "\n"
+        "  -s <sizes>       comma-separated WxH sizes, defaults to 256x256,1024x1024,1920x1080,3840x2160,7680x4320\n"
+        "  -c <contents>    any of gradient,noise,photo,flat, defaults to all\n"
+        "  -n <channels>    3 for RGB, 4 for RGBA, defaults to 3,4\n"
+        "  -t <threads>     thread counts, 0 for every hardware thread, defaults to 1,0\n"
+        "  -e <filter>      runs only the entries whose name contains this\n"
+        "  -m <seconds>     least time to repeat each case for, defaults to 0.25\n"
+        "  -q               quick: only 256x256 and 1024x1024\n"
+        "  -o <file>        writes the JSON there instead of to stdout\n"
+        "\n"
+        "entries:" );
+    for( const Entry &entry : listEntries() ) {
+        std::fprintf( stderr, " %s", entry.name.c_str() );
+    }
+    std::fprintf( stderr, "\n" );
+}
+
+std::vector<std::string> split( const std::string &list )
+{
+    std::vector<std::string> items;
+    size_t begin = 0;
+    while( begin <= list.size() ) {
+        const size_t end = std::min( list.find( ',', begin ), list.size() );
+        if( end > begin ) {
+            items.push_back( list.substr( begin, end - begin ) );
+        }
+        begin = end + 1;
+    }
+    return items;
+}
+
+bool parseArguments( int argc, char **argv, Settings *settings )
+{
+    for( int i = 1; i < argc; i++ ) {
+        const std::string argument = argv[i];
+        if( argument == "-q" ) {
+            settings->sizes = { { 256, 256 }, { 1024, 1024 } };
+            continue;
+        }
+        if( argument.size() != 2 || argument[0] != '-' ) {
+            std::fprintf( stderr, "unexpected argument %s\n", argument.c_str() );
+            return false;
+        }
+        if( i + 1 == argc ) {
+            std::fprintf( stderr, "%s needs a value\n", argument.c_str() );
+            return false;
+        }
+        const std::string value = argv[++i];
+        switch( argument[1] ) {
+            case 's':
+                settings->sizes.clear();
+                for( const std::string &size : split( value ) ) {
+                    int width = 0, height = 0;
+                    if( std::sscanf( size.c_str(), "%dx%d", &width, &height ) != 2 || width <= 0 || height <= 0 ) {
+                        std::fprintf( stderr, "bad size %s\n", size.c_str() );
+                        return false;
+                    }
+                    settings->sizes.emplace_back( width, height );
+                }
+                break;
+            case 'c':
+                settings->contents = split( value );
+                for( const std::string &content : settings->contents ) {
+                    if( std::find( std::begin( kContents ), std::end( kContents ), content ) == std::end( kContents ) ) {
+                        std::fprintf( stderr, "unknown content %s\n", content.c_str() );
+                        return false;
+                    }
+                }
+                break;
+            case 'n':
+                settings->channels.clear();
+                for( const std::string &count : split( value ) ) {
+                    const int channels = std::atoi( count.c_str() );
+                    if( channels != 3 && channels != 4 ) {
+                        std::fprintf( stderr, "channels must be 3 or 4\n" );
+                        return false;
+                    }
+                    settings->channels.push_back( channels );
+                }
+                break;
+            case 't':
+                settings->threads.clear();
+                for( const std::string &count : split( value ) ) {
+                    settings->threads.push_back( static_cast<size_t>( std::max( std::atoi( count.c_str() ), 0 ) ) );
+                }
+                break;
+            case 'e': settings->filter = value; break;
+            case 'm': settings->minSeconds = std::max( std::atof( value.c_str() ), 0.0 ); break;
+            case 'o': settings->output = value; break;
+            default: std::fprintf( stderr, "unknown option %s\n", argument.c_str() ); return false;
+        }
+    }
+    return ! settings->sizes.empty() && ! settings->contents.empty() && ! settings->channels.empty() && ! settings->threads.empty();
+}
+
+}
+
+int main( int argc, char **argv )
+{
+    Settings settings;
+    if( ! parseArguments( argc, argv, &settings ) ) {
+        printUsage();
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if( ! settings.output.empty() ) {
+        out = std::fopen( settings.output.c_str(), "w" );
+        if( ! out ) {
+            std::fprintf( stderr, "can't write %s\n", settings.output.c_str() );
+            return 1;
+        }
+    }
+
+    std::vector<Entry> entries = listEntries();
+    entries.erase( std::remove_if( entries.begin(), entries.end(), [&]( const Entry &entry ) { return entry.name.find( settings.filter ) == std::string::npos; } ),
+        entries.end() );
+
+#if defined( REZA_DITHER_SSE2 )
+    const char *simd = "sse2";
+#else
+    const char *simd = "none";
+#endif
+    std::fprintf( out, "{\n  \"simd\": \"%s\",\n  \"hardwareThreads\": %u,\n  \"minSeconds\": %g,\n  \"cases\": [", simd, std::thread::hardware_concurrency(),
+        settings.minSeconds );
+    std::vector<Timing> timings;
+    bool first = true;
+    for( const auto &size : settings.sizes ) {
+        for( const std::string &content : settings.contents ) {
+            for( int channels : settings.channels ) {
+                Image image = makeImage( content, size.first, size.second, channels );
+                for( size_t threads : settings.threads ) {
+                    for( const Entry &entry : entries ) {
+                        Measurement measurement;
+                        {
+                            const std::function<void()> task = entry.prepare( image, Options().threads( threads ) );
+                            if( ! task ) {
+                                continue;
+                            }
+                            std::fprintf( stderr, "%s %dx%d %s %d channels %zu threads\n", entry.name.c_str(), image.width, image.height, content.c_str(),
+                                channels, threads );
+                            measurement = measure( task, settings.minSeconds );
+                        }
+                        timings.push_back( { entry.name, image.width, image.height, content, channels, threads, measurement.medianSeconds } );
+                        const double pixels = double( image.getPixelCount() );
+                        std::fprintf( out,
+                            "%s\n    { \"entry\": \"%s\", \"width\": %d, \"height\": %d, \"content\": \"%s\", \"channels\": %d, \"threads\": %zu, \"runs\": %zu, "
+                            "\"medianSeconds\": %.9f, \"minSeconds\": %.9f, \"mpixPerSecond\": %.3f, \"nsPerPixel\": %.4f, \"allocationsPerRun\": %.2f, "
+                            "\"allocatedBytesPerRun\": %.0f, \"peakResidentBytes\": %lld, \"peakIsPerCase\": %s }",
+                            first ? "" : ",", entry.name.c_str(), image.width, image.height, content.c_str(), channels, threads, measurement.runs,
+                            measurement.medianSeconds, measurement.minSeconds, pixels / measurement.medianSeconds * 1e-6, measurement.medianSeconds / pixels * 1e9,
+                            measurement.allocationsPerRun, measurement.allocatedBytesPerRun, measurement.peakResidentBytes,
+                            measurement.peakIsReset ? "true" : "false" );
+                        std::fflush( out );
+                        first = false;
+                    }
+                }
+            }
+        }
+    }
+    std::fprintf( out, "\n  ],\n  \"accessorComparison\": [" );
+    first = true;
+    for( const Timing &accessor : timings ) {
+        if( accessor.entry.compare( 0, std::strlen( kAccessorPrefix ), kAccessorPrefix ) != 0 ) {
+            continue;
+        }
+        const std::string name = accessor.entry.substr( std::strlen( kAccessorPrefix ) );
+        const auto rowPointer = std::find_if( timings.begin(), timings.end(), [&]( const Timing &timing ) {
+            return timing.entry == name && timing.width == accessor.width && timing.height == accessor.height && timing.content == accessor.content
+                && timing.channels == accessor.channels && timing.threads == accessor.threads;
+        } );
+        if( rowPointer == timings.end() ) {
+            continue;
+        }
+        std::fprintf( out,
+            "%s\n    { \"entry\": \"%s\", \"width\": %d, \"height\": %d, \"content\": \"%s\", \"channels\": %d, \"accessorSeconds\": %.9f, "
+            "\"rowPointerSeconds\": %.9f, \"speedup\": %.3f }",
+            first ? "" : ",", name.c_str(), accessor.width, accessor.height, accessor.content.c_str(), accessor.channels, accessor.medianSeconds,
+            rowPointer->medianSeconds, accessor.medianSeconds / rowPointer->medianSeconds );
+        first = false;
+    }
+    std::fprintf( out, "\n  ]\n}\n" );
+
+    if( out != stdout ) {
+        std::fclose( out );
+    }
+    return 0;
+}
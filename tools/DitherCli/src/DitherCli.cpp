@@ -0,0 +1,485 @@
+// Dithers whole directories and image sequences from the command line:
+//
+//     DitherCli [options] <input>... -o <directory>
+//
+// An input is an image file, a directory, whose images are taken in name order, or a
+// pattern with a single integer conversion such as frames/%04d.png, which numbers a
+// sequence from 0 or 1 until the first missing frame. Any other name with a % in it is
+// taken as it is. Every output is written to the output directory under its input's
+// name; inputs that would share an output, such as a.png and a.jpg, are refused.
+//
+// Images go through three stages joined by bounded queues: decoder threads load them,
+// a BatchDitherer dithers them, and encoder threads write them out. The queues hold a
+// few images per dithering thread, so memory stays bounded however many images there
+// are, and a slow disk and a slow algorithm overlap instead of adding up.
+//
+// The tool needs only Cinder's image I/O, not an app: the block's CMakeLists.txt builds
+// it as the DitherCli target when it finds Cinder.
+
+#include "Dither.h"
+
+#include "cinder/ImageIo.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ci;
+using namespace reza::dither;
+
+namespace {
+
+typedef void ( *DitherFunction )( Surface32fRef input, Surface32fRef output, const Options &options );
+typedef void ( *PaletteFunction )( Surface32fRef input, Surface32fRef output, const Palette &palette, const Options &options );
+
+struct Algorithm {
+    const char *name;
+    DitherFunction dither;
+    //! The version that dithers to a palette, if there is one.
+    PaletteFunction palette;
+};
+
+const Algorithm kAlgorithms[] = {
+    { "linear", linear, linear },
+    { "linearRGB", linearRGB, nullptr },
+    { "FloydSteinberg", FloydSteinberg, FloydSteinberg },
+    { "FloydSteinbergRGB", FloydSteinbergRGB, nullptr },
+    { "JarvisJudiceNinke", JarvisJudiceNinke, JarvisJudiceNinke },
+    { "JarvisJudiceNinkeRGB", JarvisJudiceNinkeRGB, nullptr },
+    { "Stucki", Stucki, Stucki },
+    { "StuckiRGB", StuckiRGB, nullptr },
+    { "Atkinson", Atkinson, Atkinson },
+    { "AtkinsonRGB", AtkinsonRGB, nullptr },
+    { "Burkes", Burkes, Burkes },
+    { "BurkesRGB", BurkesRGB, nullptr },
+    { "Sierra", Sierra, Sierra },
+    { "SierraRGB", SierraRGB, nullptr },
+    { "TwoRowSierra", TwoRowSierra, TwoRowSierra },
+    { "TwoRowSierraRGB", TwoRowSierraRGB, nullptr },
+    { "SierraLite", SierraLite, SierraLite },
+    { "SierraLiteRGB", SierraLiteRGB, nullptr },
+    { "Bayer2", Bayer2, nullptr },
+    { "Bayer2RGB", Bayer2RGB, nullptr },
+    { "Bayer4", Bayer4, nullptr },
+    { "Bayer4RGB", Bayer4RGB, nullptr },
+    { "Bayer8", Bayer8, nullptr },
+    { "Bayer8RGB", Bayer8RGB, nullptr },
+    { "Bayer16", Bayer16, nullptr },
+    { "Bayer16RGB", Bayer16RGB, nullptr },
+    { "BlueNoise", BlueNoise, nullptr },
+    { "BlueNoiseRGB", BlueNoiseRGB, nullptr },
+};
+
+const char *const kImageExtensions[] = { ".png", ".jpg", ".jpeg", ".tif", ".tiff", ".bmp", ".gif", ".tga" };
+
+struct Settings {
+    const Algorithm *algorithm = nullptr;
+    //! Dithers to a palette of this many colors built from each image, 0 for the algorithm's own colors.
+    int colors = 0;
+    //! The palette table resolution, see Options::paletteTable(); -1 picks 32 from 16 colors and none below.
+    int tableResolution = -1;
+    //! Dithering threads, 0 for every hardware thread.
+    size_t threads = 0;
+    std::string format = "png";
+    fs::path output;
+    std::vector<std::string> inputs;
+};
+
+struct Job {
+    fs::path input;
+    fs::path output;
+    Surface32fRef image;
+};
+
+// A first-in first-out queue that blocks pushes while it holds capacity items. close()
+// wakes every blocked pop once the queue has drained.
+template<typename T>
+class BoundedQueue {
+  public:
+    explicit BoundedQueue( size_t capacity )
+        : mCapacity( capacity )
+    {
+    }
+
+    void push( T item )
+    {
+        std::unique_lock<std::mutex> lock( mMutex );
+        mNotFull.wait( lock, [this] { return mItems.size() < mCapacity; } );
+        mItems.push_back( std::move( item ) );
+        mNotEmpty.notify_one();
+    }
+
+    //! Returns false once the queue is closed and empty.
+    bool pop( T *item )
+    {
+        std::unique_lock<std::mutex> lock( mMutex );
+        mNotEmpty.wait( lock, [this] { return ! mItems.empty() || mClosed; } );
+        if( mItems.empty() ) {
+            return false;
+        }
+        *item = std::move( mItems.front() );
+        mItems.pop_front();
+        mNotFull.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        mClosed = true;
+        mNotEmpty.notify_all();
+    }
+
+  private:
+    std::mutex mMutex;
+    std::condition_variable mNotFull;
+    std::condition_variable mNotEmpty;
+    std::deque<T> mItems;
+    size_t mCapacity;
+    bool mClosed = false;
+};
+
+// Seconds of thread time spent in a stage, added to by every thread of the stage.
+class StageTime {
+  public:
+    void add( std::chrono::duration<double> duration ) { mNanoseconds += static_cast<long long>( duration.count() * 1e9 ); }
+    double seconds() const { return mNanoseconds.load() * 1e-9; }
+
+  private:
+    std::atomic<long long> mNanoseconds{ 0 };
+};
+
+void printUsage()
+{
+    std::fprintf( stderr,
+        "usage: DitherCli [options] <input>... -o <directory>\n"
+        "\n"
+        "  <input>            an image, a directory of images or a pattern such as frames/%%04d.png\n"
+        "  -o <directory>     where the dithered images are written, created if missing\n"
+        "  -a <algorithm>     defaults to FloydSteinberg\n"
+        "  -c <colors>        dithers to a palette of this many colors built from each image;\n"
+        "                     needs one of the black-and-white error diffusion algorithms\n"
+        "  -p <resolution>    looks palette colors up in a table of resolution^3 cells, 0 for none;\n"
+        "                     defaults to 32 from 16 colors and to none below\n"
+        "  -t <threads>       dithering threads, 0 for every hardware thread (the default)\n"
+        "  -f <format>        output file extension, defaults to png\n"
+        "\n"
+        "algorithms:" );
+    for( const Algorithm &algorithm : kAlgorithms ) {
+        std::fprintf( stderr, " %s", algorithm.name );
+    }
+    std::fprintf( stderr, "\n" );
+}
+
+const Algorithm *findAlgorithm( const std::string &name )
+{
+    for( const Algorithm &algorithm : kAlgorithms ) {
+        if( name == algorithm.name ) {
+            return &algorithm;
+        }
+    }
+    return nullptr;
+}
+
+bool parseArguments( int argc, char **argv, Settings *settings )
+{
+    settings->algorithm = findAlgorithm( "FloydSteinberg" );
+    for( int i = 1; i < argc; i++ ) {
+        const std::string argument = argv[i];
+        if( argument.size() == 2 && argument[0] == '-' ) {
+            if( i + 1 == argc ) {
+                std::fprintf( stderr, "%s needs a value\n", argument.c_str() );
+                return false;
+            }
+            const std::string value = argv[++i];
+            switch( argument[1] ) {
+                case 'o': settings->output = value; break;
+                case 'a':
+                    settings->algorithm = findAlgorithm( value );
+                    if( ! settings->algorithm ) {
+                        std::fprintf( stderr, "unknown algorithm %s\n", value.c_str() );
+                        return false;
+                    }
+                    break;
+                case 'c': settings->colors = std::atoi( value.c_str() ); break;
+                case 'p': settings->tableResolution = std::max( std::atoi( value.c_str() ), 0 ); break;
+                case 't': settings->threads = static_cast<size_t>( std::max( std::atoi( value.c_str() ), 0 ) ); break;
+                case 'f': settings->format = value[0] == '.' ? value.substr( 1 ) : value; break;
+                default: std::fprintf( stderr, "unknown option %s\n", argument.c_str() ); return false;
+            }
+        }
+        else {
+            settings->inputs.push_back( argument );
+        }
+    }
+
+    if( settings->inputs.empty() || settings->output.empty() ) {
+        return false;
+    }
+    if( settings->colors > 0 && ! settings->algorithm->palette ) {
+        std::fprintf( stderr, "%s can't dither to a palette\n", settings->algorithm->name );
+        return false;
+    }
+    return true;
+}
+
+bool isImage( const fs::path &path )
+{
+    std::string extension = path.extension().string();
+    std::transform( extension.begin(), extension.end(), extension.begin(), []( unsigned char c ) { return static_cast<char>( std::tolower( c ) ); } );
+    return std::find( std::begin( kImageExtensions ), std::end( kImageExtensions ), extension ) != std::end( kImageExtensions );
+}
+
+// Whether \a input is a sequence pattern: a name whose only printf conversion is one
+// %d, with an optional width, and whose other percent signs are escaped as %%. Only
+// such a name is safe to hand to snprintf() with an int.
+bool isPattern( const std::string &input )
+{
+    int conversions = 0;
+    for( size_t i = 0; i < input.size(); i++ ) {
+        if( input[i] != '%' ) {
+            continue;
+        }
+        if( i + 1 < input.size() && input[i + 1] == '%' ) {
+            i++;
+            continue;
+        }
+        size_t end = i + 1;
+        while( end < input.size() && std::isdigit( static_cast<unsigned char>( input[end] ) ) ) {
+            end++;
+        }
+        if( end == input.size() || input[end] != 'd' ) {
+            return false;
+        }
+        conversions++;
+        i = end;
+    }
+    return conversions == 1;
+}
+
+// Returns frame \a frame of the sequence \a pattern, which isPattern() accepted.
+std::string patternFrame( const std::string &pattern, int frame )
+{
+    const int length = std::snprintf( nullptr, 0, pattern.c_str(), frame );
+    std::vector<char> name( static_cast<size_t>( std::max( length, 0 ) ) + 1 );
+    std::snprintf( name.data(), name.size(), pattern.c_str(), frame );
+    return name.data();
+}
+
+// Expands the inputs into the images to dither, in order, and where to write each one.
+// Returns false if two images would be written to the same output.
+bool listJobs( const Settings &settings, std::vector<Job> *jobs )
+{
+    std::vector<fs::path> images;
+    for( const std::string &input : settings.inputs ) {
+        std::error_code error;
+        if( isPattern( input ) ) {
+            for( int frame = 0;; frame++ ) {
+                const std::string name = patternFrame( input, frame );
+                if( fs::exists( name, error ) ) {
+                    images.push_back( name );
+                }
+                else if( frame > 0 ) {
+                    break;
+                }
+            }
+        }
+        else if( fs::is_directory( input, error ) ) {
+            std::vector<fs::path> entries;
+            for( const fs::directory_entry &entry : fs::directory_iterator( input, error ) ) {
+                if( entry.is_regular_file( error ) && isImage( entry.path() ) ) {
+                    entries.push_back( entry.path() );
+                }
+            }
+            std::sort( entries.begin(), entries.end() );
+            images.insert( images.end(), entries.begin(), entries.end() );
+        }
+        else if( fs::exists( input, error ) ) {
+            images.push_back( input );
+        }
+        else {
+            std::fprintf( stderr, "skipping %s: no such file or directory\n", input.c_str() );
+        }
+    }
+
+    std::map<fs::path, fs::path> written;
+    bool unique = true;
+    for( const fs::path &image : images ) {
+        Job job;
+        job.input = image;
+        job.output = settings.output / image.stem();
+        job.output += "." + settings.format;
+        const auto inserted = written.emplace( job.output.lexically_normal(), image );
+        if( ! inserted.second ) {
+            std::fprintf( stderr, "%s and %s would both be written to %s\n", inserted.first->second.string().c_str(), image.string().c_str(),
+                job.output.string().c_str() );
+            unique = false;
+        }
+        jobs->push_back( job );
+    }
+    return unique;
+}
+
+}
+
+int main( int argc, char **argv )
+{
+    Settings settings;
+    if( ! parseArguments( argc, argv, &settings ) ) {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<Job> jobs;
+    if( ! listJobs( settings, &jobs ) ) {
+        return 1;
+    }
+    if( jobs.empty() ) {
+        std::fprintf( stderr, "no images to dither\n" );
+        return 1;
+    }
+    std::error_code error;
+    fs::create_directories( settings.output, error );
+    if( error ) {
+        std::fprintf( stderr, "can't create %s: %s\n", settings.output.string().c_str(), error.message().c_str() );
+        return 1;
+    }
+
+    BatchDitherer batch( settings.threads );
+    const size_t threads = batch.getThreads();
+    // decoding and encoding mostly wait on the disk and the codec, so they get fewer threads
+    const size_t ioThreads = std::max<size_t>( threads / 2, 1 );
+    const size_t capacity = 2 * threads;
+
+    BoundedQueue<Job> decoded( capacity );
+    BoundedQueue<Job> dithered( capacity );
+    StageTime decodeTime, ditherTime, encodeTime;
+    std::atomic<size_t> nextJob{ 0 };
+    std::atomic<size_t> decoders{ ioThreads };
+    std::atomic<size_t> failures{ 0 };
+    std::atomic<size_t> written{ 0 };
+    std::atomic<long long> pixels{ 0 };
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for( size_t i = 0; i < ioThreads; i++ ) {
+        workers.emplace_back( [&] {
+            for( size_t index = nextJob++; index < jobs.size(); index = nextJob++ ) {
+                Job job = jobs[index];
+                const auto begin = std::chrono::steady_clock::now();
+                try {
+                    job.image = Surface32f::create( loadImage( job.input ) );
+                }
+                catch( const std::exception &exception ) {
+                    std::fprintf( stderr, "can't read %s: %s\n", job.input.string().c_str(), exception.what() );
+                    failures++;
+                    continue;
+                }
+                decodeTime.add( std::chrono::steady_clock::now() - begin );
+                decoded.push( std::move( job ) );
+            }
+            if( --decoders == 0 ) {
+                decoded.close();
+            }
+        } );
+    }
+
+    for( size_t i = 0; i < ioThreads; i++ ) {
+        workers.emplace_back( [&] {
+            Job job;
+            while( dithered.pop( &job ) ) {
+                const auto begin = std::chrono::steady_clock::now();
+                try {
+                    writeImage( job.output, *job.image );
+                }
+                catch( const std::exception &exception ) {
+                    std::fprintf( stderr, "can't write %s: %s\n", job.output.string().c_str(), exception.what() );
+                    failures++;
+                    continue;
+                }
+                encodeTime.add( std::chrono::steady_clock::now() - begin );
+                pixels += static_cast<long long>( job.image->getWidth() ) * job.image->getHeight();
+                written++;
+            }
+        } );
+    }
+
+    // Feeds the decoded images to the batch, at most capacity of them at a time: a
+    // finished image frees its slot once the encoders have room for it.
+    std::mutex slotMutex;
+    std::condition_variable slotFree;
+    size_t inFlight = 0;
+
+    const Algorithm &algorithm = *settings.algorithm;
+    const int colors = settings.colors;
+    const int tableResolution = settings.tableResolution >= 0 ? settings.tableResolution : colors >= 16 ? 32 : 0;
+    const BatchDitherer::Function function = [&algorithm, colors, tableResolution]( Surface32fRef input, Surface32fRef output, const Options &options ) {
+        if( colors > 0 ) {
+            algorithm.palette( input, output, buildPalette( input, colors, options ), Options( options ).paletteTable( tableResolution ) );
+        }
+        else {
+            algorithm.dither( input, output, options );
+        }
+    };
+
+    Job job;
+    while( decoded.pop( &job ) ) {
+        {
+            std::unique_lock<std::mutex> lock( slotMutex );
+            slotFree.wait( lock, [&] { return inFlight < capacity; } );
+            inFlight++;
+        }
+        auto output = std::make_shared<Job>( std::move( job ) );
+        batch.dither( { output->image }, function, [&, output]( const BatchDitherer::Result &result ) {
+            ditherTime.add( std::chrono::duration<double>( result.seconds ) );
+            if( result.error ) {
+                try {
+                    std::rethrow_exception( result.error );
+                }
+                catch( const std::exception &exception ) {
+                    std::fprintf( stderr, "can't dither %s: %s\n", output->input.string().c_str(), exception.what() );
+                }
+                catch( ... ) {
+                    std::fprintf( stderr, "can't dither %s\n", output->input.string().c_str() );
+                }
+                failures++;
+            }
+            else {
+                output->image = result.output;
+                dithered.push( std::move( *output ) );
+            }
+            std::lock_guard<std::mutex> lock( slotMutex );
+            inFlight--;
+            slotFree.notify_one();
+        } );
+    }
+    batch.wait();
+    dithered.close();
+    for( std::thread &worker : workers ) {
+        worker.join();
+    }
+
+    const double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    const double megapixels = pixels.load() * 1e-6;
+    std::printf( "%s: %zu images, %.1f megapixels in %.2f s, %.2f images/s, %.1f megapixels/s\n", algorithm.name, written.load(), megapixels, seconds,
+        written.load() / seconds, megapixels / seconds );
+    std::printf( "thread time: decode %.2f s on %zu threads, dither %.2f s on %zu, encode %.2f s on %zu\n", decodeTime.seconds(), ioThreads,
+        ditherTime.seconds(), threads, encodeTime.seconds(), ioThreads );
+    if( failures.load() ) {
+        std::printf( "%zu images failed\n", failures.load() );
+    }
+    return failures.load() ? 1 : 0;
+}